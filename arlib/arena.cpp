@@ -0,0 +1,141 @@
+#include "arena.h"
+
+arena::~arena()
+{
+	while (m_chunk)
+	{
+		chunk* prev = m_chunk->prev;
+		free(m_chunk);
+		m_chunk = prev;
+	}
+}
+
+void* arena::alloc_slow(size_t bytes, size_t align)
+{
+	// malloc returns memory aligned for anything, so the data after the header is aligned to the header size's lowest set bit,
+	//  or to max_align_t if that's smaller; anything above that needs room to round up
+	size_t data_align = min(sizeof(chunk) & -sizeof(chunk), alignof(max_align_t));
+	size_t size = max(m_next_size, bytes + (align > data_align ? align : 0));
+	m_next_size = min(m_next_size*2, max_chunk_size);
+	
+	chunk* c = (chunk*)xmalloc(sizeof(chunk) + size);
+	c->prev = m_chunk;
+	c->size = size;
+	m_chunk = c;
+	m_at = (uint8_t*)(c+1);
+	m_end = m_at + size;
+	
+	return alloc(bytes, align);
+}
+
+void* arena::resize(void* ptr, size_t oldsize, size_t newsize, size_t align)
+{
+	uint8_t* bptr = (uint8_t*)ptr;
+	if (bptr && bptr + oldsize == m_at && newsize <= (size_t)(m_end - bptr))
+	{
+		m_at = bptr + newsize;
+		return ptr;
+	}
+	void* ret = alloc(newsize, align);
+	if (oldsize)
+		memcpy(ret, ptr, min(oldsize, newsize));
+	return ret;
+}
+
+cstrnul arena::strdup(cstring str)
+{
+	size_t len = str.length();
+	uint8_t* ret = (uint8_t*)alloc(len+1, 1);
+	memcpy(ret, str.bytes().ptr(), len);
+	ret[len] = '\0';
+	return cstrnul(bytesr(ret, len), cstrnul::has_nul());
+}
+
+void arena::reset()
+{
+	if (!m_chunk)
+		return;
+	if (m_chunk->prev)
+	{
+		// replace them all with one chunk that's big enough for everything, so doing the same thing again won't need to malloc
+		size_t total = 0;
+		while (m_chunk)
+		{
+			chunk* prev = m_chunk->prev;
+			total += m_chunk->size;
+			free(m_chunk);
+			m_chunk = prev;
+		}
+		m_chunk = (chunk*)xmalloc(sizeof(chunk) + total);
+		m_chunk->prev = NULL;
+		m_chunk->size = total;
+		m_next_size = min(max(total, m_next_size), max_chunk_size);
+	}
+	m_at = (uint8_t*)(m_chunk+1);
+	m_end = m_at + m_chunk->size;
+}
+
+#include "test.h"
+
+test("arena", "string", "arena")
+{
+	arena a(64);
+	
+	uint8_t* p1 = (uint8_t*)a.alloc(3, 1);
+	uint32_t* p2 = (uint32_t*)a.alloc(4, 4);
+	assert_eq((uintptr_t)p2 % 4, 0);
+	assert((uint8_t*)p2 >= p1+3);
+	void* p3 = a.alloc(1, 64); // bigger than the header alignment
+	assert_eq((uintptr_t)p3 % 64, 0);
+	
+	// bigger than a chunk
+	uint8_t* big = (uint8_t*)a.alloc(10000, 1);
+	memset(big, 1, 10000);
+	
+	cstrnul s1 = a.strdup("hello");
+	cstrnul s2 = a.strdup("a string that's too long to be stored inline");
+	assert_eq(s1, "hello");
+	assert_eq(s2, "a string that's too long to be stored inline");
+	assert_eq((const char*)s2, (const char*)"a string that's too long to be stored inline");
+	
+	struct pod { int a; int b; };
+	pod* p = a.make<pod>(1, 2);
+	assert_eq(p->b, 2);
+	
+	// the most recent allocation can grow in place
+	uint8_t* r = (uint8_t*)a.alloc(8, 1);
+	assert_eq((uint8_t*)a.resize(r, 8, 16, 1), r);
+	a.alloc(1, 1);
+	uint8_t* r2 = (uint8_t*)a.resize(r, 16, 32, 1);
+	assert(r2 != r);
+	
+	{
+		// rounding up to the alignment goes past the end of the chunk
+		arena a2(100);
+		uint8_t* q1 = (uint8_t*)a2.alloc(99, 1);
+		uint8_t* q2 = (uint8_t*)a2.alloc(8, 8);
+		assert_eq((uintptr_t)q2 % 8, 0);
+		assert(q2+8 <= q1 || q2 >= q1+100);
+	}
+	
+	arena_array<int> arr(a);
+	for (int i=0;i<1000;i++)
+		arr.append(i);
+	assert_eq(arr.size(), 1000);
+	int n = 0;
+	for (int i : arr)
+		assert_eq(i, n++);
+	arrayview<int> view = arr;
+	assert_eq(view[999], 999);
+	
+	// after a reset, doing the same thing again doesn't need any more memory
+	a.reset();
+	test_nomalloc {
+		a.alloc(3, 1);
+		a.alloc(4, 4);
+		a.alloc(1, 64);
+		a.alloc(10000, 1);
+		a.strdup("a string that's too long to be stored inline");
+		a.reset();
+	}
+}
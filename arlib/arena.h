@@ -0,0 +1,117 @@
+#pragma once
+#include "global.h"
+#include "array.h"
+#include "string.h"
+
+// A region allocator. Allocating is usually just a pointer bump; everything is freed at once, by reset() or the destructor.
+// Memory comes from a chain of chunks, each twice the size of the previous one (up to a limit). reset() replaces them with
+//  a single chunk as big as all of them together, so an arena reused for similar work stops calling malloc after the first round.
+// Nothing allocated from an arena is ever destructed, so only trivially destructible types may be stored in it.
+// (cstring is fine; string and array are not. Use strdup and arena_array instead.)
+class arena : nocopy {
+	struct chunk {
+		chunk* prev;
+		size_t size; // bytes after the header
+	};
+	chunk* m_chunk = NULL;
+	uint8_t* m_at = NULL;
+	uint8_t* m_end = NULL;
+	size_t m_next_size;
+	
+	static const size_t max_chunk_size = 1024*1024;
+	
+	void* alloc_slow(size_t bytes, size_t align);
+
+public:
+	arena(size_t first_chunk_size = 4096) : m_next_size(first_chunk_size) {}
+	~arena();
+	
+	// align must be a power of two.
+	forceinline void* alloc(size_t bytes, size_t align)
+	{
+		uint8_t* ret = (uint8_t*)(((uintptr_t)m_at + align-1) & ~(uintptr_t)(align-1));
+		if (ret > m_end || bytes > (size_t)(m_end - ret)) // the former is if rounding up went past the end of the chunk
+			return alloc_slow(bytes, align);
+		m_at = ret + bytes;
+		return ret;
+	}
+	// Makes the given allocation bigger or smaller. If it's the most recent allocation and there's room, it's resized in place;
+	//  otherwise, the contents are copied, and the old allocation is left unused until the next reset().
+	void* resize(void* ptr, size_t oldsize, size_t newsize, size_t align);
+	
+	template<typename T, typename... Ts>
+	T* make(Ts&&... args)
+	{
+		static_assert(std::is_trivially_destructible_v<T>);
+		return new(alloc(sizeof(T), alignof(T))) T(std::forward<Ts>(args)...);
+	}
+	// The items are uninitialized.
+	template<typename T>
+	T* alloc_array(size_t count)
+	{
+		static_assert(std::is_trivially_destructible_v<T>);
+		return (T*)alloc(sizeof(T)*count, alignof(T));
+	}
+	// The returned string is valid until the arena is reset or destroyed.
+	cstrnul strdup(cstring str);
+	
+	// Frees everything allocated from this arena.
+	void reset();
+};
+
+// Like array<T>, but the storage comes from an arena; T must be trivially destructible.
+// Growing copies the items to a new allocation, unless nothing else was allocated from the arena since last time.
+template<typename T>
+class arena_array : nocopy {
+	static_assert(std::is_trivially_destructible_v<T>);
+	
+	arena* m_arena;
+	T* m_items = NULL;
+	size_t m_count = 0;
+	size_t m_capacity = 0;
+	
+	void reserve(size_t n)
+	{
+		if (n <= m_capacity)
+			return;
+		size_t new_capacity = max(bitround(n), (size_t)4);
+		m_items = (T*)m_arena->resize(m_items, sizeof(T)*m_capacity, sizeof(T)*new_capacity, alignof(T));
+		m_capacity = new_capacity;
+	}
+
+public:
+	arena_array(arena& a) : m_arena(&a) {}
+	
+	T& append(const T& item)
+	{
+		reserve(m_count+1);
+		return *new(&m_items[m_count++]) T(item);
+	}
+	T& append()
+	{
+		reserve(m_count+1);
+		return *new(&m_items[m_count++]) T();
+	}
+	void resize(size_t n)
+	{
+		reserve(n);
+		for (size_t i=m_count;i<n;i++)
+			new(&m_items[i]) T();
+		m_count = n;
+	}
+	void reset() { m_count = 0; }
+	
+	size_t size() const { return m_count; }
+	T& operator[](size_t n) { return m_items[n]; }
+	const T& operator[](size_t n) const { return m_items[n]; }
+	T* ptr() { return m_items; }
+	const T* ptr() const { return m_items; }
+	
+	operator arrayview<T>() const { return arrayview<T>(m_items, m_count); }
+	operator arrayvieww<T>() { return arrayvieww<T>(m_items, m_count); }
+	
+	T* begin() { return m_items; }
+	T* end() { return m_items+m_count; }
+	const T* begin() const { return m_items; }
+	const T* end() const { return m_items+m_count; }
+};
@@ -10,14 +10,20 @@
 #include "endian.h"
 #include "function.h"
 #include "set.h"
+#include "btree.h"
 
+#include "arena.h"
 #include "bytepipe.h"
 #include "file.h"
+#include "intern.h"
+#include "lrucache.h"
 #include "os.h"
 #include "random.h"
 #include "stringconv.h"
 
 #include "thread/thread.h" //no ifdef on this one, it contains some dummy implementations if threads are disabled
+#include "thread/queue.h"
+#include "concurrentmap.h"
 #include "json.h"
 
 #include "argparse.h"
@@ -25,6 +31,7 @@
 #include "bytestream.h"
 #include "crc32.h"
 #include "deflate.h"
+#include "filter.h"
 #include "image.h"
 #include "inotify.h"
 #include "prioqueue.h"
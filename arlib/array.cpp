@@ -1,4 +1,134 @@
 #include "array.h"
+#include "simd.h"
+
+template<bitarray::bitop_t op>
+void bitarray::bitop_chunks(chunk_t * dst, const chunk_t * src, size_t n)
+{
+	auto scalar = [](chunk_t a, chunk_t b) -> chunk_t {
+		if (op == op_and) return a & b;
+		if (op == op_or) return a | b;
+		if (op == op_xor) return a ^ b;
+		if (op == op_andnot) return a & ~b;
+		__builtin_unreachable();
+	};
+	size_t i = 0;
+#ifdef runtime__SSE2__
+	if (runtime__SSE2__)
+	{
+		for (;i+4<=n;i+=4)
+		{
+			__m128i a = _mm_loadu_si128((__m128i*)(dst+i));
+			__m128i b = _mm_loadu_si128((__m128i*)(src+i));
+			if (op == op_and) a = _mm_and_si128(a, b);
+			if (op == op_or) a = _mm_or_si128(a, b);
+			if (op == op_xor) a = _mm_xor_si128(a, b);
+			if (op == op_andnot) a = _mm_andnot_si128(b, a);
+			_mm_storeu_si128((__m128i*)(dst+i), a);
+		}
+	}
+#endif
+	for (;i<n;i++)
+		dst[i] = scalar(dst[i], src[i]);
+}
+template void bitarray::bitop_chunks<bitarray::op_and>(chunk_t * dst, const chunk_t * src, size_t n);
+template void bitarray::bitop_chunks<bitarray::op_or>(chunk_t * dst, const chunk_t * src, size_t n);
+template void bitarray::bitop_chunks<bitarray::op_xor>(chunk_t * dst, const chunk_t * src, size_t n);
+template void bitarray::bitop_chunks<bitarray::op_andnot>(chunk_t * dst, const chunk_t * src, size_t n);
+
+static forceinline size_t popcount_chunks_inner(const uint32_t * chunks, size_t n)
+{
+	// two chunks at the time, 32bit popcount is slower on most platforms
+	size_t ret = 0;
+	size_t i = 0;
+	for (;i+2<=n;i+=2)
+		ret += __builtin_popcountll(chunks[i] | (uint64_t)chunks[i+1]<<32);
+	if (i < n)
+		ret += __builtin_popcount(chunks[i]);
+	return ret;
+}
+#ifdef runtime__POPCNT__
+__attribute__((target("popcnt")))
+static size_t popcount_chunks_popcnt(const uint32_t * chunks, size_t n)
+{
+	return popcount_chunks_inner(chunks, n);
+}
+#endif
+
+size_t bitarray::popcount_chunks(const chunk_t * chunks, size_t n)
+{
+#ifdef runtime__POPCNT__
+	if (runtime__POPCNT__)
+		return popcount_chunks_popcnt(chunks, n);
+#endif
+	return popcount_chunks_inner(chunks, n);
+}
+
+bitarray& bitarray::operator&=(const bitarray& other)
+{
+	size_t n_chunks = n_chunks_for(nbits);
+	size_t n_other = n_chunks_for(other.nbits);
+	if (n_other >= n_chunks)
+	{
+		bitop_chunks<op_and>(bits(), other.bits(), n_chunks);
+	}
+	else
+	{
+		bitop_chunks<op_and>(bits(), other.bits(), n_other);
+		memset(bits()+n_other, 0, sizeof(chunk_t)*(n_chunks-n_other));
+	}
+	return *this;
+}
+
+bitarray::rank_index::rank_index(const bitarray& parent) : parent(parent)
+{
+	const chunk_t * chunks = parent.bits();
+	size_t n_chunks = n_chunks_for(parent.nbits);
+	size_t total = 0;
+	for (size_t i=0;i<n_chunks;i+=chunks_per_block)
+	{
+		blocks.append(total);
+		total += popcount_chunks(chunks+i, min(chunks_per_block, n_chunks-i));
+	}
+	blocks.append(total);
+}
+
+size_t bitarray::rank_index::rank(size_t n) const
+{
+	size_t block = n / (chunks_per_block*chunk_size);
+	return blocks[block] + bitarray::popcount(parent.bits(), block*chunks_per_block*chunk_size, n);
+}
+
+size_t bitarray::rank_index::select(size_t n) const
+{
+	if (n >= popcount())
+		return parent.nbits;
+	
+	// find the last block with at most n set bits before it
+	size_t lo = 0;
+	size_t hi = blocks.size()-1;
+	while (hi-lo > 1)
+	{
+		size_t mid = (lo+hi)/2;
+		if (blocks[mid] <= n) lo = mid;
+		else hi = mid;
+	}
+	
+	n -= blocks[lo];
+	const chunk_t * chunks = parent.bits();
+	size_t i = lo*chunks_per_block;
+	while (true)
+	{
+		size_t count = __builtin_popcount(chunks[i]);
+		if (n < count)
+			break;
+		n -= count;
+		i++;
+	}
+	chunk_t chunk = chunks[i];
+	while (n--)
+		chunk &= chunk-1;
+	return i*chunk_size + ilog2(chunk & -chunk);
+}
 
 void bitarray::set_slice(size_t start, size_t num, const bitarray& other, size_t other_start)
 {
@@ -103,24 +233,28 @@ void bitarray::resize(size_t len)
 
 bitarray bitarray::slice(size_t first, size_t count) const
 {
-	if ((first&7) == 0)
+	bitarray ret;
+	ret.resize(count);
+	
+	const chunk_t * src = this->bits();
+	chunk_t * dst = ret.bits();
+	size_t src_chunks = n_chunks_for(this->nbits);
+	size_t shift = first & (chunk_size-1);
+	for (size_t i=0;i<n_chunks_for(count);i++)
 	{
-		bitarray ret;
-		ret.resize(count);
-		memcpy(ret.bits(), this->bits() + first/8, (count+7)/8);
-		return ret;
-	}
-	else
-	{
-		//TODO: optimize
-		bitarray ret;
-		ret.resize(count);
-		for (size_t i=0;i<count;i++) ret.set(i, this->get(first+i));
-		return ret;
+		size_t src_idx = first/chunk_size + i;
+		chunk_t chunk = src[src_idx] >> shift;
+		if (shift && src_idx+1 < src_chunks)
+			chunk |= src[src_idx+1] << (chunk_size-shift);
+		dst[i] = chunk;
 	}
+	if (count & (chunk_size-1))
+		dst[count/chunk_size] &= ~(~(chunk_t)0 << (count & (chunk_size-1)));
+	return ret;
 }
 
 #include "test.h"
+#include "random.h"
 
 #ifdef ARLIB_TEST
 test("array", "", "array")
@@ -295,9 +429,158 @@ test("array", "", "array")
 		array<int> f = { 1, 2, 12, 13, 12, 13, 10, 11, 10, 11, 12, 13, 2, 10, 3, 4, 5, 6, 7, 8 };
 		assert_eq(a, f);
 	}
+	
+	{
+		inline_array<int,4> a;
+		test_nomalloc {
+			a.append(1);
+			a.append(2);
+			a.append(3);
+			a.insert(0, 0);
+		}
+		assert_eq(arrayview<int>(a), (array<int>{ 0, 1, 2, 3 }));
+		a.append(4); // spills to the heap
+		a.append(5);
+		assert_eq(arrayview<int>(a), (array<int>{ 0, 1, 2, 3, 4, 5 }));
+		a.remove(0);
+		a.remove(0); // and back
+		assert_eq(arrayview<int>(a), (array<int>{ 2, 3, 4, 5 }));
+		a.resize(10);
+		assert_eq(a.size(), 10);
+		assert_eq(a[4], 0);
+		a.resize(1);
+		assert_eq(arrayview<int>(a), (array<int>{ 2 }));
+		a.append(a[0]);
+		assert_eq(arrayview<int>(a), (array<int>{ 2, 2 }));
+	}
+	
+	{
+		// inline and heap-backed items must both survive copies, moves, and relocation by their container
+		array<inline_array<string,2>> a;
+		for (int i=0;i<50;i++)
+		{
+			inline_array<string,2>& b = a.append();
+			for (int j=0;j<i%4;j++)
+				b.append("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"+tostring(j));
+		}
+		for (int i=0;i<50;i++)
+		{
+			assert_eq(a[i].size(), i%4);
+			for (int j=0;j<i%4;j++)
+				assert_eq(a[i][j], "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"+tostring(j));
+		}
+		inline_array<string,2> b = a[3];
+		inline_array<string,2> c = std::move(b);
+		assert_eq(b.size(), 0);
+		assert_eq(c.size(), 3);
+		c = a[1];
+		assert_eq(c.size(), 1);
+		b = { "x", "y", "z" };
+		c = b;
+		assert_eq(c.pop_tail(), "z");
+		assert_eq(c.size(), 2);
+		assert_eq(b.size(), 3);
+		c.reset();
+		assert(!c);
+	}
 }
 
 
+namespace {
+struct sortrec {
+	uint32_t key;
+	uint32_t seq;
+};
+}
+test("sort", "array", "")
+{
+	for (size_t size : { 0, 1, 5, 31, 32, 33, 64, 65, 1000, 4097, 100000 })
+	{
+		random_t rand(size);
+		array<sortrec> recs;
+		for (size_t i=0;i<size;i++)
+			recs.append({ rand((uint32_t)(size/4+1)), (uint32_t)i });
+		array<sortrec> recs2 = recs;
+		array<sortrec> recs3 = recs;
+		
+		// stable: equal keys stay in their original order
+		recs.ssort([](const sortrec& a, const sortrec& b) { return a.key < b.key; });
+		for (size_t i=1;i<size;i++)
+		{
+			assert_lte(recs[i-1].key, recs[i].key);
+			if (recs[i-1].key == recs[i].key)
+				assert_lt(recs[i-1].seq, recs[i].seq);
+		}
+		
+		recs2.radix_sort([](const sortrec& r) { return r.key; });
+		for (size_t i=0;i<size;i++)
+		{
+			assert_eq(recs2[i].key, recs[i].key);
+			assert_eq(recs2[i].seq, recs[i].seq);
+		}
+		
+		recs3.sort([](const sortrec& a, const sortrec& b) { return a.key < b.key; });
+		for (size_t i=0;i<size;i++)
+			assert_eq(recs3[i].key, recs[i].key);
+		
+		// sorted and reverse sorted input
+		recs.ssort([](const sortrec& a, const sortrec& b) { return a.seq > b.seq; });
+		for (size_t i=0;i<size;i++)
+			assert_eq(recs[i].seq, size-1-i);
+		recs.ssort([](const sortrec& a, const sortrec& b) { return a.seq < b.seq; });
+		for (size_t i=0;i<size;i++)
+			assert_eq(recs[i].seq, i);
+	}
+	
+	{
+		array<int> x;
+		array<int64_t> y;
+		array<float> z;
+		random_t rand(1);
+		for (int i=0;i<1000;i++)
+		{
+			x.append((int)rand(0x1000000) - 0x800000);
+			y.append((int64_t)rand(0x1000000) * (i&1 ? -1000000007 : 1000000007));
+			z.append(((int)rand(0x1000000) - 0x800000) / 1000.0f);
+		}
+		z.append(-0.0f);
+		z.append(0.0f);
+		x.sort();
+		y.sort();
+		z.sort();
+		for (size_t i=1;i<x.size();i++)
+			assert_lte(x[i-1], x[i]);
+		for (size_t i=1;i<y.size();i++)
+			assert_lte(y[i-1], y[i]);
+		for (size_t i=1;i<z.size();i++)
+			assert_lte(z[i-1], z[i]);
+		
+		array<uint8_t> w;
+		for (int i=0;i<300;i++)
+			w.append(rand(256));
+		w.sort();
+		for (size_t i=1;i<w.size();i++)
+			assert_lte(w[i-1], w[i]);
+		
+		// too big for radix sort, must use the comparison sort
+		array<long double> v;
+		for (int i=0;i<300;i++)
+			v.append(((int)rand(0x1000000) - 0x800000) / 1000.0L);
+		v.sort();
+		for (size_t i=1;i<v.size();i++)
+			assert(v[i-1] <= v[i]); // no tostring(long double)
+	}
+	
+	{
+		array<int> x;
+		for (int i=0;i<1000;i++)
+			x.append(i);
+		int n_comp = 0;
+		x.ssort([&](int a, int b) { n_comp++; return a<b; });
+		assert_lte(n_comp, x.size());
+	}
+}
+
 static string ones_zeroes(int ones, int zeroes)
 {
 	string ret;
@@ -399,6 +682,98 @@ test("bitarray", "", "array")
 	static_assert(sizeof(bitset<256>) == 256/8);
 }
 
+test("bitarray bulk operations", "", "array")
+{
+	random_t rand(1);
+	
+	for (size_t size : { 0, 1, 31, 32, 33, 64, 100, 511, 512, 513, 5000 })
+	{
+		bitarray a;
+		bitarray b;
+		a.resize(size);
+		b.resize(size/2);
+		for (size_t i=0;i<size;i++)
+			a[i] = rand(2);
+		for (size_t i=0;i<size/2;i++)
+			b[i] = rand(3) == 0;
+		
+		size_t count = 0;
+		for (size_t i=0;i<size;i++)
+			count += a[i];
+		assert_eq(a.popcount(), count);
+		assert_eq(a.popcount(0, size), count);
+		for (size_t start=0;start<size;start+=size/7+1)
+		for (size_t end=start;end<=size;end+=size/5+1)
+		{
+			size_t exp = 0;
+			for (size_t i=start;i<end;i++)
+				exp += a[i];
+			assert_eq(a.popcount(start, end), exp);
+		}
+		
+		for (size_t start=0;start<=size;start++)
+		{
+			size_t exp_set = start;
+			while (exp_set < size && !a[exp_set]) exp_set++;
+			size_t exp_clear = start;
+			while (exp_clear < size && a[exp_clear]) exp_clear++;
+			assert_eq(a.next_set(start), exp_set);
+			assert_eq(a.next_clear(start), exp_clear);
+		}
+		
+		bitarray::rank_index idx(a);
+		assert_eq(idx.popcount(), count);
+		size_t rank = 0;
+		for (size_t i=0;i<=size;i++)
+		{
+			assert_eq(idx.rank(i), rank);
+			if (i < size && a[i])
+			{
+				assert_eq(idx.select(rank), i);
+				rank++;
+			}
+		}
+		assert_eq(idx.select(rank), size);
+		
+		bitarray c;
+		c = a; c &= b;
+		for (size_t i=0;i<size;i++) assert_eq(c.get(i), a[i] && b.get_or(i, false));
+		c = a; c |= b;
+		for (size_t i=0;i<size;i++) assert_eq(c.get(i), a[i] || b.get_or(i, false));
+		c = a; c ^= b;
+		for (size_t i=0;i<size;i++) assert_eq(c.get(i), a[i] != b.get_or(i, false));
+		c = a; c.and_not(b);
+		for (size_t i=0;i<size;i++) assert_eq(c.get(i), a[i] && !b.get_or(i, false));
+		c = b; c &= a;
+		assert_eq(c.size(), size/2);
+		c = b; c ^= a;
+		assert_eq(c.size(), size);
+		assert_eq(c.next_set(size), size); // unused bits must remain clear
+		
+		for (size_t first=0;first<size;first+=size/9+1)
+		{
+			bitarray s = a.slice(first, size-first);
+			assert_eq(s.size(), size-first);
+			for (size_t i=0;i<size-first;i++)
+				assert_eq(s.get(i), a.get(first+i));
+			assert_eq(s.popcount(), a.popcount(first, size));
+		}
+	}
+	
+	bitset<40> x;
+	bitset<40> y;
+	x[3] = true;
+	x[35] = true;
+	y[35] = true;
+	assert_eq(x.popcount(), 2);
+	assert_eq((x^y).popcount(), 1);
+	assert_eq((x|y).popcount(), 2);
+	assert_eq((x&y).next_set(0), 35);
+	assert_eq(x.next_clear(3), 4);
+	assert_eq(x.next_set(36), 40);
+	assert_eq((~x).popcount(5, 40), 34);
+}
+
 // these tests pass if they compile
 inline arrayview<int> test_ret_arrayview()
 {
@@ -5,6 +5,7 @@
 #include <type_traits>
 #include "serialize2-head.h"
 #include "heap.h"
+#include "sort.h"
 
 template<typename T> class arrayview;
 template<typename T> class arrayvieww;
@@ -303,7 +304,15 @@ public:
 	
 	void sort()
 	{
-		// TODO: if integer, use radix sort
+		// long double and 128bit integers don't fit radix_bits; they use the comparison sort
+		if constexpr (std::is_arithmetic_v<T> && sizeof(T) <= 8 && !std::is_same_v<T, long double>)
+		{
+			if (this->count > sorting::radix_min)
+			{
+				radix_sort([](T item) { return item; });
+				return;
+			}
+		}
 		sort([](const T& a, const T& b) { return a < b; });
 	}
 	
@@ -311,36 +320,15 @@ public:
 	template<typename Tless>
 	void ssort(const Tless& less)
 	{
-		// insertion sort; not the fastest, but it's adaptive, it's simple, and its constant factors are good
-		// no real point upgrading to something faster, stable sort is rare
-		for (size_t a=1;a<this->count;a++)
+		// merge sort, with insertion sort for short runs; it's adaptive, sorted input is O(n)
+		if (this->count <= sorting::run_size)
 		{
-			if (!less(this->items[a], this->items[a-1]))
-				continue;
-			
-			size_t probe = 1;
-			while (probe < a && less(this->items[a], this->items[a-probe]))
-				probe *= 2;
-			
-			size_t min = a-probe;
-			probe /= 2;
-			while (probe)
-			{
-				if (min+probe > a || !less(this->items[a], this->items[min+probe]))
-					min += probe;
-				probe /= 2;
-			}
-			
-			if (min > a || !less(this->items[a], this->items[min]))
-				min++;
-			
-			size_t newpos = min;
-			
-			char tmp[sizeof(T)];
-			memcpy((void*)tmp, (void*)&this->items[a], sizeof(T));
-			memmove((void*)&this->items[newpos+1], (void*)&this->items[newpos], sizeof(T)*(a-newpos));
-			memcpy((void*)&this->items[newpos], tmp, sizeof(T));
+			sorting::insertion(this->items, this->count, less);
+			return;
 		}
+		T* scratch = xmalloc(sizeof(T)*this->count);
+		sorting::merge_sort(this->items, scratch, this->count, less);
+		free(scratch);
 	}
 	
 	void ssort()
@@ -348,6 +336,21 @@ public:
 		ssort([](const T& a, const T& b) { return a < b; });
 	}
 	
+	//stable sort by key(item), which must return an integer or float
+	//O(n), and much faster than ssort for big arrays, but needs the same scratch memory
+	template<typename Tkey>
+	void radix_sort(const Tkey& key)
+	{
+		if (this->count <= sorting::radix_min)
+		{
+			ssort([&](const T& a, const T& b) { return key(a) < key(b); });
+			return;
+		}
+		T* scratch = xmalloc(sizeof(T)*this->count);
+		sorting::radix(this->items, scratch, this->count, key);
+		free(scratch);
+	}
+	
 	const T* begin() const { return this->items; }
 	const T* end() const { return this->items+this->count; }
 	T* begin() { return this->items; }
@@ -836,6 +839,165 @@ template<typename T, size_t N, size_t N2>
 struct std::tuple_element<N2, sarray<T, N>> { using type = T; };
 
 
+// Like array<T>, but the first N items are stored inside the object itself; it only allocates if it grows beyond that.
+// Useful for short-lived lists that are almost always short, like split results or a handful of headers.
+// Whether the items are inline depends only on the size, not on any pointer, so it's safe to memcpy like everything else;
+//  the price is that shrinking from N+1 to N items copies them back inline and frees the heap buffer.
+template<typename T, size_t N> class inline_array {
+	static_assert(N > 0);
+	
+	size_t count = 0;
+	union {
+		T* heap;
+		alignas(T) uint8_t storage[sizeof(T)*N];
+	};
+	
+	bool is_inline() const { return count <= N; }
+	T* items() { return is_inline() ? (T*)storage : heap; }
+	const T* items() const { return is_inline() ? (const T*)storage : heap; }
+	
+	// Changes the size, moving the items between inline and heap storage as needed.
+	// New items are uninitialized; removed items must already be destructed.
+	void set_count(size_t newcount)
+	{
+		if (newcount > N)
+		{
+			if (count <= N)
+			{
+				T* newitems = xmalloc(sizeof(T)*array<T>::capacity_for(newcount));
+				memcpy((void*)newitems, storage, sizeof(T)*count);
+				heap = newitems;
+			}
+			else if (newcount > array<T>::capacity_for(count))
+				heap = xrealloc(heap, sizeof(T)*array<T>::capacity_for(newcount));
+			// shrinking without leaving the heap keeps the buffer
+		}
+		else if (count > N)
+		{
+			T* olditems = heap;
+			memcpy(storage, (void*)olditems, sizeof(T)*newcount);
+			free(olditems);
+		}
+		count = newcount;
+	}
+	
+	void clone(arrayview<T> other)
+	{
+		set_count(other.size());
+		T* dst = items();
+		if constexpr (std::is_trivially_copyable_v<T>)
+			memcpy((void*)dst, (void*)other.ptr(), sizeof(T)*count);
+		else
+		{
+			for (size_t i=0;i<count;i++)
+				new(&dst[i]) T(other[i]);
+		}
+	}
+	
+	void destruct_from(size_t start)
+	{
+		if constexpr (!std::is_trivially_destructible_v<T>)
+		{
+			T* ptr = items();
+			for (size_t i=start;i<count;i++)
+				ptr[i].~T();
+		}
+	}
+
+public:
+	inline_array() {}
+	inline_array(const inline_array& other) { clone(other); }
+	inline_array(inline_array&& other)
+	{
+		memcpy((void*)this, (void*)&other, sizeof(*this));
+		other.count = 0;
+	}
+	inline_array(arrayview<T> other) { clone(other); }
+	inline_array(std::initializer_list<T> c) { clone(arrayview<T>(c.begin(), c.size())); }
+	inline_array& operator=(inline_array other)
+	{
+		char tmp[sizeof(*this)];
+		memcpy(tmp, (void*)this, sizeof(*this));
+		memcpy((void*)this, (void*)&other, sizeof(*this));
+		memcpy((void*)&other, tmp, sizeof(*this));
+		return *this;
+	}
+	~inline_array()
+	{
+		destruct_from(0);
+		if (!is_inline())
+			free(heap);
+	}
+	
+	size_t size() const { return count; }
+	explicit operator bool() const { return count; }
+	T* ptr() { return items(); }
+	const T* ptr() const { return items(); }
+	T& operator[](size_t n) { return items()[n]; }
+	const T& operator[](size_t n) const { return items()[n]; }
+	
+	operator arrayview<T>() const { return arrayview<T>(items(), count); }
+	operator arrayvieww<T>() { return arrayvieww<T>(items(), count); }
+	
+	T& insert(size_t index, T&& item)
+	{
+		char tmp[sizeof(T)]; // in case 'item' points into this array
+		new(&tmp) T(std::move(item));
+		
+		set_count(count+1);
+		T* ptr = items();
+		memmove((void*)(ptr+index+1), (void*)(ptr+index), sizeof(T)*(count-1-index));
+		memcpy((void*)(ptr+index), tmp, sizeof(T));
+		return ptr[index];
+	}
+	T& insert(size_t index, const T& item) { return insert(index, T(item)); }
+	T& append(T&& item) { return insert(count, std::move(item)); }
+	T& append(const T& item) { return insert(count, T(item)); }
+	T& append()
+	{
+		set_count(count+1);
+		return *new(&items()[count-1]) T();
+	}
+	
+	void remove(size_t index)
+	{
+		T* ptr = items();
+		ptr[index].~T();
+		memmove((void*)(ptr+index), (void*)(ptr+index+1), sizeof(T)*(count-1-index));
+		set_count(count-1);
+	}
+	T pop_tail()
+	{
+		T ret = std::move(items()[count-1]);
+		remove(count-1);
+		return ret;
+	}
+	
+	void resize(size_t newcount)
+	{
+		if (newcount < count)
+		{
+			destruct_from(newcount);
+			set_count(newcount);
+		}
+		else if (newcount > count)
+		{
+			size_t prevcount = count;
+			set_count(newcount);
+			T* ptr = items();
+			for (size_t i=prevcount;i<newcount;i++)
+				new(&ptr[i]) T();
+		}
+	}
+	void reset() { resize(0); }
+	
+	T* begin() { return items(); }
+	T* end() { return items()+count; }
+	const T* begin() const { return items(); }
+	const T* end() const { return items()+count; }
+};
+
+
 //A refarray acts mostly like a normal array. The difference is that it stores pointers rather than the elements themselves;
 //as such, you can't cast to arrayview or pointer, but you can keep pointers or references to the elements, or insert something virtual.
 template<typename T> class refarray {
@@ -1016,6 +1178,49 @@ protected:
 		return false;
 	}
 	
+	static constexpr bool next_false(const chunk_t * chunks, size_t nbits, size_t start, size_t& ret)
+	{
+		// same as above, but the unused bits at the end are clear, so they need a bounds check
+		for (size_t i=start/chunk_size;i<n_chunks_for(nbits);i++)
+		{
+			chunk_t chunk = ~chunks[i];
+			if (i == start/chunk_size)
+				chunk &= ~(chunk_t)0 << (start & (chunk_size-1));
+			if (chunk)
+			{
+				ret = i*chunk_size + ilog2(chunk & -chunk);
+				return ret < nbits;
+			}
+		}
+		return false;
+	}
+	
+	static constexpr size_t popcount(const chunk_t * chunks, size_t start, size_t end)
+	{
+		if (start >= end)
+			return 0;
+		size_t first = start/chunk_size;
+		size_t last = (end-1)/chunk_size;
+		chunk_t first_mask = ~(chunk_t)0 << (start & (chunk_size-1));
+		chunk_t last_mask = ~(chunk_t)0 >> (-end & (chunk_size-1));
+		if (first == last)
+			return __builtin_popcount(chunks[first] & first_mask & last_mask);
+		size_t ret = __builtin_popcount(chunks[first] & first_mask) + __builtin_popcount(chunks[last] & last_mask);
+		if (std::is_constant_evaluated())
+		{
+			for (size_t i=first+1;i<last;i++)
+				ret += __builtin_popcount(chunks[i]);
+			return ret;
+		}
+		return ret + popcount_chunks(chunks+first+1, last-first-1);
+	}
+	
+	// these two are SIMD accelerated, if possible
+	static size_t popcount_chunks(const chunk_t * chunks, size_t n);
+	enum bitop_t { op_and, op_or, op_xor, op_andnot };
+	template<bitop_t op>
+	static void bitop_chunks(chunk_t * dst, const chunk_t * src, size_t n);
+	
 	template<size_t size>
 	friend class bitset;
 	
@@ -1152,13 +1357,59 @@ public:
 		return *this;
 	}
 	
+	// |= and ^= extend this to the other's size, if needed. &= and and_not do not; the other bitarray is treated as
+	//  having infinitely many false bits at the end.
 	bitarray& operator|=(const bitarray& other)
 	{
 		if (other.nbits >= nbits) resize(other.nbits);
-		for (size_t n=0;n*chunk_size < other.nbits;n++)
-			bits()[n] |= other.bits()[n];
+		bitop_chunks<op_or>(bits(), other.bits(), n_chunks_for(other.nbits));
+		return *this;
+	}
+	bitarray& operator^=(const bitarray& other)
+	{
+		if (other.nbits >= nbits) resize(other.nbits);
+		bitop_chunks<op_xor>(bits(), other.bits(), n_chunks_for(other.nbits));
 		return *this;
 	}
+	bitarray& operator&=(const bitarray& other);
+	// Clears every bit that's set in the other bitarray.
+	bitarray& and_not(const bitarray& other)
+	{
+		bitop_chunks<op_andnot>(bits(), other.bits(), n_chunks_for(min(nbits, other.nbits)));
+		return *this;
+	}
+	
+	// Number of set bits, either total or in [start, end).
+	size_t popcount() const { return popcount_chunks(bits(), n_chunks_for(nbits)); }
+	size_t popcount(size_t start, size_t end) const { return popcount(bits(), start, end); }
+	
+	// Index of the first set or clear bit at or after start, or size() if there is none.
+	size_t next_set(size_t start) const
+	{
+		size_t ret;
+		if (next_true(bits(), nbits, start, ret)) return ret;
+		else return nbits;
+	}
+	size_t next_clear(size_t start) const
+	{
+		size_t ret;
+		if (next_false(bits(), nbits, start, ret)) return ret;
+		else return nbits;
+	}
+	
+	// Directory for O(1) rank and O(log n) select queries. It refers to the bitarray, and must be rebuilt if it changes.
+	class rank_index {
+		const bitarray& parent;
+		static const size_t chunks_per_block = 16;
+		array<size_t> blocks; // number of set bits before each block of 512 bits; the last one is the total
+	public:
+		rank_index(const bitarray& parent);
+		// Number of set bits before (not including) index n.
+		size_t rank(size_t n) const;
+		// Index of the set bit that has n set bits before it, or size() if there are not that many.
+		size_t select(size_t n) const;
+		size_t popcount() const { return blocks[blocks.size()-1]; }
+	};
 	
 	explicit operator bool() const { return size(); }
 	
@@ -1255,13 +1506,27 @@ public:
 			bits[i] |= other.bits[i];
 		return *this;
 	}
-	constexpr bitset operator&(const bitset& other) const
+	constexpr bitset& operator&=(const bitset& other)
 	{
-		bitset ret;
 		for (size_t i=0;i<ARRAY_SIZE(bits);i++)
-			ret.bits[i] = bits[i] & other.bits[i];
-		return ret;
+			bits[i] &= other.bits[i];
+		return *this;
+	}
+	constexpr bitset& operator^=(const bitset& other)
+	{
+		for (size_t i=0;i<ARRAY_SIZE(bits);i++)
+			bits[i] ^= other.bits[i];
+		return *this;
+	}
+	constexpr bitset& and_not(const bitset& other)
+	{
+		for (size_t i=0;i<ARRAY_SIZE(bits);i++)
+			bits[i] &= ~other.bits[i];
+		return *this;
 	}
+	constexpr bitset operator|(const bitset& other) const { bitset ret = *this; ret |= other; return ret; }
+	constexpr bitset operator&(const bitset& other) const { bitset ret = *this; ret &= other; return ret; }
+	constexpr bitset operator^(const bitset& other) const { bitset ret = *this; ret ^= other; return ret; }
 	constexpr bool operator==(const bitset& other) const
 	{
 		for (size_t i=0;i<ARRAY_SIZE(bits);i++)
@@ -1289,13 +1554,27 @@ public:
 		}
 		return false;
 	}
-	constexpr bool popcount() const
+	constexpr size_t popcount() const
 	{
 		size_t ret = 0;
 		for (size_t i=0;i<ARRAY_SIZE(bits);i++)
 			ret += __builtin_popcount(bits[i]);
 		return ret;
 	}
+	constexpr size_t popcount(size_t start, size_t end) const { return bitarray::popcount(bits, start, end); }
+	
+	constexpr size_t next_set(size_t start) const
+	{
+		size_t ret;
+		if (bitarray::next_true(bits, nbits, start, ret)) return ret;
+		else return nbits;
+	}
+	constexpr size_t next_clear(size_t start) const
+	{
+		size_t ret;
+		if (bitarray::next_false(bits, nbits, start, ret)) return ret;
+		else return nbits;
+	}
 	
 private:
 	class truth_iterator {
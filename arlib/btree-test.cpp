@@ -0,0 +1,239 @@
+#include "btree.h"
+#include "random.h"
+#include "test.h"
+
+#ifdef ARLIB_TEST
+namespace {
+// big enough that the nodes are the minimum size, so the tree gets deep with few items
+struct big {
+	int n;
+	char pad[124];
+	big(int n) : n(n) {}
+	bool operator<(const big& other) const { return n < other.n; }
+	friend bool operator<(const big& a, int b) { return a.n < b; }
+	friend bool operator<(int a, const big& b) { return a < b.n; }
+};
+int to_int(int n) { return n; }
+int to_int(const big& b) { return b.n; }
+
+template<typename T>
+void check_contents(const btree_set<T>& s, const array<bool>& ref)
+{
+	size_t n = 0;
+	int prev = -1;
+	for (const T& item : s)
+	{
+		assert(ref[to_int(item)]);
+		assert_gt(to_int(item), prev);
+		prev = to_int(item);
+		n++;
+	}
+	assert_eq(n, s.size());
+	for (int i : range(ref.size()))
+	{
+		assert_eq(s.contains(i), ref[i]);
+		if (ref[i]) n--;
+	}
+	assert_eq(n, 0);
+	
+	// and backwards
+	auto it = s.end();
+	for (int i=ref.size()-1;i>=0;i--)
+	{
+		if (!ref[i]) continue;
+		--it;
+		assert_eq(to_int(*it), i);
+	}
+	assert(it == s.begin());
+}
+
+template<typename T>
+void test_set(int max_n)
+{
+	btree_set<T> s;
+	array<bool> ref;
+	ref.resize(max_n);
+	random_t rand(42);
+	
+	for (int i=0;i<max_n*4;i++)
+	{
+		int n = rand(max_n);
+		if (rand(3) == 0)
+		{
+			s.remove(n);
+			ref[n] = false;
+		}
+		else
+		{
+			s.add(n);
+			ref[n] = true;
+		}
+		if (i%(max_n/2) == 0)
+			check_contents(s, ref);
+	}
+	check_contents(s, ref);
+	
+	for (int i=0;i<max_n;i++)
+	{
+		auto lo = s.lower_bound(i);
+		auto hi = s.upper_bound(i);
+		int next_lo = -1;
+		int next_hi = -1;
+		for (int j=i;j<max_n;j++)
+		{
+			if (ref[j] && next_lo < 0) next_lo = j;
+			if (ref[j] && j > i && next_hi < 0) next_hi = j;
+		}
+		if (next_lo < 0) assert(lo == s.end());
+		else assert_eq(to_int(*lo), next_lo);
+		if (next_hi < 0) assert(hi == s.end());
+		else assert_eq(to_int(*hi), next_hi);
+	}
+	
+	btree_set<T> copy = s;
+	check_contents(copy, ref);
+	
+	// remove everything, in a different order than it was added
+	for (int i=0;i<max_n;i++)
+	{
+		int n = (i*7919) % max_n;
+		s.remove(n);
+		ref[n] = false;
+		if (i%(max_n/4) == 0)
+			check_contents(s, ref);
+	}
+	assert_eq(s.size(), 0);
+	check_contents(s, ref);
+}
+}
+
+test("btree_set", "array", "btree")
+{
+	test_set<int>(5000);
+	test_set<big>(500);
+	
+	{
+		btree_set<int> s = { 5, 1, 3 };
+		int expected[] = { 1, 3, 5 };
+		size_t n = 0;
+		for (int i : s)
+			assert_eq(i, expected[n++]);
+		assert_eq(n, 3);
+		
+		n = 0;
+		for (int i : s.range(2, 5))
+		{
+			assert_eq(i, 3);
+			n++;
+		}
+		assert_eq(n, 1);
+		
+		btree_set<int> empty;
+		assert(empty.begin() == empty.end());
+		assert(empty.lower_bound(1) == empty.end());
+		assert(!empty.contains(1));
+		empty.remove(1);
+	}
+	
+	// every size up to a few levels deep, to hit every rounding case
+	for (int size=0;size<600;size+=(size<100 ? 1 : 37))
+	{
+		array<int> items;
+		array<bool> ref;
+		for (int i=0;i<size;i++)
+		{
+			items.append(i*2);
+			ref.append(true);
+			ref.append(false);
+		}
+		btree_set<int> s = btree_set<int>::from_sorted(items);
+		check_contents(s, ref);
+		
+		array<big> bigs;
+		for (int i=0;i<size;i++)
+			bigs.append(i*2);
+		btree_set<big> sb = btree_set<big>::from_sorted(bigs);
+		check_contents(sb, ref);
+		
+		// make sure the result is a valid tree, not just something that iterates right
+		for (int i=0;i<size*2;i+=3)
+		{
+			sb.add(i);
+			ref[i] = true;
+		}
+		for (int i=0;i<size*2;i+=4)
+		{
+			sb.remove(i);
+			ref[i] = false;
+		}
+		check_contents(sb, ref);
+	}
+}
+
+test("btree_map", "btree,string", "")
+{
+	btree_map<string,int,string> m;
+	m.insert("b", 2);
+	m.insert("a", 1);
+	m.insert("d", 4);
+	m.get_create("c") = 3;
+	assert_eq(m.size(), 4);
+	assert_eq(m.get("c"), 3);
+	assert_eq(m.get_or("e", 5), 5);
+	assert(!m.get_or_null("e"));
+	assert(m.contains("a"));
+	
+	string keys;
+	int sum = 0;
+	for (auto& node : m)
+	{
+		keys += node.key;
+		sum += node.value;
+	}
+	assert_eq(keys, "abcd");
+	assert_eq(sum, 10);
+	
+	keys = "";
+	for (auto& node : m.range("b", "d"))
+	{
+		keys += node.key;
+		node.value *= 10;
+	}
+	assert_eq(keys, "bc");
+	assert_eq(m.get("b"), 20);
+	assert_eq(m.lower_bound("bb")->key, "c");
+	assert_eq(m.upper_bound("c")->key, "d");
+	assert(m.upper_bound("d") == m.end());
+	
+	auto it = m.lower_bound("c");
+	--it;
+	assert_eq(it->key, "b"); // the nearest key before c
+	
+	m.remove("a");
+	assert(!m.contains("a"));
+	assert_eq(m.begin()->key, "b");
+	
+	array<int> k;
+	array<string> v;
+	for (int i=0;i<1000;i++)
+	{
+		k.append(i);
+		v.append(tostring(i));
+	}
+	btree_map<int,string> m2 = btree_map<int,string>::from_sorted(k, v);
+	assert_eq(m2.size(), 1000);
+	for (int i=0;i<1000;i++)
+		assert_eq(m2.get(i), tostring(i));
+	for (int i=0;i<1000;i+=2)
+		m2.remove(i);
+	assert_eq(m2.size(), 500);
+	int prev = -1;
+	for (auto& node : m2)
+	{
+		assert_eq(node.key, prev+2);
+		assert_eq(node.value, tostring(node.key));
+		prev = node.key;
+	}
+	assert_eq(prev, 999);
+}
+#endif
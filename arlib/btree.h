@@ -0,0 +1,727 @@
+#pragma once
+#include "global.h"
+#include "array.h"
+#include "tuple.h"
+
+// An ordered set, for when the hashed set<> isn't enough; it supports iterating in order, and finding the nearest item.
+// It's a B-tree, with the same layout as Abseil's; every node has up to N items and, unless it's a leaf, N+1 children.
+// N is chosen so a node's items are about four cache lines, so each node visited costs a few cache misses at most,
+//  and the tree is only a few levels deep, even for millions of items.
+// Items are sorted by operator<, or by Tless::less(a, b) if given; like set<>'s Thasher, it may be overloaded to accept other types.
+// string has no operator<, so use string::less (btree_set<string, string>), or iless or snatless.
+// Like array<>, it assumes items can be moved with memcpy.
+template<typename T, typename Tless = void>
+class btree_set {
+	template<typename,typename,typename>
+	friend class btree_map;
+	
+	static const unsigned N = max(min(256/sizeof(T), (size_t)63), (size_t)3);
+	static const unsigned min_count = (N-1)/2; // every node except the root has at least this many items
+	
+	struct tnode {
+		tnode* parent;
+		uint8_t pos; // index in parent's children
+		uint8_t count;
+		bool leaf;
+		alignas(T) uint8_t storage[sizeof(T)*N];
+		
+		T* values() { return (T*)storage; }
+	};
+	struct tinner : public tnode {
+		tnode* children[N+1];
+	};
+	
+	tnode* m_root;
+	size_t m_count;
+	
+	static tnode** children(tnode* n) { return static_cast<tinner*>(n)->children; }
+	static void set_child(tnode* n, unsigned idx, tnode* child)
+	{
+		children(n)[idx] = child;
+		child->parent = n;
+		child->pos = idx;
+	}
+	static tnode* new_node(bool leaf)
+	{
+		tnode* ret = (leaf ? new tnode : new tinner);
+		ret->parent = NULL;
+		ret->count = 0;
+		ret->leaf = leaf;
+		return ret;
+	}
+	static void free_node(tnode* n)
+	{
+		if (n->leaf) delete n;
+		else delete static_cast<tinner*>(n);
+	}
+	
+	template<typename Ta, typename Tb>
+	static bool less(const Ta& a, const Tb& b)
+	{
+		if constexpr (std::is_same_v<Tless, void>)
+			return a < b;
+		else
+			return Tless::less(a, b);
+	}
+	
+	// first index whose item is not less than key
+	template<typename T2>
+	static unsigned lower_idx(tnode* n, const T2& key)
+	{
+		unsigned lo = 0;
+		unsigned hi = n->count;
+		while (lo < hi)
+		{
+			unsigned mid = (lo+hi)/2;
+			if (less(n->values()[mid], key)) lo = mid+1;
+			else hi = mid;
+		}
+		return lo;
+	}
+	// first index whose item is greater than key
+	template<typename T2>
+	static unsigned upper_idx(tnode* n, const T2& key)
+	{
+		unsigned lo = 0;
+		unsigned hi = n->count;
+		while (lo < hi)
+		{
+			unsigned mid = (lo+hi)/2;
+			if (!less(key, n->values()[mid])) lo = mid+1;
+			else hi = mid;
+		}
+		return lo;
+	}
+	
+	// Makes room for an item at the given index, splitting nodes as needed, and returns where the item should go.
+	// If n isn't a leaf, 'child' is inserted right after the new item.
+	tuple<tnode*,unsigned> insert_slot(tnode* n, unsigned idx, tnode* child)
+	{
+		if (n->count == N)
+		{
+			// full; the upper half moves to a new node, and the middle item moves to the parent
+			unsigned mid = N/2;
+			tnode* right = new_node(n->leaf);
+			right->count = N-mid-1;
+			memcpy((void*)right->values(), (void*)(n->values()+mid+1), sizeof(T)*right->count);
+			if (!n->leaf)
+			{
+				for (unsigned i=0;i<=right->count;i++)
+					set_child(right, i, children(n)[mid+1+i]);
+			}
+			n->count = mid;
+			
+			if (!n->parent)
+			{
+				m_root = new_node(false);
+				set_child(m_root, 0, n);
+			}
+			auto[pn,pidx] = insert_slot(n->parent, n->pos, right);
+			memcpy((void*)&pn->values()[pidx], (void*)&n->values()[mid], sizeof(T));
+			
+			if (idx > mid)
+			{
+				n = right;
+				idx -= mid+1;
+			}
+		}
+		
+		memmove((void*)(n->values()+idx+1), (void*)(n->values()+idx), sizeof(T)*(n->count-idx));
+		if (!n->leaf)
+		{
+			for (unsigned i=n->count;i>idx;i--)
+				set_child(n, i+1, children(n)[i]);
+			set_child(n, idx+1, child);
+		}
+		n->count++;
+		return { n, idx };
+	}
+	
+	// Moves the separator at index idx of n, and everything in the child after it, into the child before it.
+	void merge(tnode* n, unsigned idx)
+	{
+		tnode* left = children(n)[idx];
+		tnode* right = children(n)[idx+1];
+		
+		memcpy((void*)&left->values()[left->count], (void*)&n->values()[idx], sizeof(T));
+		memcpy((void*)&left->values()[left->count+1], (void*)right->values(), sizeof(T)*right->count);
+		if (!left->leaf)
+		{
+			for (unsigned i=0;i<=right->count;i++)
+				set_child(left, left->count+1+i, children(right)[i]);
+		}
+		left->count += 1+right->count;
+		free_node(right);
+		
+		memmove((void*)(n->values()+idx), (void*)(n->values()+idx+1), sizeof(T)*(n->count-idx-1));
+		for (unsigned i=idx+1;i<n->count;i++)
+			set_child(n, i, children(n)[i+1]);
+		n->count--;
+	}
+	
+	// Moves one item from the child before separator idx, through the separator, to the child after it.
+	void rotate_right(tnode* n, unsigned idx)
+	{
+		tnode* left = children(n)[idx];
+		tnode* right = children(n)[idx+1];
+		
+		memmove((void*)(right->values()+1), (void*)right->values(), sizeof(T)*right->count);
+		memcpy((void*)&right->values()[0], (void*)&n->values()[idx], sizeof(T));
+		memcpy((void*)&n->values()[idx], (void*)&left->values()[left->count-1], sizeof(T));
+		if (!right->leaf)
+		{
+			for (unsigned i=right->count+1;i>0;i--)
+				set_child(right, i, children(right)[i-1]);
+			set_child(right, 0, children(left)[left->count]);
+		}
+		left->count--;
+		right->count++;
+	}
+	
+	// The other direction.
+	void rotate_left(tnode* n, unsigned idx)
+	{
+		tnode* left = children(n)[idx];
+		tnode* right = children(n)[idx+1];
+		
+		memcpy((void*)&left->values()[left->count], (void*)&n->values()[idx], sizeof(T));
+		memcpy((void*)&n->values()[idx], (void*)&right->values()[0], sizeof(T));
+		memmove((void*)right->values(), (void*)(right->values()+1), sizeof(T)*(right->count-1));
+		if (!right->leaf)
+		{
+			set_child(left, left->count+1, children(right)[0]);
+			for (unsigned i=0;i<right->count;i++)
+				set_child(right, i, children(right)[i+1]);
+		}
+		left->count++;
+		right->count--;
+	}
+	
+	// Call after removing an item from n.
+	void rebalance(tnode* n)
+	{
+		while (true)
+		{
+			if (n == m_root)
+			{
+				if (n->count == 0)
+				{
+					if (n->leaf) m_root = NULL;
+					else
+					{
+						m_root = children(n)[0];
+						m_root->parent = NULL;
+					}
+					free_node(n);
+				}
+				return;
+			}
+			if (n->count >= min_count)
+				return;
+			
+			tnode* parent = n->parent;
+			unsigned pos = n->pos;
+			tnode* left = (pos > 0 ? children(parent)[pos-1] : NULL);
+			tnode* right = (pos < parent->count ? children(parent)[pos+1] : NULL);
+			if (left && left->count > min_count)
+				return rotate_right(parent, pos-1);
+			if (right && right->count > min_count)
+				return rotate_left(parent, pos);
+			// neither sibling can spare anything, so they both have min_count items; merging them with n can't overflow
+			if (left) merge(parent, pos-1);
+			else merge(parent, pos);
+			n = parent;
+		}
+	}
+	
+	void erase(tnode* n, unsigned idx)
+	{
+		n->values()[idx].~T();
+		if (!n->leaf)
+		{
+			// replace it with the previous item, which is always in a leaf
+			tnode* leaf = children(n)[idx];
+			while (!leaf->leaf)
+				leaf = children(leaf)[leaf->count];
+			memcpy((void*)&n->values()[idx], (void*)&leaf->values()[leaf->count-1], sizeof(T));
+			leaf->count--;
+			n = leaf;
+		}
+		else
+		{
+			memmove((void*)(n->values()+idx), (void*)(n->values()+idx+1), sizeof(T)*(n->count-idx-1));
+			n->count--;
+		}
+		m_count--;
+		rebalance(n);
+	}
+	
+	template<typename T2>
+	tuple<tnode*,unsigned> find(const T2& key) const
+	{
+		tnode* n = m_root;
+		while (n)
+		{
+			unsigned idx = lower_idx(n, key);
+			if (idx < n->count && !less(key, n->values()[idx]))
+				return { n, idx };
+			if (n->leaf)
+				break;
+			n = children(n)[idx];
+		}
+		return { NULL, 0 };
+	}
+	
+	//if the item doesn't exist, NULL
+	template<typename T2>
+	T* get_or_null(const T2& key) const
+	{
+		auto[n,idx] = find(key);
+		if (n) return &n->values()[idx];
+		else return NULL;
+	}
+	
+	// returns either false and a normal pointer, or true and an uninitialized pointer
+	// in the latter case, it's the caller's responsibility to call placement new
+	template<typename T2>
+	tuple<bool,T*> get_or_prepare_create(const T2& key)
+	{
+		if (!m_root)
+			m_root = new_node(true);
+		
+		tnode* n = m_root;
+		while (true)
+		{
+			unsigned idx = lower_idx(n, key);
+			if (idx < n->count && !less(key, n->values()[idx]))
+				return { false, &n->values()[idx] };
+			if (n->leaf)
+			{
+				auto[tn,tidx] = insert_slot(n, idx, NULL);
+				m_count++;
+				return { true, &tn->values()[tidx] };
+			}
+			n = children(n)[idx];
+		}
+	}
+	
+	// Builds the tree bottom up, with every node as full as possible. The items must be sorted and unique.
+	// construct(T* ptr, size_t idx) must construct the item with the given index at ptr.
+	template<typename Tf>
+	void build(size_t n_items, Tf&& construct)
+	{
+		if (!n_items)
+			return;
+		
+		// each level is a list of nodes, and separator items between them
+		array<tnode*> level;
+		array<size_t> seps;
+		
+		size_t n_leaves = (n_items+1 + N) / (N+1);
+		size_t n_in_leaves = n_items - (n_leaves-1);
+		size_t next = 0;
+		for (size_t i=0;i<n_leaves;i++)
+		{
+			tnode* leaf = new_node(true);
+			leaf->count = n_in_leaves/n_leaves + (i < n_in_leaves%n_leaves);
+			for (unsigned j=0;j<leaf->count;j++)
+				construct(&leaf->values()[j], next++);
+			level.append(leaf);
+			if (i != n_leaves-1)
+				seps.append(next++);
+		}
+		
+		while (level.size() > 1)
+		{
+			array<tnode*> next_level;
+			array<size_t> next_seps;
+			
+			size_t n_nodes = (level.size() + N) / (N+1);
+			size_t child = 0;
+			for (size_t i=0;i<n_nodes;i++)
+			{
+				size_t n_children = level.size()/n_nodes + (i < level.size()%n_nodes);
+				tnode* n = new_node(false);
+				n->count = n_children-1;
+				for (unsigned j=0;j<n_children;j++)
+				{
+					set_child(n, j, level[child+j]);
+					if (j != n_children-1)
+						construct(&n->values()[j], seps[child+j]);
+				}
+				child += n_children;
+				next_level.append(n);
+				if (i != n_nodes-1)
+					next_seps.append(seps[child-1]);
+			}
+			level = std::move(next_level);
+			seps = std::move(next_seps);
+		}
+		
+		m_root = level[0];
+		m_count = n_items;
+	}
+	
+	static tnode* clone(tnode* src)
+	{
+		tnode* ret = new_node(src->leaf);
+		ret->count = src->count;
+		for (unsigned i=0;i<src->count;i++)
+			new(&ret->values()[i]) T(src->values()[i]);
+		if (!src->leaf)
+		{
+			for (unsigned i=0;i<=src->count;i++)
+				set_child(ret, i, clone(children(src)[i]));
+		}
+		return ret;
+	}
+	
+	static void destroy(tnode* n)
+	{
+		for (unsigned i=0;i<n->count;i++)
+			n->values()[i].~T();
+		if (!n->leaf)
+		{
+			for (unsigned i=0;i<=n->count;i++)
+				destroy(children(n)[i]);
+		}
+		free_node(n);
+	}
+	
+	void construct()
+	{
+		m_root = NULL;
+		m_count = 0;
+	}
+	void construct(const btree_set& other)
+	{
+		m_root = (other.m_root ? clone(other.m_root) : NULL);
+		m_count = other.m_count;
+	}
+	void construct(btree_set&& other)
+	{
+		m_root = other.m_root;
+		m_count = other.m_count;
+		other.construct();
+	}
+	void destruct()
+	{
+		if (m_root)
+			destroy(m_root);
+		construct();
+	}
+
+public:
+	btree_set() { construct(); }
+	btree_set(const btree_set& other) { construct(other); }
+	btree_set(btree_set&& other) { construct(std::move(other)); }
+	btree_set(std::initializer_list<T> c)
+	{
+		construct();
+		for (const T& item : c) add(item);
+	}
+	btree_set& operator=(const btree_set& other) { destruct(); construct(other); return *this; }
+	btree_set& operator=(btree_set&& other) { destruct(); construct(std::move(other)); return *this; }
+	~btree_set() { destruct(); }
+	
+	//The items must be sorted and unique. O(n), as opposed to O(n log n) for adding them one at a time.
+	static btree_set from_sorted(arrayview<T> items)
+	{
+		btree_set ret;
+		ret.build(items.size(), [&items](T* ptr, size_t idx) { new(ptr) T(items[idx]); });
+		return ret;
+	}
+	
+	template<typename T2>
+	void add(const T2& item)
+	{
+		auto[create,ptr] = get_or_prepare_create(item);
+		if (create) new(ptr) T(item);
+	}
+	
+	template<typename T2>
+	bool contains(const T2& item) const
+	{
+		return get_or_null(item);
+	}
+	
+	template<typename T2>
+	void remove(const T2& item)
+	{
+		auto[n,idx] = find(item);
+		if (n) erase(n, idx);
+	}
+	
+	size_t size() const { return m_count; }
+	
+	void reset() { destruct(); construct(); }
+	
+	class iterator {
+		friend class btree_set;
+		
+		const btree_set* parent;
+		tnode* n; // NULL for end
+		unsigned pos;
+		
+		iterator(const btree_set* parent, tnode* n, unsigned pos) : parent(parent), n(n), pos(pos) {}
+	
+	public:
+		const T& operator*() const { return n->values()[pos]; }
+		const T* operator->() const { return &n->values()[pos]; }
+		
+		void operator++()
+		{
+			if (!n->leaf)
+			{
+				// first item in the subtree after this item
+				n = children(n)[pos+1];
+				while (!n->leaf)
+					n = children(n)[0];
+				pos = 0;
+				return;
+			}
+			pos++;
+			while (pos == n->count)
+			{
+				// end of this leaf; the next item is the separator after this subtree, if any
+				if (!n->parent)
+				{
+					n = NULL;
+					pos = 0;
+					return;
+				}
+				pos = n->pos;
+				n = n->parent;
+			}
+		}
+		//Decrementing the end iterator gives the last item. Decrementing the first item is undefined behavior.
+		void operator--()
+		{
+			if (!n)
+			{
+				n = parent->m_root;
+				pos = n->count;
+			}
+			if (!n->leaf)
+			{
+				n = children(n)[pos];
+				while (!n->leaf)
+					n = children(n)[n->count];
+				pos = n->count-1;
+				return;
+			}
+			while (pos == 0)
+			{
+				pos = n->pos;
+				n = n->parent;
+			}
+			pos--;
+		}
+		
+		bool operator==(const iterator& other) const { return n == other.n && pos == other.pos; }
+		bool operator!=(const iterator& other) const { return !(*this == other); }
+	};
+	
+	class range_t {
+		friend class btree_set;
+		iterator m_begin;
+		iterator m_end;
+		range_t(iterator begin, iterator end) : m_begin(begin), m_end(end) {}
+	public:
+		iterator begin() const { return m_begin; }
+		iterator end() const { return m_end; }
+	};
+	
+	//Adding or removing anything invalidates all iterators.
+	iterator begin() const
+	{
+		tnode* n = m_root;
+		if (!n || !n->count)
+			return end();
+		while (!n->leaf)
+			n = children(n)[0];
+		return iterator(this, n, 0);
+	}
+	iterator end() const { return iterator(this, NULL, 0); }
+	
+	//Returns the first item not less than key, or end() if there is none.
+	template<typename T2>
+	iterator lower_bound(const T2& key) const
+	{
+		iterator ret = end();
+		tnode* n = m_root;
+		while (n)
+		{
+			unsigned idx = lower_idx(n, key);
+			if (idx < n->count)
+			{
+				ret = iterator(this, n, idx);
+				if (!less(key, n->values()[idx]))
+					break;
+			}
+			if (n->leaf)
+				break;
+			n = children(n)[idx];
+		}
+		return ret;
+	}
+	//Returns the first item greater than key, or end().
+	template<typename T2>
+	iterator upper_bound(const T2& key) const
+	{
+		iterator ret = end();
+		tnode* n = m_root;
+		while (n)
+		{
+			unsigned idx = upper_idx(n, key);
+			if (idx < n->count)
+				ret = iterator(this, n, idx);
+			if (n->leaf)
+				break;
+			n = children(n)[idx];
+		}
+		return ret;
+	}
+	//Returns the items not less than lo, and less than hi.
+	template<typename T2, typename T3>
+	range_t range(const T2& lo, const T3& hi) const
+	{
+		return { lower_bound(lo), lower_bound(hi) };
+	}
+};
+
+
+
+template<typename Tkey, typename Tvalue, typename Tless = void>
+class btree_map {
+public:
+	struct node {
+		const Tkey key;
+		Tvalue value;
+		
+		node(const Tkey& key) : key(key), value() {}
+		node(const Tkey& key, const Tvalue& value) : key(key), value(value) {}
+	};
+private:
+	class node_less {
+		static const Tkey& key_of(const node& n) { return n.key; }
+		template<typename T>
+		static const T& key_of(const T& key) { return key; }
+	public:
+		template<typename Ta, typename Tb>
+		static bool less(const Ta& a, const Tb& b) { return btree_set<Tkey,Tless>::less(key_of(a), key_of(b)); }
+	};
+	using set_t = btree_set<node,node_less>;
+	set_t items;
+	
+	template<typename Tr>
+	class iterator_t {
+		friend class btree_map;
+		typename set_t::iterator it;
+		iterator_t(typename set_t::iterator it) : it(it) {}
+	public:
+		Tr& operator*() const { return const_cast<Tr&>(*it); }
+		Tr* operator->() const { return const_cast<Tr*>(&*it); }
+		void operator++() { ++it; }
+		void operator--() { --it; }
+		bool operator==(const iterator_t& other) const { return it == other.it; }
+		bool operator!=(const iterator_t& other) const { return it != other.it; }
+	};
+	template<typename Tr>
+	class range_t {
+		friend class btree_map;
+		typename set_t::range_t r;
+		range_t(typename set_t::range_t r) : r(r) {}
+	public:
+		iterator_t<Tr> begin() const { return r.begin(); }
+		iterator_t<Tr> end() const { return r.end(); }
+	};
+
+public:
+	//The keys must be sorted and unique, and the arrays must be the same size.
+	static btree_map from_sorted(arrayview<Tkey> keys, arrayview<Tvalue> values)
+	{
+		btree_map ret;
+		struct { arrayview<Tkey>& keys; arrayview<Tvalue>& values; } ctx = { keys, values };
+		ret.items.build(keys.size(), [&ctx](node* ptr, size_t idx) { new(ptr) node(ctx.keys[idx], ctx.values[idx]); });
+		return ret;
+	}
+	
+	Tvalue& insert(const Tkey& key, const Tvalue& value)
+	{
+		auto[create,ptr] = items.get_or_prepare_create(key);
+		if (create) new(ptr) node(key, value);
+		else ptr->value = value;
+		return ptr->value;
+	}
+	
+	//if nonexistent, null deref (undefined behavior, segfault in practice)
+	template<typename Tk2>
+	Tvalue& get(const Tk2& key)
+	{
+		return items.get_or_null(key)->value;
+	}
+	template<typename Tk2>
+	const Tvalue& get(const Tk2& key) const
+	{
+		return items.get_or_null(key)->value;
+	}
+	
+	template<typename Tk2>
+	Tvalue get_or(const Tk2& key, Tvalue def) const
+	{
+		node* ret = items.get_or_null(key);
+		if (ret) return ret->value;
+		else return def;
+	}
+	template<typename Tk2>
+	Tvalue* get_or_null(const Tk2& key)
+	{
+		node* ret = items.get_or_null(key);
+		if (ret) return &ret->value;
+		else return NULL;
+	}
+	template<typename Tk2>
+	const Tvalue* get_or_null(const Tk2& key) const
+	{
+		node* ret = items.get_or_null(key);
+		if (ret) return &ret->value;
+		else return NULL;
+	}
+	Tvalue& get_create(const Tkey& key)
+	{
+		auto[create,ptr] = items.get_or_prepare_create(key);
+		if (create) new(ptr) node(key);
+		return ptr->value;
+	}
+	
+	template<typename Tk2>
+	bool contains(const Tk2& key) const
+	{
+		return items.contains(key);
+	}
+	
+	template<typename Tk2>
+	void remove(const Tk2& key)
+	{
+		items.remove(key);
+	}
+	
+	void reset() { items.reset(); }
+	
+	size_t size() const { return items.size(); }
+	
+	//Adding or removing anything invalidates all iterators.
+	iterator_t<node> begin() { return items.begin(); }
+	iterator_t<const node> begin() const { return items.begin(); }
+	iterator_t<node> end() { return items.end(); }
+	iterator_t<const node> end() const { return items.end(); }
+	
+	template<typename Tk2> iterator_t<node> lower_bound(const Tk2& key) { return items.lower_bound(key); }
+	template<typename Tk2> iterator_t<const node> lower_bound(const Tk2& key) const { return items.lower_bound(key); }
+	template<typename Tk2> iterator_t<node> upper_bound(const Tk2& key) { return items.upper_bound(key); }
+	template<typename Tk2> iterator_t<const node> upper_bound(const Tk2& key) const { return items.upper_bound(key); }
+	//Returns the items whose keys are not less than lo, and less than hi.
+	template<typename Tk2, typename Tk3> range_t<node> range(const Tk2& lo, const Tk3& hi) { return items.range(lo, hi); }
+	template<typename Tk2, typename Tk3> range_t<const node> range(const Tk2& lo, const Tk3& hi) const { return items.range(lo, hi); }
+};
@@ -128,6 +128,117 @@ void bytepipe::reset(size_t bufsize)
 	buf2end = 0;
 }
 
+void bytepipe_chain::push(bytesr bytes)
+{
+	bytesw target = push_begin(bytes.size());
+	memcpy(target.ptr(), bytes.ptr(), bytes.size());
+	push_finish(bytes.size());
+}
+
+void bytepipe_chain::push(bytearray&& bytes)
+{
+	if (bytes.size() < min_segment)
+	{
+		push((bytesr)bytes);
+		return;
+	}
+	size_t n = bytes.size();
+	segs.append({ std::move(bytes), 0, n });
+	m_size += n;
+}
+
+bytesw bytepipe_chain::push_begin(size_t nbytes)
+{
+	if (segs.size() > first)
+	{
+		segment& last = segs[segs.size()-1];
+		if (last.buf.size() - last.end >= nbytes)
+			return last.buf.skip(last.end);
+	}
+	segment& seg = segs.append();
+	seg.buf.resize(max(block_size, bitround(nbytes)));
+	seg.start = 0;
+	seg.end = 0;
+	return seg.buf;
+}
+
+arrayview<iovec> bytepipe_chain::pull_iov(size_t max_bufs)
+{
+	iov.reset();
+	for (size_t i=first;i<segs.size() && iov.size()<max_bufs;i++)
+	{
+		const segment& seg = segs[i];
+		if (seg.end != seg.start)
+			iov.append({ (void*)(seg.buf.ptr()+seg.start), seg.end-seg.start });
+	}
+	return iov;
+}
+
+bytesr bytepipe_chain::pull_begin() const
+{
+	for (size_t i=first;i<segs.size();i++)
+	{
+		const segment& seg = segs[i];
+		if (seg.end != seg.start)
+			return seg.buf.slice(seg.start, seg.end-seg.start);
+	}
+	return {};
+}
+
+void bytepipe_chain::pull_finish(size_t nbytes, array<bytearray>* keep)
+{
+	m_size -= nbytes;
+	while (nbytes)
+	{
+		segment& seg = segs[first];
+		size_t n = min(nbytes, seg.end-seg.start);
+		seg.start += n;
+		nbytes -= n;
+		if (seg.start == seg.end && first != segs.size()-1)
+		{
+			if (keep)
+				keep->append(std::move(seg.buf));
+			else
+				seg.buf.reset();
+			first++;
+		}
+	}
+	
+	if (m_size == 0 && segs.size())
+	{
+		// keep the last buffer for future pushes, unless it's an unusually big one, or the caller wants it
+		segs.remove_range(0, segs.size()-1);
+		first = 0;
+		if (keep)
+		{
+			keep->append(std::move(segs[0].buf));
+			segs.reset();
+		}
+		else if (segs[0].buf.size() == block_size)
+			segs[0].start = segs[0].end = 0;
+		else
+			segs.reset();
+	}
+	else if (first >= 16 && first*2 >= segs.size())
+	{
+		segs.remove_range(0, first);
+		first = 0;
+	}
+}
+
+void bytepipe_chain::reset(array<bytearray>* keep)
+{
+	if (keep)
+	{
+		for (size_t i=first;i<segs.size();i++)
+			keep->append(std::move(segs[i].buf));
+	}
+	segs.reset();
+	first = 0;
+	m_size = 0;
+	iov.reset();
+}
+
 #include "test.h"
 
 namespace {
@@ -269,3 +380,78 @@ test("bytepipe", "array", "bytepipe")
 		assert_eq(fail.size(), 0);
 	}
 }
+
+test("bytepipe_chain", "array", "bytepipe")
+{
+	bytepipe_chain p;
+	assert_eq(p.size(), 0);
+	assert_eq(p.pull_iov().size(), 0);
+	assert(!p.pull_begin());
+	
+	p.push_text("GET ", "/", " HTTP/1.1\r\n");
+	p.push(cstring("\r\n").bytes());
+	
+	bytearray body;
+	body.resize(5000);
+	for (size_t i=0;i<body.size();i++)
+		body[i] = i;
+	const uint8_t * body_ptr = body.ptr();
+	p.push(std::move(body));
+	p.push_text("trailer");
+	assert_eq(p.size(), 16+2+5000+7);
+	
+	arrayview<iovec> iov = p.pull_iov();
+	assert_eq(iov.size(), 3);
+	assert_eq(cstring(bytesr((uint8_t*)iov[0].iov_base, iov[0].iov_len)), "GET / HTTP/1.1\r\n\r\n");
+	assert_eq((uint8_t*)iov[1].iov_base, body_ptr); // not copied
+	assert_eq(iov[1].iov_len, 5000);
+	assert_eq(cstring(bytesr((uint8_t*)iov[2].iov_base, iov[2].iov_len)), "trailer");
+	assert_eq(p.pull_iov(2).size(), 2);
+	
+	// partial pull spanning two buffers
+	p.pull_finish(18+4000);
+	iov = p.pull_iov();
+	assert_eq(iov.size(), 2);
+	assert_eq(iov[0].iov_len, 1000);
+	assert_eq(((uint8_t*)iov[0].iov_base)[0], (uint8_t)4000);
+	assert_eq(p.pull_begin().size(), 1000);
+	p.pull_finish(1000+3);
+	assert_eq(cstring(p.pull_begin()), "iler");
+	p.pull_finish(4);
+	assert_eq(p.size(), 0);
+	assert_eq(p.pull_iov().size(), 0);
+	
+	// small moved buffers are copied
+	bytearray small = cstring("abc").bytes();
+	p.push(std::move(small));
+	p.push_text("def");
+	assert_eq(p.pull_iov().size(), 1);
+	assert_eq(cstring(p.pull_begin()), "abcdef");
+	
+	// many pulls, never quite emptying it; the list of empty buffers must not grow forever
+	p.pull_finish(6);
+	p.push_text("x");
+	for (int i=0;i<1000;i++)
+	{
+		bytearray big;
+		big.resize(2000);
+		big[1999] = i;
+		p.push(std::move(big));
+		p.pull_finish(2000);
+		assert_eq(p.size(), 1);
+		assert_eq(p.pull_begin()[0], (uint8_t)i);
+	}
+	
+	// resetting can keep the buffers, including partially pulled ones
+	bytearray big;
+	big.resize(5000);
+	const uint8_t * big_ptr = big.ptr();
+	p.push(std::move(big));
+	p.pull_finish(1+1000);
+	array<bytearray> keep;
+	p.reset(&keep);
+	assert_eq(p.size(), 0);
+	assert_eq(p.pull_iov().size(), 0);
+	assert_eq(keep.size(), 1);
+	assert_eq(keep[0].ptr(), big_ptr);
+}
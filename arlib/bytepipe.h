@@ -1,6 +1,16 @@
 #pragma once
 #include "array.h"
 #include "string.h"
+#ifdef __unix__
+#include <sys/uio.h>
+#endif
+
+#ifdef _WIN32
+struct iovec {
+	void* iov_base;
+	size_t iov_len;
+};
+#endif
 
 // A bytepipe accepts an infinite amount of bytes and returns them, first one first.
 // Unlike splicing and splitting a bytearray, this is guaranteed amortized O(1) per byte,
@@ -16,15 +26,16 @@ class bytepipe {
 	
 	void try_swap();
 	
-	size_t push_text_size(const char * str) { return strlen(str); }
-	size_t push_text_size(cstring str) { return str.length(); }
-	void push_text_core(uint8_t*& ptr, bytesr by)
+	static size_t push_text_size(const char * str) { return strlen(str); }
+	static size_t push_text_size(cstring str) { return str.length(); }
+	static void push_text_core(uint8_t*& ptr, bytesr by)
 	{
 		memcpy(ptr, by.ptr(), by.size());
 		ptr += by.size();
 	}
-	void push_text_inner(uint8_t*& ptr, const char * str) { push_text_core(ptr, bytesr((uint8_t*)str, strlen(str))); }
-	void push_text_inner(uint8_t*& ptr, cstring str) { push_text_core(ptr, str.bytes()); }
+	static void push_text_inner(uint8_t*& ptr, const char * str) { push_text_core(ptr, bytesr((uint8_t*)str, strlen(str))); }
+	static void push_text_inner(uint8_t*& ptr, cstring str) { push_text_core(ptr, str.bytes()); }
+	friend class bytepipe_chain;
 	
 public:
 	bytepipe() { reset(); }
@@ -74,3 +85,51 @@ public:
 	
 	void reset(size_t bufsize = 256);
 };
+
+// Like bytepipe, but the contents are kept as a list of separate buffers, which can be passed to writev() or similar
+//  without joining them first. Small pushes are copied into a shared buffer, like bytepipe; large bytearrays can be
+//  pushed by moving, and are then sent straight from their original storage.
+// There's no pull_line(), or any other way to pull a specific number of bytes; it's meant for outgoing data.
+class bytepipe_chain {
+	struct segment {
+		bytearray buf;
+		size_t start;
+		size_t end;
+	};
+	array<segment> segs; // the last one may have unused capacity, and be pushed to; the others are full
+	size_t first = 0; // segments before this one are empty, and are removed once there's enough of them
+	size_t m_size = 0;
+	array<iovec> iov;
+	
+	static const size_t block_size = 4096;
+	// Moved bytearrays smaller than this are copied instead; an iovec per tiny buffer costs more than the memcpy.
+	static const size_t min_segment = 1024;
+	
+public:
+	void push(bytesr bytes);
+	void push(bytearray&& bytes);
+	template<typename... Ts> void push_text(Ts... args)
+	{
+		static_assert(sizeof...(args) >= 1);
+		size_t nbytes = (bytepipe::push_text_size(args) + ...);
+		uint8_t* target = push_begin(nbytes).ptr();
+		(bytepipe::push_text_inner(target, args), ...);
+		push_finish(nbytes);
+	}
+	
+	// Same as bytepipe.
+	bytesw push_begin(size_t nbytes = 128);
+	void push_finish(size_t nbytes) { segs[segs.size()-1].end += nbytes; m_size += nbytes; }
+	
+	// Returns the first few buffers; each one is nonempty. Valid until the next non-const call.
+	arrayview<iovec> pull_iov(size_t max_bufs = 64);
+	// Returns the first buffer; useful if the destination can't take an iovec.
+	bytesr pull_begin() const;
+	// Can discard bytes from more than one buffer. If keep is non-null, buffers that are no longer needed are appended to it,
+	//  rather than freed or reused; this is for zero-copy sending, where the kernel may read them after this call.
+	void pull_finish(size_t nbytes, array<bytearray>* keep = nullptr);
+	
+	size_t size() const { return m_size; }
+	// If keep is non-null, every buffer is appended to it, including partially pulled ones, like pull_finish.
+	void reset(array<bytearray>* keep = nullptr);
+};
@@ -0,0 +1,67 @@
+#include "concurrentmap.h"
+#include "test.h"
+#include "string.h"
+
+#ifdef ARLIB_TEST
+test("concurrent_map", "set", "")
+{
+	{
+		concurrent_map<int,int> m;
+		assert(!m.contains(1));
+		assert_eq(m.get_or(1, 42), 42);
+		m.insert(1, 2);
+		assert(m.contains(1));
+		assert_eq(m.get_or(1, 42), 2);
+		int out = 0;
+		assert(m.get(1, out));
+		assert_eq(out, 2);
+		assert(!m.get(2, out));
+		assert_eq(out, 2);
+		assert_eq(m.get_create(1, []() { return 3; }), 2);
+		assert_eq(m.get_create(2, []() { return 3; }), 3);
+		assert_eq(m.update(2, [](int& n) { return ++n; }), 4);
+		assert_eq(m.size(), 2);
+		m.remove(1);
+		assert(!m.contains(1));
+		assert_eq(m.size(), 1);
+		m.reset();
+		assert_eq(m.size(), 0);
+	}
+	
+	{
+		concurrent_map<string,string> m;
+		m.insert("foo", "bar");
+		assert_eq(m.get_or("foo", ""), "bar");
+		assert_eq(m.get_or(cstring("foo"), ""), "bar");
+	}
+	
+	{
+		// every thread inserts its own keys, and they all bump a few shared counters
+		concurrent_map<int,int> m;
+		thread_split(8, [&m](unsigned int id) {
+			int base = id*2000;
+			for (int i=0;i<2000;i++)
+			{
+				m.insert(base + i, i);
+				m.update(-1 - i%4, [](int& n) { n++; });
+				assert(m.contains(base + i));
+			}
+			for (int i=0;i<2000;i+=2)
+				m.remove(base + i);
+		});
+		assert_eq(m.size(), 8*1000 + 4);
+		for (int i=0;i<4;i++)
+			assert_eq(m.get_or(-1-i, 0), 8*2000/4);
+		
+		map<int,int> snap = m.snapshot();
+		assert_eq(snap.size(), 8*1000 + 4);
+		for (int i=0;i<8*2000;i++)
+		{
+			if (i&1)
+				assert_eq(snap.get(i), i%2000);
+			else
+				assert(!snap.contains(i));
+		}
+	}
+}
+#endif
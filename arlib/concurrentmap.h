@@ -0,0 +1,131 @@
+#pragma once
+#include "global.h"
+#include "set.h"
+#include "thread/thread.h"
+
+// A map that can be used from multiple threads at once. It's split into a number of shards, each with its own lock,
+//  so threads only wait for each other if they happen to use the same shard at the same time.
+// Since the lock is released before returning, nothing returns references to the contents; values are copied out,
+//  or the caller passes a function that's called while holding the lock.
+// Such a function must not use the same concurrent_map, that would deadlock.
+template<typename Tkey, typename Tvalue, typename Thasher = void>
+class concurrent_map : nomove {
+	static const unsigned shard_bits = 6;
+	static const size_t n_shards = 1<<shard_bits;
+	
+	struct alignas(64) shard { // one cache line each, so threads using adjacent shards don't fight over the locks
+		mutable mutex lock;
+		map<Tkey,Tvalue,Thasher> items;
+	};
+	shard m_shards[n_shards];
+	
+	template<typename Tk2>
+	shard& shard_for(const Tk2& key) const
+	{
+		// the set uses the low bits of the same hash; use the high bits of a different mix, so the items in each shard
+		//  don't all end up in the same few groups
+		size_t hashv = set<Tkey,Thasher>::hash_of(key) * (size_t)0x9E3779B97F4A7C15;
+		return const_cast<shard&>(m_shards[hashv >> (sizeof(size_t)*8 - shard_bits)]);
+	}
+	
+public:
+	template<typename Tk2>
+	bool contains(const Tk2& key) const
+	{
+		shard& s = shard_for(key);
+		mutexlocker lk(s.lock);
+		return s.items.contains(key);
+	}
+	
+	//Returns whether the key exists. If it does, the value is copied to 'out'.
+	template<typename Tk2>
+	bool get(const Tk2& key, Tvalue& out) const
+	{
+		shard& s = shard_for(key);
+		mutexlocker lk(s.lock);
+		const Tvalue* ret = s.items.get_or_null(key);
+		if (ret) out = *ret;
+		return (ret != NULL);
+	}
+	template<typename Tk2>
+	Tvalue get_or(const Tk2& key, Tvalue def) const
+	{
+		get(key, def);
+		return def;
+	}
+	
+	void insert(const Tkey& key, const Tvalue& value)
+	{
+		shard& s = shard_for(key);
+		mutexlocker lk(s.lock);
+		s.items.insert(key, value);
+	}
+	
+	//If the key doesn't exist, inserts cr(). Either way, returns a copy of the value.
+	//cr() is called while holding the lock, so if multiple threads try to create the same key, only one of them calls it.
+	template<typename Tvc>
+	Tvalue get_create(const Tkey& key, Tvc&& cr) requires (std::is_invocable_r_v<Tvalue, Tvc>)
+	{
+		shard& s = shard_for(key);
+		mutexlocker lk(s.lock);
+		return s.items.get_create(key, cr);
+	}
+	
+	//Calls fn(Tvalue&) while holding the lock, creating the value if it doesn't exist, and returns whatever fn returns.
+	template<typename Tf>
+	auto update(const Tkey& key, Tf&& fn)
+	{
+		shard& s = shard_for(key);
+		mutexlocker lk(s.lock);
+		return fn(s.items.get_create(key));
+	}
+	
+	template<typename Tk2>
+	void remove(const Tk2& key)
+	{
+		shard& s = shard_for(key);
+		mutexlocker lk(s.lock);
+		s.items.remove(key);
+	}
+	
+	//If other threads are modifying the map, these may or may not see their changes.
+	size_t size() const
+	{
+		size_t ret = 0;
+		for (const shard& s : m_shards)
+		{
+			synchronized(s.lock)
+			{
+				ret += s.items.size();
+			}
+		}
+		return ret;
+	}
+	void reset()
+	{
+		for (shard& s : m_shards)
+		{
+			synchronized(s.lock)
+			{
+				s.items.reset();
+			}
+		}
+	}
+	
+	//Returns a copy of the contents, to iterate over without holding any lock.
+	//Each shard is copied at a single point in time, but not all shards at the same time; if other threads are modifying
+	// the map, the result may contain some of their changes and not others.
+	map<Tkey,Tvalue,Thasher> snapshot() const
+	{
+		map<Tkey,Tvalue,Thasher> ret;
+		for (const shard& s : m_shards)
+		{
+			synchronized(s.lock)
+			{
+				for (const auto& node : s.items)
+					ret.insert(node.key, node.value);
+			}
+		}
+		return ret;
+	}
+};
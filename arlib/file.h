@@ -53,10 +53,6 @@
 // http support should be deprecated, filesystem only
 
 #ifdef _WIN32
-struct iovec {
-	void* iov_base;
-	size_t iov_len;
-};
 typedef off64_t off_t;
 static_assert(sizeof(off_t) == 8);
 #endif
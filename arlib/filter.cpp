@@ -0,0 +1,307 @@
+#include "filter.h"
+#include "endian.h"
+#include "os.h"
+
+static uint64_t hash_fingerprint()
+{
+	// if hash() changes, so does at least one of these
+	static const char probe[] = "Arlib filter hash fingerprint, long enough for the bulk path";
+	uint64_t ret = hash_shuffle_strong((uint64_t)hash((const uint8_t*)probe, sizeof(probe)-1));
+	ret ^= (uint64_t)hash((const uint8_t*)probe, 5);
+	ret ^= (uint64_t)hash((uint32_t)12345) << 32;
+	return ret;
+}
+
+void filter_base::write_header(bytesw by, const char * magic, uint64_t n_words, uint64_t extra)
+{
+	memset(by.ptr(), 0, header_size);
+	memcpy(by.ptr(), magic, 8);
+	writeu_le64(by.ptr()+8, hash_fingerprint());
+	writeu_le64(by.ptr()+16, n_words);
+	writeu_le64(by.ptr()+24, extra);
+}
+
+arrayview<uint64_t> filter_base::read_header(bytesr by, const char * magic, uint64_t& extra)
+{
+	if (by.size() < header_size || memcmp(by.ptr(), magic, 8) != 0)
+		return {};
+	if (readu_le64(by.ptr()+8) != hash_fingerprint())
+		return {};
+	uint64_t n_words = readu_le64(by.ptr()+16);
+	if (n_words != (by.size()-header_size)/sizeof(uint64_t) || (by.size()-header_size)%sizeof(uint64_t))
+		return {};
+	if ((uintptr_t)by.ptr() % alignof(uint64_t))
+		return {};
+	extra = readu_le64(by.ptr()+24);
+	return { (uint64_t*)(by.ptr()+header_size), (size_t)n_words };
+}
+
+void filter_base::check_writable(size_t body_size)
+{
+#ifndef ARLIB_OPT
+	if (body_size)
+		debug_fatal_stack("can't change a filter from load(), use load_copy()\n");
+#endif
+}
+
+
+void bloom_filter::init(size_t n_items, size_t bits_per_item)
+{
+	size_t n_blocks = max((n_items*bits_per_item + block_words*64-1) / (block_words*64), 1);
+	storage.reset();
+	storage.resize(n_blocks * block_words);
+	body = storage;
+}
+
+bytearray bloom_filter::serialize() const
+{
+	bytearray ret;
+	ret.resize(header_size + body.size()*sizeof(uint64_t));
+	write_header(ret, "arbloom1", body.size(), 0);
+	memcpy(ret.ptr()+header_size, body.ptr(), body.size()*sizeof(uint64_t));
+	return ret;
+}
+
+bool bloom_filter::load(bytesr by)
+{
+	uint64_t extra;
+	arrayview<uint64_t> words = read_header(by, "arbloom1", extra);
+	if (!words.size() || words.size() % block_words)
+		return false;
+	storage.reset();
+	body = { (uint64_t*)words.ptr(), words.size() };
+	return true;
+}
+
+bool bloom_filter::load_copy(bytesr by)
+{
+	if (!load(by))
+		return false;
+	storage = body;
+	body = storage;
+	return true;
+}
+
+
+void cuckoo_filter::init(size_t n_items)
+{
+	size_t n_buckets = bitround(max((n_items + bucket_size-1) / bucket_size, 1));
+	storage.reset();
+	storage.resize(n_buckets);
+	body = storage;
+	count = 0;
+}
+
+bool cuckoo_filter::bucket_insert(size_t index, uint16_t fp)
+{
+	uint64_t bucket = body[index];
+	for (size_t i=0;i<bucket_size;i++)
+	{
+		if ((uint16_t)(bucket >> (i*16)) == 0)
+		{
+			body[index] = bucket | (uint64_t)fp << (i*16);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool cuckoo_filter::bucket_remove(size_t index, uint16_t fp)
+{
+	uint64_t bucket = body[index];
+	for (size_t i=0;i<bucket_size;i++)
+	{
+		if ((uint16_t)(bucket >> (i*16)) == fp)
+		{
+			body[index] = bucket & ~((uint64_t)0xFFFF << (i*16));
+			return true;
+		}
+	}
+	return false;
+}
+
+bool cuckoo_filter::insert_hash(uint64_t hash)
+{
+	if (UNLIKELY(!storage.size()))
+	{
+		check_writable(body.size());
+		init(0);
+	}
+	uint16_t fp = fingerprint(hash);
+	size_t i1 = hash & mask();
+	size_t i2 = alt_index(i1, fp);
+	if (bucket_insert(i1, fp) || bucket_insert(i2, fp))
+	{
+		count++;
+		return true;
+	}
+	
+	// both buckets are full; evict a random fingerprint to its other bucket, repeat until something fits
+	// if nothing does, undo everything, so the filter doesn't lose an item
+	static const size_t max_kicks = 500;
+	struct kick {
+		size_t index;
+		uint64_t prev;
+	} kicks[max_kicks];
+	
+	kick_state = kick_state*1664525 + 1013904223;
+	size_t index = (kick_state & 0x10000) ? i1 : i2;
+	for (size_t n=0;n<max_kicks;n++)
+	{
+		kick_state = kick_state*1664525 + 1013904223;
+		size_t slot = (kick_state >> 16) % bucket_size;
+		
+		kicks[n] = { index, body[index] };
+		uint16_t victim = body[index] >> (slot*16);
+		body[index] = (body[index] & ~((uint64_t)0xFFFF << (slot*16))) | (uint64_t)fp << (slot*16);
+		fp = victim;
+		index = alt_index(index, fp);
+		if (bucket_insert(index, fp))
+		{
+			count++;
+			return true;
+		}
+	}
+	for (size_t n=max_kicks;n--;)
+		body[kicks[n].index] = kicks[n].prev;
+	return false;
+}
+
+bool cuckoo_filter::remove_hash(uint64_t hash)
+{
+	if (!body.size())
+		return false;
+	if (!storage.size())
+		check_writable(body.size());
+	uint16_t fp = fingerprint(hash);
+	size_t i1 = hash & mask();
+	if (bucket_remove(i1, fp) || bucket_remove(alt_index(i1, fp), fp))
+	{
+		count--;
+		return true;
+	}
+	return false;
+}
+
+bytearray cuckoo_filter::serialize() const
+{
+	bytearray ret;
+	ret.resize(header_size + body.size()*sizeof(uint64_t));
+	write_header(ret, "arcucko1", body.size(), count);
+	memcpy(ret.ptr()+header_size, body.ptr(), body.size()*sizeof(uint64_t));
+	return ret;
+}
+
+bool cuckoo_filter::load(bytesr by)
+{
+	uint64_t extra;
+	arrayview<uint64_t> words = read_header(by, "arcucko1", extra);
+	if (!words.size() || (words.size() & (words.size()-1)))
+		return false;
+	storage.reset();
+	body = { (uint64_t*)words.ptr(), words.size() };
+	count = extra;
+	return true;
+}
+
+bool cuckoo_filter::load_copy(bytesr by)
+{
+	if (!load(by))
+		return false;
+	storage = body;
+	body = storage;
+	return true;
+}
+
+#include "test.h"
+#ifdef ARLIB_TEST
+test("bloom_filter", "array,string", "filter")
+{
+	bloom_filter f(10000);
+	assert(!f.contains(cstring("hello")));
+	for (int i=0;i<10000;i++)
+		f.insert(tostring(i));
+	for (int i=0;i<10000;i++)
+		assert(f.contains(tostring(i)));
+	
+	size_t false_positives = 0;
+	for (int i=10000;i<110000;i++)
+		false_positives += f.contains(tostring(i));
+	assert_lt(false_positives, 1500); // expected about 1%, give it some margin
+	
+	bytearray by = f.serialize();
+	bloom_filter f2;
+	assert(f2.load(by));
+	for (int i=0;i<10000;i++)
+		assert(f2.contains(tostring(i)));
+	
+	bloom_filter f3;
+	assert(f3.load_copy(by));
+	f3.insert(cstring("hello"));
+	assert(f3.contains(cstring("hello")));
+	
+	by[0]++;
+	assert(!f2.load(by));
+	by[0]--;
+	by[8]++; // hash fingerprint
+	assert(!f2.load(by));
+	by[8]--;
+	assert(!f2.load(by.slice(0, by.size()-8)));
+	
+	bloom_filter f4;
+	assert(!f4.contains(1));
+	f4.insert(1);
+	assert(f4.contains(1));
+}
+
+test("cuckoo_filter", "array,string", "filter")
+{
+	cuckoo_filter f(10000);
+	for (int i=0;i<10000;i++)
+		assert(f.insert(i));
+	assert_eq(f.size(), 10000);
+	for (int i=0;i<10000;i++)
+		assert(f.contains(i));
+	
+	size_t false_positives = 0;
+	for (int i=10000;i<110000;i++)
+		false_positives += f.contains(i);
+	assert_lt(false_positives, 100); // expected about 0.01%
+	
+	for (int i=0;i<10000;i+=2)
+		assert(f.remove(i));
+	assert_eq(f.size(), 5000);
+	for (int i=1;i<10000;i+=2)
+		assert(f.contains(i));
+	false_positives = 0;
+	for (int i=0;i<10000;i+=2)
+		false_positives += f.contains(i);
+	assert_lt(false_positives, 10);
+	
+	// filling it up must fail cleanly, without losing anything
+	cuckoo_filter f2(64);
+	int n_inserted = 0;
+	while (f2.insert(n_inserted))
+		n_inserted++;
+	assert_gte(n_inserted, 56);
+	assert_eq(f2.size(), n_inserted);
+	for (int i=0;i<n_inserted;i++)
+		assert(f2.contains(i));
+	
+	cuckoo_filter f4;
+	assert(!f4.contains(1));
+	assert(!f4.remove(1));
+	assert(f4.insert(1));
+	assert(f4.contains(1));
+	
+	bytearray by = f.serialize();
+	cuckoo_filter f3;
+	assert(f3.load_copy(by));
+	assert_eq(f3.size(), 5000);
+	for (int i=1;i<10000;i+=2)
+		assert(f3.contains(i));
+	assert(f3.remove(1));
+	assert(!f3.load(by.slice(0, 100)));
+
+}
+#endif
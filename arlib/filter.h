@@ -0,0 +1,150 @@
+#pragma once
+#include "global.h"
+#include "array.h"
+#include "hash.h"
+
+// Probabilistic membership filters. contains() may return true for keys that were never inserted,
+//  but never returns false for a key that was.
+// Keys are hashed with hash(), so anything that can be a set<> key can be used here.
+//
+// Both can be serialized, and loaded from a file2::mmap_t without copying or rebuilding. However, hash() values are not
+//  stable outside the process (see hash.h), so the serialized form records a fingerprint of the hash function, and load()
+//  fails if the fingerprint doesn't match; the caller must then rebuild the filter from the underlying data.
+// Don't use these filters on untrusted input; like everything else based on hash(), they're trivial to attack.
+class filter_base : nocopy {
+protected:
+	template<typename T>
+	static uint64_t key_hash(const T& key) { return hash_shuffle_strong((uint64_t)hash(key)); }
+	// Called before writing, if storage is empty. Fails if the filter is from load(); otherwise, it's default constructed,
+	//  and the caller should init() the minimum size.
+	static void check_writable(size_t body_size);
+	
+	static const size_t header_size = 64;
+	// The header is the magic, the hash fingerprint, the number of words in the body, and one filter-specific value.
+	static void write_header(bytesw by, const char * magic, uint64_t n_words, uint64_t extra);
+	// Returns the body, or an empty arrayview if the header is wrong.
+	static arrayview<uint64_t> read_header(bytesr by, const char * magic, uint64_t& extra);
+};
+
+// Blocked Bloom filter. Each key sets 8 bits, one per word in a 64-byte block, so a query touches only one cache line.
+// Measured false positive rates: about 3% at 8 bits per item, 1% at the default 10, 0.4% at 12, 0.09% at 16.
+// Can't remove items.
+class bloom_filter : filter_base {
+	static const size_t block_words = 8;
+	
+	array<uint64_t> storage;
+	arrayvieww<uint64_t> body; // either storage, or external memory
+	
+	uint64_t* block_for(uint64_t hash) const
+	{
+		size_t n_blocks = body.size() / block_words;
+		return (uint64_t*)body.ptr() + (size_t)(((hash>>32) * n_blocks) >> 32) * block_words;
+	}
+	static uint64_t bit_for(uint64_t hash, size_t word)
+	{
+		static const uint32_t salt[block_words] = {
+			0x47b6137b, 0x44974d91, 0x8824ad5b, 0xa2b7289d, 0x705495c7, 0x2df1424b, 0x9efc4947, 0x5c6bfb31
+		};
+		return (uint64_t)1 << (((uint32_t)hash * salt[word]) >> 26);
+	}
+	
+public:
+	bloom_filter() {}
+	bloom_filter(size_t n_items, size_t bits_per_item = 10) { init(n_items, bits_per_item); }
+	// Discards all contents. A default constructed filter is empty; inserting into it sets it to the minimum size.
+	void init(size_t n_items, size_t bits_per_item = 10);
+	
+	void insert_hash(uint64_t hash)
+	{
+		if (UNLIKELY(!storage.size()))
+		{
+			check_writable(body.size());
+			init(0);
+		}
+		uint64_t* block = block_for(hash);
+		for (size_t i=0;i<block_words;i++)
+			block[i] |= bit_for(hash, i);
+	}
+	bool contains_hash(uint64_t hash) const
+	{
+		if (!body.size())
+			return false;
+		const uint64_t* block = block_for(hash);
+		bool ret = true;
+		for (size_t i=0;i<block_words;i++)
+			ret &= ((block[i] & bit_for(hash, i)) != 0);
+		return ret;
+	}
+	template<typename T> void insert(const T& key) { insert_hash(key_hash(key)); }
+	template<typename T> bool contains(const T& key) const { return contains_hash(key_hash(key)); }
+	
+	bytearray serialize() const;
+	// The filter refers to the given memory, which must remain valid. Such a filter is read only; inserting would write to
+	//  the given memory, which may be a read-only mmap, so it's an error. Use load_copy() if it needs changes.
+	bool load(bytesr by);
+	// Like load(), but copies the data, so the filter is writable and doesn't need the given memory.
+	bool load_copy(bytesr by);
+};
+
+// Cuckoo filter, with 16-bit fingerprints in buckets of four. False positive rate is about 0.01%, at about 17 bits
+//  per item. Unlike the Bloom filter, it supports removal, but only of items that were actually inserted, and inserting
+//  the same key more than a few times fills up its buckets.
+// Insertion fails if the filter is full; this usually happens at about 95% of the given capacity.
+class cuckoo_filter : filter_base {
+	static const size_t bucket_size = 4;
+	
+	array<uint64_t> storage;
+	arrayvieww<uint64_t> body; // each bucket is a uint64, with four 16-bit fingerprints; 0 is empty
+	size_t count = 0;
+	uint32_t kick_state = 1;
+	
+	size_t mask() const { return body.size()-1; }
+	static uint16_t fingerprint(uint64_t hash)
+	{
+		uint16_t ret = hash >> 48;
+		return ret ? ret : 1;
+	}
+	size_t alt_index(size_t index, uint16_t fp) const { return (index ^ hash_shuffle_strong((uint32_t)fp)) & mask(); }
+	
+	static bool bucket_has(uint64_t bucket, uint16_t fp)
+	{
+		for (size_t i=0;i<bucket_size;i++)
+		{
+			if ((uint16_t)(bucket >> (i*16)) == fp)
+				return true;
+		}
+		return false;
+	}
+	bool bucket_insert(size_t index, uint16_t fp);
+	bool bucket_remove(size_t index, uint16_t fp);
+	
+public:
+	cuckoo_filter() {}
+	cuckoo_filter(size_t n_items) { init(n_items); }
+	// Discards all contents. A default constructed filter is empty; inserting into it sets it to the minimum size.
+	void init(size_t n_items);
+	
+	// Returns false if the filter is full. In that case, the filter is unchanged.
+	bool insert_hash(uint64_t hash);
+	bool contains_hash(uint64_t hash) const
+	{
+		if (!body.size())
+			return false;
+		uint16_t fp = fingerprint(hash);
+		size_t i1 = hash & mask();
+		return bucket_has(body[i1], fp) || bucket_has(body[alt_index(i1, fp)], fp);
+	}
+	// Returns whether anything was removed.
+	bool remove_hash(uint64_t hash);
+	
+	template<typename T> bool insert(const T& key) { return insert_hash(key_hash(key)); }
+	template<typename T> bool contains(const T& key) const { return contains_hash(key_hash(key)); }
+	template<typename T> bool remove(const T& key) { return remove_hash(key_hash(key)); }
+	
+	size_t size() const { return count; }
+	
+	bytearray serialize() const;
+	// Same as bloom_filter; inserting or removing is an error after load(), but not after load_copy().
+	bool load(bytesr by);
+	bool load_copy(bytesr by);
+};
@@ -66,7 +66,7 @@ public:
 		//  Host: per url
 		//  Content-Length: body.size(), if method is not GET
 		//  Content-Type: application/json if body starts with [ or {, else application/x-www-form-urlencoded, if body is nonempty
-		array<string> headers;
+		inline_array<string,4> headers;
 		bytearray body;
 		
 		size_t bytes_max = 16*1024*1024; // Counts total bytes received in the HTTP response. For request_chunked(), applies to headers only.
@@ -76,7 +76,7 @@ public:
 		
 		int status;
 		bool complete = false;
-		array<string> headers;
+		inline_array<string,4> headers;
 		
 		bool success() const
 		{
@@ -168,7 +168,7 @@ public:
 	// To avoid this, the req must be a local created on a previous line.
 	//  Any attempt to pass an initializer list directly will be unable to choose between the overloads, giving an error.
 	// Once I drop support for GCC 12, all callers should be audited.
-	struct bad_req { location loc; string method; array<string> headers; bytearray body; size_t bytes_max = 16*1024*1024; };
+	struct bad_req { location loc; string method; inline_array<string,4> headers; bytearray body; size_t bytes_max = 16*1024*1024; };
 	async<rsp> request(bad_req q) = delete;
 #endif
 	
@@ -0,0 +1,63 @@
+#include "intern.h"
+
+atom intern_pool::get(cstring str)
+{
+	const atom* found = m_by_str.get_or_null(str);
+	if (found)
+		return *found;
+	
+	atom::body* b = m_arena.make<atom::body>();
+	b->id = m_by_id.size();
+	b->str = m_arena.strdup(str);
+	m_by_str.insert(b->str, b);
+	m_by_id.append(b);
+	return b;
+}
+
+#include "test.h"
+#ifdef ARLIB_TEST
+test("intern_pool", "string,set,arena", "intern")
+{
+	intern_pool pool;
+	assert(!pool.find("foo"));
+	
+	atom foo = pool.get("foo");
+	atom bar = pool.get(string("bar"));
+	atom empty = pool.get("");
+	assert(foo);
+	assert(empty);
+	assert(foo != bar);
+	assert(foo == pool.get(string("f")+"oo"));
+	assert(foo == pool.find("foo"));
+	assert(empty != atom());
+	assert_eq(pool.size(), 3);
+	
+	assert_eq(foo.id(), 0);
+	assert_eq(bar.id(), 1);
+	assert_eq(empty.id(), 2);
+	assert(pool.by_id(1) == bar);
+	assert_eq(foo.str(), "foo");
+	assert_eq(bar.str(), "bar");
+	assert_eq(empty.str(), "");
+	assert_eq(atom().str(), "");
+	
+	// the strings must not move when the pool grows
+	const char * foo_ptr = foo.str();
+	array<atom> many;
+	for (int i=0;i<10000;i++)
+		many.append(pool.get("a long string to fill up the arena "+tostring(i)));
+	for (int i=0;i<10000;i++)
+	{
+		assert(many[i] == pool.get("a long string to fill up the arena "+tostring(i)));
+		assert_eq(many[i].id(), i+3);
+	}
+	assert_eq((const char*)foo.str(), foo_ptr);
+	assert(foo == pool.get("foo"));
+	
+	map<atom, int> m;
+	m.insert(foo, 1);
+	m.insert(bar, 2);
+	assert_eq(m.get(pool.get("foo")), 1);
+	assert_eq(m.get(pool.get("bar")), 2);
+}
+#endif
@@ -0,0 +1,51 @@
+#pragma once
+#include "global.h"
+#include "arena.h"
+#include "set.h"
+#include "string.h"
+
+class intern_pool;
+
+// An interned string. Two atoms from the same intern_pool are equal if and only if their strings are, so comparing and
+//  hashing them is O(1), and they're cheap map keys. The string's address is stable, and it's valid as long as the pool is.
+// A default constructed atom is null; it's not equal to any other atom, not even the empty string.
+// Atoms from different pools must not be compared.
+class atom {
+	friend class intern_pool;
+	struct body {
+		uint32_t id;
+		cstrnul str;
+	};
+	const body* m_body = nullptr;
+	atom(const body* b) : m_body(b) {}
+	
+public:
+	atom() = default;
+	
+	// Small integer, unique within the pool. The pool's first atom is 0, the next one is 1, etc.
+	uint32_t id() const { return m_body->id; }
+	cstrnul str() const { return m_body ? m_body->str : cstrnul(); }
+	
+	explicit operator bool() const { return m_body; }
+	bool operator==(const atom& other) const { return m_body == other.m_body; }
+	size_t hash() const { return (uintptr_t)m_body; }
+};
+
+// Not thread safe.
+class intern_pool : nocopy {
+	arena m_arena;
+	map<cstring, atom> m_by_str; // the keys point into the arena
+	array<atom> m_by_id;
+	
+public:
+	// Returns the atom for this string, creating it if needed.
+	atom get(cstring str);
+	// Returns the atom for this string, or a null atom if there is none.
+	atom find(cstring str) const
+	{
+		const atom* ret = m_by_str.get_or_null(str);
+		return ret ? *ret : atom();
+	}
+	atom by_id(uint32_t id) const { return m_by_id[id]; }
+	size_t size() const { return m_by_id.size(); }
+};
@@ -97,7 +97,10 @@ jsonparser::event jsonparser::next_inner()
 		else
 			m_need_error = true;
 		m_want_key = false;
-		return { jsonparser::map_key, decode_backslashes<json5>(ret_str) };
+		event ev = { jsonparser::map_key, decode_backslashes<json5>(ret_str) };
+		if (m_keys)
+			ev.key = m_keys->get(ev.str);
+		return ev;
 	}
 	if (*m_at == '{')
 	{
@@ -778,6 +781,148 @@ string JSON::serialize_sorted(int indent) const
 
 
 
+const JSONarena JSONarena::c_null;
+
+// Children are collected on a stack, and copied to the arena once the list or map is complete,
+//  so the arena only gets one allocation per container, and the stack's memory is reused by all of them.
+struct JSONarena::builder {
+	arena& a;
+	jsonparser& p;
+	bool ok = true;
+	array<JSONarena> list_stack;
+	array<member> map_stack;
+	
+	void construct(JSONarena& out, jsonparser::event& ev, size_t maxdepth);
+	void build_index(member* members, uint32_t count);
+};
+
+void JSONarena::builder::construct(JSONarena& out, jsonparser::event& ev, size_t maxdepth)
+{
+	out.m_type = ev.type;
+	if (ev.type == jsonparser::str || ev.type == jsonparser::num)
+		out.m_str = a.strdup(ev.str);
+	else if (ev.type == jsonparser::error)
+		ok = false;
+	else if ((ev.type == jsonparser::enter_list || ev.type == jsonparser::enter_map) && maxdepth == 0)
+	{
+		out.m_type = jsonparser::error;
+		ok = false;
+		size_t xdepth = 1;
+		while (xdepth)
+		{
+			jsonparser::event next = p.next();
+			if (next.type == jsonparser::enter_list) xdepth++;
+			if (next.type == jsonparser::enter_map) xdepth++;
+			if (next.type == jsonparser::exit_list) xdepth--;
+			if (next.type == jsonparser::exit_map) xdepth--;
+		}
+	}
+	else if (ev.type == jsonparser::enter_list)
+	{
+		size_t start = list_stack.size();
+		while (true)
+		{
+			jsonparser::event next = p.next();
+			if (next.type == jsonparser::exit_list) break;
+			JSONarena child;
+			construct(child, next, maxdepth-1);
+			list_stack.append(child);
+		}
+		out.m_count = list_stack.size() - start;
+		JSONarena* children = a.alloc_array<JSONarena>(out.m_count);
+		memcpy((void*)children, (void*)&list_stack[start], sizeof(JSONarena)*out.m_count);
+		list_stack.resize(start);
+		out.m_list = children;
+	}
+	else if (ev.type == jsonparser::enter_map)
+	{
+		size_t start = map_stack.size();
+		while (true)
+		{
+			jsonparser::event next = p.next();
+			if (next.type == jsonparser::exit_map) break;
+			if (next.type == jsonparser::map_key)
+			{
+				member child;
+				child.key = a.strdup(next.str);
+				jsonparser::event ev = p.next();
+				construct(child.value, ev, maxdepth-1);
+				map_stack.append(child);
+			}
+			if (next.type == jsonparser::error) ok = false;
+		}
+		out.m_count = map_stack.size() - start;
+		size_t n_index = (out.m_count > index_min ? index_size(out.m_count) : 0);
+		member* children = (member*)a.alloc(sizeof(member)*out.m_count + sizeof(uint32_t)*n_index, alignof(member));
+		memcpy((void*)children, (void*)&map_stack[start], sizeof(member)*out.m_count);
+		map_stack.resize(start);
+		if (n_index)
+			build_index(children, out.m_count);
+		out.m_map = children;
+	}
+}
+
+// The index is an open addressing hashtable of (member index + 1), with zero for empty slots.
+void JSONarena::builder::build_index(member* members, uint32_t count)
+{
+	uint32_t* index = (uint32_t*)(members + count);
+	size_t mask = index_size(count)-1;
+	memset(index, 0, sizeof(uint32_t)*(mask+1));
+	for (uint32_t i=0;i<count;i++)
+	{
+		size_t pos = hash_shuffle(hash(members[i].key)) & mask;
+		while (index[pos] && members[index[pos]-1].key != members[i].key)
+			pos = (pos+1) & mask;
+		index[pos] = i+1; // if it's a duplicate, the later one wins
+	}
+}
+
+const JSONarena& JSONarena::lookup(cstring key) const
+{
+	if (m_type != jsonparser::enter_map)
+		return c_null;
+	if (m_count <= index_min)
+	{
+		for (size_t i=m_count;i>0;i--)
+		{
+			if (m_map[i-1].key == key)
+				return m_map[i-1].value;
+		}
+		return c_null;
+	}
+	
+	const uint32_t* index = (const uint32_t*)(m_map + m_count);
+	size_t mask = index_size(m_count)-1;
+	size_t pos = hash_shuffle(hash(key)) & mask;
+	while (index[pos])
+	{
+		if (m_map[index[pos]-1].key == key)
+			return m_map[index[pos]-1].value;
+		pos = (pos+1) & mask;
+	}
+	return c_null;
+}
+
+const JSONarena& JSONarena::parse(arena& a, string s)
+{
+	jsonparser p(std::move(s));
+	builder b = { a, p };
+	JSONarena* ret = a.make<JSONarena>();
+	jsonparser::event ev = p.next();
+	b.construct(*ret, ev, 1000);
+	
+	ev = p.next();
+	if (!b.ok || ev.type != jsonparser::finish)
+	{
+		// like JSON, discard the entire object
+		*ret = JSONarena();
+		ret->m_type = jsonparser::error;
+	}
+	return *ret;
+}
+
+
+
 #include "test.h"
 #ifdef ARLIB_TEST
 #define e_jfalse jsonparser::jfalse
@@ -1133,6 +1278,34 @@ No \\n's!",
 test("JSON parser", "string", "json") { testjson_all<jsonparser, false>(); }
 test("JSON5 parser", "string", "json") { testjson_all<json5parser, true>(); }
 
+test("JSON parser, interned keys", "string,intern", "json")
+{
+	intern_pool pool;
+	jsonparser p("[ { \"foo\": 1, \"bar\": 2 }, { \"foo\": { \"b\\u0061r\": \"foo\" } } ]");
+	p.intern_keys(pool);
+	array<atom> keys;
+	while (true)
+	{
+		jsonparser::event ev = p.next();
+		if (ev.type == jsonparser::finish)
+			break;
+		if (ev.type == jsonparser::map_key)
+		{
+			assert_eq(ev.str, ev.key.str());
+			keys.append(ev.key);
+		}
+		else
+			assert(!ev.key);
+	}
+	assert(!p.errored());
+	assert_eq(keys.size(), 4);
+	assert_eq(pool.size(), 2);
+	assert(keys[0] == keys[2]);
+	assert(keys[1] == keys[3]);
+	assert(keys[0] == pool.find("foo"));
+	assert(keys[1] == pool.find("bar"));
+}
+
 test("JSON container", "string,array,set", "json")
 {
 	{
@@ -1231,4 +1404,59 @@ test("JSON container", "string,array,set", "json")
 		JSON((char*)spam); // must not overflow the stack (pointless cast to avoid some c++ language ambiguity)
 	}
 }
+
+test("JSONarena", "string,array,arena", "json")
+{
+	arena a;
+	
+	{
+		const JSONarena& json = JSONarena::parse(a, R"({"a":[1,2,"three"],"b":{"c":true,"d":null},"s":"a string that doesn't fit inline"})");
+		assert_eq(json.type(), jsonparser::enter_map);
+		assert_eq(json.assoc().size(), 3);
+		assert_eq(json.assoc()[0].key, "a");
+		assert_eq((int)json["a"][0], 1);
+		assert_eq((int)json["a"][1], 2);
+		assert_eq(json["a"][2].str(), "three");
+		assert_eq(json["a"].list().size(), 3);
+		assert_eq(json["a"][3].type(), jsonparser::unset);
+		assert_eq((bool)json["b"]["c"], true);
+		assert_eq(json["b"]["d"].type(), jsonparser::jnull);
+		assert_eq(json["s"].str(), "a string that doesn't fit inline");
+		assert_eq(json["x"].type(), jsonparser::unset);
+		assert_eq(json["x"]["y"][0].type(), jsonparser::unset);
+	}
+	
+	{
+		// enough keys to use the hash index, including a duplicate
+		string doc = "{";
+		for (int i=0;i<100;i++)
+			doc += "\"k"+tostring(i)+"\":"+tostring(i)+",";
+		doc += "\"k5\":500}";
+		const JSONarena& json = JSONarena::parse(a, doc);
+		assert_eq(json.assoc().size(), 101);
+		for (int i=0;i<100;i++)
+			assert_eq((int)json["k"+tostring(i)], i==5 ? 500 : i);
+		assert_eq(json["k100"].type(), jsonparser::unset);
+		
+		const JSONarena& small = JSONarena::parse(a, R"({"a":1,"a":2})");
+		assert_eq((int)small["a"], 2);
+	}
+	
+	{
+		assert_eq(JSONarena::parse(a, "[1,2").type(), jsonparser::error);
+		assert_eq(JSONarena::parse(a, "{\"x\":").type(), jsonparser::error);
+		assert_eq(JSONarena::parse(a, "[] 1").type(), jsonparser::error);
+		assert_eq(JSONarena::parse(a, "").type(), jsonparser::error);
+	}
+	
+	{
+		// the arena can be reused
+		string doc = R"({"a":[1,2,3,{"b":"a string that doesn't fit inline"}],"c":{"d":[[],{}]}})";
+		a.reset();
+		JSONarena::parse(a, doc);
+		a.reset();
+		const JSONarena& json = JSONarena::parse(a, doc);
+		assert_eq(json["a"][3]["b"].str(), "a string that doesn't fit inline");
+	}
+}
 #endif
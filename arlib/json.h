@@ -4,6 +4,8 @@
 #include "string.h"
 #include "stringconv.h"
 #include "set.h"
+#include "arena.h"
+#include "intern.h"
 
 //This is a streaming parser. It returns a sequence of event objects.
 //For example, the document
@@ -24,6 +26,7 @@ class jsonparser {
 	bool m_errored = false;
 	bool m_need_error = false;
 	bitarray m_nesting; // an entry is false for list, true for map; after [[{, this is false,false,true
+	intern_pool* m_keys = nullptr;
 	
 	friend class json5parser;
 	
@@ -68,6 +71,7 @@ public:
 	struct event {
 		int type = unset;
 		cstring str; // string, stringified number, or error message (TODO: actual error messages)
+		atom key; // for map_key, if intern_keys() was called
 	};
 	
 	// You can't stream data into this object.
@@ -75,6 +79,8 @@ public:
 	
 	event next();
 	bool errored() const { return m_errored; }
+	// Interns every map key into the given pool, and puts the atom in event::key. The pool must outlive the parser.
+	void intern_keys(intern_pool& pool) { m_keys = &pool; }
 	
 	// Meaningless helper, in case something is templated on the JSON parser type.
 	template<typename T>
@@ -105,6 +111,7 @@ public:
 	
 	event next() { return inner.next5(); }
 	bool errored() const { return inner.errored(); }
+	void intern_keys(intern_pool& pool) { inner.intern_keys(pool); }
 	
 	// JSON5 numbers support a few formats that normal JSON does not, so a separate decoder function is needed.
 	// May return unexpected answers if the input is not valid JSON5.
@@ -327,3 +334,99 @@ public:
 };
 
 using JSON = const JSONw;
+
+//A read-only JSON tree, where all nodes and strings are allocated from an arena, rather than individually from malloc.
+//Parsing and discarding a document costs a few big allocations, instead of one per node; good for short-lived documents.
+//The nodes are valid until the arena is reset or destroyed. Same interface as JSON, except objects are key/value lists,
+// not maps, in document order. If a key is repeated, lookups find the last one.
+class JSONarena {
+public:
+	struct member;
+private:
+	uint8_t m_type;
+	uint32_t m_count = 0; // for lists and maps
+	cstrnul m_str; // for strings and numbers
+	union {
+		const JSONarena* m_list;
+		const member* m_map; // followed by a hash index, if m_count is above index_min
+	};
+	
+	static const uint32_t index_min = 8;
+	static size_t index_size(size_t count) { return bitround(count*2); }
+	
+	struct builder;
+	
+	static const JSONarena c_null;
+	
+	const JSONarena& lookup(cstring key) const;
+	
+public:
+	JSONarena() : m_type(jsonparser::unset), m_list(NULL) {}
+	
+	//If the document is not valid JSON, the returned node has type error.
+	static const JSONarena& parse(arena& a, string s);
+	
+	int type() const { return m_type; }
+	
+	template<typename T = double>
+	T num() const { return m_type == jsonparser::num ? try_fromstring<T>(m_str) : (T)0; }
+	cstrnul str() const { return m_type == jsonparser::str ? m_str : (cstrnul)""; }
+	arrayview<JSONarena> list() const
+	{
+		return m_type == jsonparser::enter_list ? arrayview<JSONarena>(m_list, m_count) : nullptr;
+	}
+	arrayview<member> assoc() const
+	{
+		return m_type == jsonparser::enter_map ? arrayview<member>(m_map, m_count) : nullptr;
+	}
+	
+	bool boolean() const
+	{
+		switch (m_type)
+		{
+		case jsonparser::jtrue: return true;
+		case jsonparser::str: return m_str;
+		case jsonparser::num: return try_fromstring<double>(m_str);
+		case jsonparser::enter_list: return m_count;
+		case jsonparser::enter_map: return m_count;
+		default: return false;
+		}
+	}
+	
+	operator bool() const { return boolean(); }
+	operator double() const { return num(); }
+	operator cstrnul() const { return str(); }
+	
+	bool operator==(double right) const { return num()==right; }
+	bool operator==(const char * right) const { return str()==right; }
+	bool operator==(cstring right) const { return str()==right; }
+	
+	bool operator!=(double right) const { return num()!=right; }
+	bool operator!=(const char * right) const { return str()!=right; }
+	bool operator!=(cstring right) const { return str()!=right; }
+	
+	bool operator!() const { return !boolean(); }
+	
+#define JSONOPS(T) \
+		operator T() const { return num(); } \
+		bool operator==(T right) const { return num()==right; } \
+		bool operator!=(T right) const { return num()!=right; }
+	ALLINTS(JSONOPS)
+#undef JSONOPS
+	
+	const JSONarena& operator[](int idx) const { return operator[]((size_t)idx); }
+	const JSONarena& operator[](size_t idx) const
+	{
+		if (m_type == jsonparser::enter_list && idx < m_count)
+			return m_list[idx];
+		else
+			return c_null;
+	}
+	const JSONarena& operator[](const char * s) const { return lookup(s); }
+	const JSONarena& operator[](cstring s) const { return lookup(s); }
+};
+
+struct JSONarena::member {
+	cstrnul key;
+	JSONarena value;
+};
@@ -0,0 +1,85 @@
+#include "lrucache.h"
+#include "test.h"
+#include "string.h"
+
+#ifdef ARLIB_TEST
+test("lru_cache", "set,string", "")
+{
+	{
+		lru_cache<int,int> c(3);
+		assert(!c.get(1));
+		c.insert(1, 10);
+		c.insert(2, 20);
+		c.insert(3, 30);
+		assert_eq(c.size(), 3);
+		assert_eq(*c.get(1), 10); // 1 is now most recent, 2 is least
+		c.insert(4, 40);
+		assert(!c.contains(2));
+		assert(c.contains(1));
+		assert(c.contains(3));
+		assert(c.contains(4));
+		assert_eq(c.cost(), 3);
+		assert_eq(c.hits(), 1);
+		assert_eq(c.misses(), 1);
+		
+		c.insert(3, 31); // replacing makes it most recent
+		c.insert(5, 50);
+		assert(!c.contains(1));
+		assert_eq(*c.get(3), 31);
+		
+		c.remove(3);
+		assert(!c.get(3));
+		assert_eq(c.size(), 2);
+		c.set_budget(1);
+		assert_eq(c.size(), 1);
+		assert(c.contains(5));
+		c.reset();
+		assert_eq(c.size(), 0);
+		assert_eq(c.cost(), 0);
+		assert(!c.get(5));
+	}
+	
+	{
+		lru_cache<string,string> c(100);
+		c.insert("a", "x", 40);
+		c.insert("b", "y", 40);
+		c.insert("c", "z", 40); // evicts a
+		assert(!c.contains("a"));
+		assert_eq(c.cost(), 80);
+		c.insert("d", "w", 500); // too big on its own, evicts everything else but is kept
+		assert_eq(c.size(), 1);
+		assert_eq(*c.get("d"), "w");
+		c.insert("e", "v", 1); // and now it's evicted
+		assert(!c.contains("d"));
+		assert_eq(c.cost(), 1);
+		
+		c.insert("old", "1", 1, timestamp::now() - duration{ 10, 0 });
+		c.insert("new", "2", 1, timestamp::in_sec(3600));
+		assert(!c.get("old"));
+		assert_eq(*c.get("new"), "2");
+		assert(!c.contains("old"));
+	}
+	
+	{
+		// many insertions and removals, to test the freelist
+		lru_cache<int,int> c(50);
+		for (int i=0;i<1000;i++)
+		{
+			c.insert(i, i*2);
+			if (i%3 == 0)
+				c.remove(i-10);
+			assert_lte(c.size(), 50);
+		}
+		assert_eq(c.size(), 49); // 989 was just removed
+		for (int i=970;i<1000;i++)
+		{
+			if (i%3 == 2 && i < 990) // removed
+				assert(!c.contains(i));
+			else
+				assert_eq(*c.get(i), i*2);
+		}
+		for (int i=0;i<900;i++)
+			assert(!c.contains(i));
+	}
+}
+#endif
@@ -0,0 +1,174 @@
+#pragma once
+#include "global.h"
+#include "array.h"
+#include "set.h"
+#include "time.h"
+
+// A map with a size limit. Each item has a cost (for example its size in bytes, or just 1), and inserting an item evicts
+//  the least recently used ones until the total cost is within the budget again. Items can also have an expiry time.
+// Pointers returned from get() and insert() are invalidated by the next insert(), remove() or reset().
+// Tkey and Tvalue must be default constructible; evicted items are replaced with default objects, to release their memory.
+// Not thread safe.
+template<typename Tkey, typename Tvalue, typename Thasher = void>
+class lru_cache : nocopy {
+	static const uint32_t none = (uint32_t)-1;
+	
+	struct node {
+		Tkey key;
+		Tvalue value;
+		size_t cost;
+		timestamp expiry;
+		uint32_t prev; // towards the most recently used item; for unused nodes, unused
+		uint32_t next; // towards the least recently used item; for unused nodes, the next unused node
+	};
+	map<Tkey, uint32_t, Thasher> m_index;
+	array<node> m_nodes;
+	uint32_t m_head = none; // most recently used
+	uint32_t m_tail = none; // least recently used
+	uint32_t m_free = none;
+	
+	size_t m_budget;
+	size_t m_cost = 0;
+	size_t m_hits = 0;
+	size_t m_misses = 0;
+	
+	void unlink(uint32_t idx)
+	{
+		node& n = m_nodes[idx];
+		if (n.prev != none) m_nodes[n.prev].next = n.next;
+		else m_head = n.next;
+		if (n.next != none) m_nodes[n.next].prev = n.prev;
+		else m_tail = n.prev;
+	}
+	void link_head(uint32_t idx)
+	{
+		node& n = m_nodes[idx];
+		n.prev = none;
+		n.next = m_head;
+		if (m_head != none) m_nodes[m_head].prev = idx;
+		else m_tail = idx;
+		m_head = idx;
+	}
+	
+	void remove_node(uint32_t idx)
+	{
+		node& n = m_nodes[idx];
+		unlink(idx);
+		m_index.remove(n.key);
+		m_cost -= n.cost;
+		n.key = Tkey();
+		n.value = Tvalue();
+		n.next = m_free;
+		m_free = idx;
+	}
+	
+	void evict(uint32_t keep)
+	{
+		while (m_cost > m_budget && m_tail != none && m_tail != keep)
+			remove_node(m_tail);
+	}
+	
+	static bool expired(const node& n)
+	{
+		return n.expiry.sec != timestamp::sec_never() && n.expiry < timestamp::now();
+	}
+	
+public:
+	lru_cache(size_t budget) : m_budget(budget) {}
+	
+	// Returns null if the key doesn't exist or has expired. Otherwise, marks it as most recently used.
+	template<typename Tk2>
+	Tvalue* get(const Tk2& key)
+	{
+		uint32_t* idx = m_index.get_or_null(key);
+		if (idx && expired(m_nodes[*idx]))
+		{
+			remove_node(*idx);
+			idx = nullptr;
+		}
+		if (!idx)
+		{
+			m_misses++;
+			return nullptr;
+		}
+		m_hits++;
+		if (*idx != m_head)
+		{
+			unlink(*idx);
+			link_head(*idx);
+		}
+		return &m_nodes[*idx].value;
+	}
+	// Doesn't affect recency, or the hit/miss counters.
+	template<typename Tk2>
+	bool contains(const Tk2& key) const
+	{
+		const uint32_t* idx = m_index.get_or_null(key);
+		return idx && !expired(m_nodes[*idx]);
+	}
+	
+	// If the key already exists, it's replaced. The new item is never evicted by its own insertion, even if its cost
+	//  exceeds the budget on its own.
+	Tvalue& insert(const Tkey& key, Tvalue value, size_t cost = 1, timestamp expiry = timestamp::at_never())
+	{
+		uint32_t* existing = m_index.get_or_null(key);
+		uint32_t idx;
+		if (existing)
+		{
+			idx = *existing;
+			m_cost -= m_nodes[idx].cost;
+			unlink(idx);
+		}
+		else
+		{
+			if (m_free != none)
+			{
+				idx = m_free;
+				m_free = m_nodes[idx].next;
+			}
+			else
+			{
+				idx = m_nodes.size();
+				m_nodes.append();
+			}
+			m_nodes[idx].key = key;
+			m_index.insert(key, idx);
+		}
+		node& n = m_nodes[idx];
+		n.value = std::move(value);
+		n.cost = cost;
+		n.expiry = expiry;
+		m_cost += cost;
+		link_head(idx);
+		evict(idx);
+		return m_nodes[idx].value;
+	}
+	
+	template<typename Tk2>
+	void remove(const Tk2& key)
+	{
+		uint32_t* idx = m_index.get_or_null(key);
+		if (idx)
+			remove_node(*idx);
+	}
+	
+	void reset()
+	{
+		m_index.reset();
+		m_nodes.reset();
+		m_head = none;
+		m_tail = none;
+		m_free = none;
+		m_cost = 0;
+	}
+	
+	// Changing the budget evicts items immediately, if needed.
+	void set_budget(size_t budget) { m_budget = budget; evict(none); }
+	
+	size_t size() const { return m_index.size(); } // Includes expired items that haven't been noticed yet.
+	size_t cost() const { return m_cost; }
+	size_t budget() const { return m_budget; }
+	size_t hits() const { return m_hits; }
+	size_t misses() const { return m_misses; }
+	void reset_stats() { m_hits = 0; m_misses = 0; }
+};
@@ -1,5 +1,6 @@
 #include "prioqueue.h"
 #include "test.h"
+#include "random.h"
 
 #ifdef ARLIB_TEST
 template<typename T>
@@ -97,4 +98,79 @@ test("priority queue", "array", "prioqueue")
 	};
 	test_queue<nontrivial>({ 3,1,4,5,9,2,6,8,7,0 });
 }
+template<typename Tp, typename T>
+static void validate(const prioqueue_indexed<Tp, T>& q)
+{
+	auto items = q.peek_heap();
+	for (size_t i=0;i<items.size();i++)
+	{
+		assert_eq(q.peek_position(items[i].h), i);
+		for (size_t ch=i*4+1;ch<i*4+5 && ch<items.size();ch++)
+			assert_lte(items[i].prio, items[ch].prio);
+	}
+}
+
+test("indexed priority queue", "array", "prioqueue")
+{
+	prioqueue_indexed<int, string> q;
+	array<prioqueue_indexed<int, string>::handle> live;
+	array<int> prios; // indexed by handle
+	array<int> values;
+	
+	random_t rand(1);
+	for (int i=0;i<3000;i++)
+	{
+		uint32_t op = rand(8);
+		if (op <= 3 || !live.size())
+		{
+			int prio = rand(500);
+			auto h = q.push(prio, tostring(prio));
+			assert(!live.contains(h));
+			live.append(h);
+			prios.reserve(h+1);
+			values.reserve(h+1);
+			prios[h] = prio;
+			values[h] = prio;
+		}
+		else if (op == 4)
+		{
+			size_t idx = rand(live.size());
+			auto h = live[idx];
+			int prio = rand(500);
+			q.update(h, prio);
+			prios[h] = prio;
+			assert_eq(q.prio(h), prio);
+		}
+		else if (op == 5)
+		{
+			size_t idx = rand(live.size());
+			auto h = live[idx];
+			assert_eq(q.get(h), tostring(values[h]));
+			assert_eq(q.remove(h), tostring(values[h]));
+			assert(!q.contains(h));
+			live.remove(idx);
+		}
+		else
+		{
+			int min_prio = 500;
+			for (auto h : live)
+				min_prio = min(min_prio, prios[h]);
+			assert_eq(q.peek_prio(), min_prio);
+			assert_eq(prios[q.peek_handle()], min_prio);
+			live.remove_matching(q.peek_handle());
+			q.pop();
+		}
+		assert_eq(q.size(), live.size());
+		validate(q);
+	}
+	
+	int prev = -1;
+	while (q.size())
+	{
+		assert_lte(prev, q.peek_prio());
+		prev = q.peek_prio();
+		q.pop();
+		validate(q);
+	}
+}
 #endif
@@ -76,3 +76,139 @@ public:
 	arrayview<T> peek_heap() const { return { items, count }; }
 #endif
 };
+
+// Like prioqueue, but each item is given a handle, which can later be used to change its priority or remove it,
+//  both O(log n), so there's no need for lazy deletion.
+// It's a 4-ary heap; it's half as deep as a binary heap, and a node's children are usually on the same cache line.
+// Handles are small integers, and are reused once their item is popped or removed.
+template<typename Tp, typename T>
+class prioqueue_indexed {
+public:
+	typedef size_t handle;
+private:
+	struct node {
+		Tp prio;
+		handle h;
+		T value;
+	};
+	static constexpr size_t npos = (size_t)-1;
+	
+	array<node> items;
+	array<size_t> positions; // indexed by handle, npos if that handle isn't in use
+	array<handle> free_handles;
+	
+	static size_t parent(size_t n) { return (n-1)/4; }
+	static size_t child1(size_t n) { return n*4+1; }
+	
+	void place(size_t pos, const node* src)
+	{
+		memcpy((void*)&items[pos], (void*)src, sizeof(node));
+		positions[items[pos].h] = pos;
+	}
+	
+	bool sift_up(size_t pos)
+	{
+		node* body = items.ptr();
+		if (pos == 0 || !(body[pos].prio < body[parent(pos)].prio))
+			return false;
+		
+		alignas(node) char buf[sizeof(node)];
+		memcpy(buf, (void*)&body[pos], sizeof(node));
+		const node& n = *(node*)buf;
+		do {
+			place(pos, &body[parent(pos)]);
+			pos = parent(pos);
+		} while (pos && n.prio < body[parent(pos)].prio);
+		place(pos, &n);
+		return true;
+	}
+	
+	void sift_down(size_t pos)
+	{
+		node* body = items.ptr();
+		size_t len = items.size();
+		
+		alignas(node) char buf[sizeof(node)];
+		memcpy(buf, (void*)&body[pos], sizeof(node));
+		const node& n = *(node*)buf;
+		while (true)
+		{
+			size_t ch = child1(pos);
+			if (ch >= len)
+				break;
+			size_t min_ch = ch;
+			for (size_t i=ch+1;i<min(ch+4, len);i++)
+			{
+				if (body[i].prio < body[min_ch].prio)
+					min_ch = i;
+			}
+			if (!(body[min_ch].prio < n.prio))
+				break;
+			place(pos, &body[min_ch]);
+			pos = min_ch;
+		}
+		place(pos, &n);
+	}
+	
+public:
+	handle push(Tp prio, T value)
+	{
+		handle h;
+		if (free_handles.size())
+			h = free_handles.pop_tail();
+		else
+		{
+			h = positions.size();
+			positions.append(npos);
+		}
+		items.append({ std::move(prio), h, std::move(value) });
+		positions[h] = items.size()-1;
+		sift_up(items.size()-1);
+		return h;
+	}
+	
+	// The item with the lowest priority. The queue must not be empty.
+	const T& peek() const { return items[0].value; }
+	const Tp& peek_prio() const { return items[0].prio; }
+	handle peek_handle() const { return items[0].h; }
+	T pop() { return remove(items[0].h); }
+	
+	bool contains(handle h) const { return h < positions.size() && positions[h] != npos; }
+	const T& get(handle h) const { return items[positions[h]].value; }
+	T& get(handle h) { return items[positions[h]].value; }
+	const Tp& prio(handle h) const { return items[positions[h]].prio; }
+	
+	void update(handle h, Tp prio)
+	{
+		size_t pos = positions[h];
+		items[pos].prio = std::move(prio);
+		if (!sift_up(pos))
+			sift_down(pos);
+	}
+	
+	T remove(handle h)
+	{
+		size_t pos = positions[h];
+		size_t last = items.size()-1;
+		T ret = std::move(items[pos].value);
+		positions[h] = npos;
+		free_handles.append(h);
+		
+		if (pos != last)
+		{
+			items.swap(pos, last);
+			positions[items[pos].h] = pos;
+		}
+		items.remove(last);
+		if (pos != last && !sift_up(pos))
+			sift_down(pos);
+		return ret;
+	}
+	
+	size_t size() const { return items.size(); }
+	
+#ifdef ARLIB_TEST
+	auto peek_heap() const { return (arrayview<node>)items; }
+	size_t peek_position(handle h) const { return positions[h]; }
+#endif
+};
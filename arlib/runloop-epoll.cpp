@@ -0,0 +1,398 @@
+#if defined(__linux__) && defined(ARLIB_RUNLOOP_EPOLL)
+#include "runloop2.h"
+#include "array.h"
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <errno.h>
+#ifdef ARLIB_SOCKET
+#include "socket.h"
+#endif
+
+#ifdef ARLIB_GUI
+#error the epoll runloop does not support GUI events, use the poll runloop instead
+#endif
+
+// Same contract as runloop-poll.cpp, but epoll_wait() only returns the fds that are actually ready,
+//  so step() is O(ready fds) rather than O(registered fds). Useful if there's a lot of idle sockets.
+// Every fd is registered as EPOLLONESHOT; once it fires, the kernel disarms it, and it's rearmed only if someone's still waiting.
+// Registration changes are collected and flushed right before epoll_wait, so await_fd() itself is syscall-free,
+//  and the usual recv / await / recv cycle costs one epoll_ctl per wakeup.
+// Cancelling a wait doesn't touch the kernel at all; if the stale registration fires, the event is simply ignored.
+
+namespace {
+
+class runloop2_epoll;
+runloop2_epoll& get_loop();
+
+class runloop2_epoll {
+public:
+#ifdef ARLIB_TESTRUNNER
+	timestamp last_iter;
+	bool test_has_runloop = false;
+	bool test_is_main = false; // loops on other threads aren't part of the test, and mustn't report latency
+#endif
+	
+	class fds_t {
+		static const size_t npos = (size_t)-1;
+		
+		struct waiter_node {
+			producer<void> prod = make_producer<&waiter_node::prod, &waiter_node::cancel>();
+			void cancel() { get_loop().fds.cancel(this); }
+			size_t next; // next waiter for the same fd; or, if this node is unused, the freelist
+			int fd;
+			bool want_write;
+			uint32_t step_id; // events from the step() that created this node must not dispatch it
+		};
+	public:
+		allocatable_array<waiter_node, [](waiter_node* n) { return &n->next; }, [](waiter_node* n) { n->prod.moved(); }> nodes;
+	private:
+	
+		struct fd_state {
+			size_t first = npos; // index into nodes
+			uint32_t gen = 0; // incremented on every epoll_ctl, so events from a previous registration can be discarded
+			bool registered = false; // if false, the fd is not in the epoll set; if true, it may or may not be (it could've been closed)
+			bool dirty = false;
+			bool regular = false; // epoll rejects regular files; poll() claims they're always ready, so let's do the same
+		};
+		array<fd_state> state; // indexed by fd
+		array<int> dirty;
+		array<int> regular;
+		
+		int epfd;
+		uint32_t step_id = 0;
+		
+		void mark_dirty(int fd)
+		{
+			if (state[fd].dirty)
+				return;
+			state[fd].dirty = true;
+			dirty.append(fd);
+		}
+		
+		void unregular(int fd)
+		{
+			state[fd].regular = false;
+			regular.remove_matching(fd);
+		}
+		
+		void cancel(waiter_node* n)
+		{
+			size_t idx = n - nodes.begin();
+			int fd = n->fd;
+			size_t* link = &state[fd].first;
+			while (*link != idx)
+				link = &nodes.begin()[*link].next;
+			*link = n->next;
+			nodes.dealloc(n);
+			if (state[fd].first == npos && state[fd].regular)
+				unregular(fd);
+		}
+		
+		void ctl(int fd, uint32_t events)
+		{
+			fd_state& st = state[fd];
+			st.gen++;
+			epoll_event ev = { events|EPOLLONESHOT, { .u64 = (uint32_t)fd | (uint64_t)st.gen<<32 } };
+			
+			int op = (st.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD);
+		again:
+			if (epoll_ctl(epfd, op, fd, &ev) == 0)
+			{
+				st.registered = true;
+				return;
+			}
+			// the fd was closed and the number reused, or someone else registered it (for example a dup() of a registered fd)
+			if (errno == ENOENT && op == EPOLL_CTL_MOD) { op = EPOLL_CTL_ADD; goto again; }
+			if (errno == EEXIST && op == EPOLL_CTL_ADD) { op = EPOLL_CTL_MOD; goto again; }
+			st.registered = false;
+			if (errno == EPERM)
+			{
+				st.regular = true;
+				regular.append(fd);
+			}
+			// else EBADF, which means someone's waiting for a closed fd; that's a bug in the caller, and poll() wouldn't help either
+		}
+	
+	public:
+		fds_t()
+		{
+			epfd = epoll_create1(EPOLL_CLOEXEC);
+			if (epfd < 0)
+				abort();
+		}
+		~fds_t()
+		{
+			close(epfd);
+		}
+		
+		async<void> await_fd(int fd, bool want_write)
+		{
+			waiter_node* n = nodes.alloc();
+			if ((size_t)fd >= state.size())
+				state.resize(max((size_t)fd+1, state.size()*2));
+			
+			n->fd = fd;
+			n->want_write = want_write;
+			n->step_id = step_id;
+			n->next = state[fd].first;
+			state[fd].first = n - nodes.begin();
+			if (!state[fd].regular)
+				mark_dirty(fd);
+			return &n->prod;
+		}
+		
+		// Tells the kernel about every fd whose waiter set changed. Returns whether any fd is always ready.
+		bool flush()
+		{
+			for (int fd : dirty)
+			{
+				fd_state& st = state[fd];
+				st.dirty = false;
+				if (st.regular)
+					continue;
+				
+				uint32_t want = 0;
+				for (size_t n = st.first; n != npos; n = nodes.begin()[n].next)
+					want |= (nodes.begin()[n].want_write ? EPOLLOUT : EPOLLIN);
+				// if nobody's waiting, leave the registration disarmed; if it's armed, the event will be ignored
+				if (want)
+					ctl(fd, want);
+			}
+			dirty.reset();
+			return regular.size();
+		}
+		
+		int wait(epoll_event* events, int max_events, int timeout_ms)
+		{
+			int n = epoll_wait(epfd, events, max_events, timeout_ms);
+			step_id++;
+			return n;
+		}
+		
+		// Returns whether anything happened.
+		bool dispatch(int fd, uint32_t events)
+		{
+			bool rd = (events & (EPOLLIN |EPOLLHUP|EPOLLERR)); // kernel always returns HUP and ERR, whether requested or not
+			bool wr = (events & (EPOLLOUT|EPOLLHUP|EPOLLERR));
+			bool ret = false;
+			
+			// the loop must restart from the start every time, activating a coroutine can add or cancel waiters, and reallocate both arrays
+			// (usually, an fd has only one or two waiters, so it's not a performance problem)
+		again:
+			size_t* link = &state[fd].first;
+			while (*link != npos)
+			{
+				waiter_node* n = &nodes.begin()[*link];
+				if (n->step_id != step_id && (n->want_write ? wr : rd))
+				{
+					*link = n->next;
+					nodes.dealloc(n);
+					n->prod.complete();
+					ret = true;
+					goto again;
+				}
+				link = &n->next;
+			}
+			
+			if (state[fd].first != npos)
+				mark_dirty(fd); // oneshot means it's now disarmed; rearm it for the remaining waiters
+			return ret;
+		}
+		
+		bool dispatch_event(const epoll_event& ev)
+		{
+			int fd = (uint32_t)ev.data.u64;
+			if ((size_t)fd >= state.size() || state[fd].gen != (uint32_t)(ev.data.u64 >> 32))
+				return false;
+			return dispatch(fd, ev.events);
+		}
+		
+		bool dispatch_regular()
+		{
+			bool ret = false;
+			for (size_t i=0;i<regular.size();i++)
+			{
+				int fd = regular[i];
+				ret |= dispatch(fd, EPOLLIN|EPOLLOUT);
+				if (state[fd].first == npos && state[fd].regular)
+				{
+					unregular(fd);
+					i--;
+				}
+			}
+			return ret;
+		}
+	};
+	fds_t fds;
+	
+	
+	timer_wheel timeouts;
+	
+	
+	bool step(bool wait)
+	{
+		bool ret = false;
+		
+		timestamp timeout = timeouts.next();
+		
+		bool any_regular = fds.flush();
+		
+		int timeout_ms = -1;
+		if (!wait || any_regular)
+		{
+			timeout_ms = 0;
+		}
+		else if (timeout != timestamp::at_never())
+		{
+			duration dur = timeout - timestamp::now();
+			if (dur.sec < 0)
+				timeout_ms = 0;
+			else if (dur.sec >= INT_MAX/1000 - 1)
+				timeout_ms = INT_MAX;
+			else // round up, waking up early and immediately sleeping again is pointless
+				timeout_ms = dur.sec*1000 + (dur.nsec+999999)/1000000;
+		}
+		
+		test_rethrow();
+#ifdef ARLIB_TESTRUNNER
+		test_has_runloop = true;
+		test_iter_end();
+#endif
+		epoll_event events[64];
+		int n_events = fds.wait(events, ARRAY_SIZE(events), timeout_ms);
+#ifdef ARLIB_TESTRUNNER
+		test_iter_begin();
+#endif
+		
+		for (int i=0;i<n_events;i++)
+			ret |= fds.dispatch_event(events[i]);
+		if (any_regular)
+			ret |= fds.dispatch_regular();
+		
+		ret |= timeouts.run(timestamp::now());
+		test_rethrow();
+		
+		return ret;
+	}
+	
+	async<void> await_fd(int fd, bool want_write)
+	{
+		return fds.await_fd(fd, want_write);
+	}
+	
+	async<void> await_timeout(timestamp timeout)
+	{
+		return timeouts.await(timeout);
+	}
+	
+#ifdef ARLIB_SOCKET
+	void* dns = nullptr;
+	runloop2_epoll()
+	{
+#ifndef ARLIB_THREAD
+		dns = socket2::dns_create();
+#endif
+	}
+	~runloop2_epoll()
+	{
+#if defined(ARLIB_THREAD) || defined(ARLIB_TESTRUNNER)
+		if (dns)
+#endif
+			socket2::dns_destroy(dns);
+	}
+	void* get_dns()
+	{
+#if defined(ARLIB_THREAD) || defined(ARLIB_TESTRUNNER)
+		if (!dns)
+			dns = socket2::dns_create();
+#endif
+		return dns;
+	}
+#endif
+	
+#ifdef ARLIB_TESTRUNNER
+	void test_iter_begin()
+	{
+		last_iter = timestamp::now();
+	}
+	void test_iter_end()
+	{
+		if (test_is_main && test_has_runloop)
+			_test_runloop_latency(timestamp::now() - last_iter);
+	}
+	
+	size_t n_global_waits;
+	
+	size_t n_fd_waits()
+	{
+		size_t ret = 0;
+		for (auto& node : fds.nodes)
+		{
+			if (node.prod.has_waiter())
+				ret++;
+		}
+		return ret;
+	}
+	
+	void test_begin()
+	{
+		test_is_main = true;
+		test_has_runloop = false;
+		test_iter_begin();
+		n_global_waits = n_fd_waits();
+	}
+	void test_end()
+	{
+		test_iter_end();
+#ifdef ARLIB_SOCKET
+		if (dns)
+		{
+			socket2::dns_destroy(dns);
+			dns = nullptr;
+		}
+#endif
+		assert_eq(n_global_waits, n_fd_waits());
+		assert_eq(timeouts.size(), 0);
+	}
+#endif
+};
+
+#ifdef ARLIB_THREAD
+static thread_local runloop2_epoll* g_loop;
+runloop2_epoll& get_loop()
+{
+	runloop2_epoll*& loop = g_loop;
+	if (!loop)
+		loop = new runloop2_epoll();
+	return *loop;
+}
+#else
+__attribute__((init_priority(101))) // objects without a constructor priority are constructed after ones with
+static runloop2_epoll g_loop;
+runloop2_epoll& get_loop() { return g_loop; }
+#endif
+
+}
+
+namespace runloop2 {
+	bool step(bool wait) { return get_loop().step(wait); }
+	void run(async<void> event)
+	{
+		waiter<void> wait;
+		event.then(&wait);
+		auto& loop = get_loop();
+		while (wait.is_waiting())
+			loop.step(true);
+	}
+	async<void> await_fd(int fd, bool want_write) { return get_loop().await_fd(fd, want_write); }
+	async<void> await_timeout(timestamp timeout) { return get_loop().await_timeout(timeout); }
+	async<void> in_ms(int ms) { return get_loop().await_timeout(timestamp::in_ms(ms)); }
+#ifdef ARLIB_SOCKET
+	void* get_dns() { return get_loop().get_dns(); }
+#endif
+#ifdef ARLIB_TESTRUNNER
+	void test_begin() { get_loop().test_begin(); }
+	void test_end() { get_loop().test_end(); }
+#endif
+}
+#endif
@@ -0,0 +1,55 @@
+#include "runloop2.h"
+
+thread_local coro_frame_alloc::freelist_t coro_frame_alloc::freelist;
+
+coro_frame_alloc::thread_cleanup::~thread_cleanup()
+{
+	for (size_t cls=0;cls<n_classes;cls++)
+	{
+		void* iter = freelist.head[cls];
+		while (iter)
+		{
+			void* next = *(void**)iter;
+			free(iter);
+			iter = next;
+		}
+		freelist.head[cls] = nullptr;
+		// pretend the list is full, so frames freed during the rest of thread teardown go straight to free()
+		freelist.count[cls] = max_cached;
+	}
+}
+
+void coro_frame_alloc::register_cleanup()
+{
+	static thread_local thread_cleanup cleanup;
+	(void)cleanup;
+	freelist.registered = true;
+}
+
+void* coro_frame_alloc::alloc_slow(size_t size)
+{
+	if (!freelist.registered)
+		register_cleanup();
+#ifndef ARLIB_OPT
+	freelist.n_malloc++;
+#endif
+	size_t cls = (size-1) / granularity;
+	if (cls < n_classes)
+		size = (cls+1) * granularity; // round up, so it can be reused by anything else in the same class
+	return xmalloc(size);
+}
+
+coro_frame_alloc::stats_t coro_frame_alloc::stats()
+{
+	stats_t ret = {};
+#ifndef ARLIB_OPT
+	ret.n_alloc = freelist.n_alloc;
+	ret.n_malloc = freelist.n_malloc;
+#endif
+	for (size_t cls=0;cls<n_classes;cls++)
+	{
+		if (freelist.head[cls])
+			ret.n_cached += freelist.count[cls];
+	}
+	return ret;
+}
@@ -0,0 +1,123 @@
+#ifdef ARLIB_THREAD
+#include "runloop2.h"
+#ifdef __unix__
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+runloop_mailbox::runloop_mailbox()
+{
+#ifdef __linux__
+	fd_rd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+	if (fd_rd < 0)
+		abort();
+	fd_wr = fd_rd;
+#elif defined(__unix__)
+	int fds[2];
+	if (pipe(fds) < 0)
+		abort();
+	for (int fd : fds)
+	{
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	}
+	fd_rd = fds[0];
+	fd_wr = fds[1];
+#endif
+#ifdef _WIN32
+	event = CreateEvent(NULL, FALSE, FALSE, NULL); // auto reset, so waking up resets it
+#endif
+	arm();
+}
+
+runloop_mailbox::~runloop_mailbox()
+{
+	wake_wait.cancel();
+	// post() writes the wakeup while holding the lock, so once we've got the lock, nobody's touching the fds anymore
+	synchronized(lock) {}
+#ifdef __unix__
+	close(fd_rd);
+	if (fd_wr != fd_rd)
+		close(fd_wr);
+#endif
+#ifdef _WIN32
+	CloseHandle(event);
+#endif
+}
+
+void runloop_mailbox::arm()
+{
+#ifdef __unix__
+	runloop2::await_read(fd_rd).then(&wake_wait);
+#endif
+#ifdef _WIN32
+	runloop2::await_handle(event).then(&wake_wait);
+#endif
+}
+
+void runloop_mailbox::post(function<void()> fn)
+{
+	synchronized(lock)
+	{
+		queue.append(std::move(fn));
+		if (!signalled)
+		{
+			signalled = true;
+#ifdef __unix__
+			uint64_t one = 1; // eventfd wants exactly 8 bytes; a pipe doesn't care
+			ssize_t ignore = write(fd_wr, &one, sizeof(one));
+			(void)ignore;
+#endif
+#ifdef _WIN32
+			SetEvent(event);
+#endif
+		}
+	}
+}
+
+void runloop_mailbox::on_wake()
+{
+	array<function<void()>> items;
+	synchronized(lock)
+	{
+#ifdef __unix__
+		// only one write per signal, so one read drains it
+		uint64_t ignore;
+		ssize_t ignore2 = read(fd_rd, &ignore, sizeof(ignore));
+		(void)ignore2;
+#endif
+		signalled = false;
+		items.swap(queue);
+	}
+	// rearm before calling anything, the functions may destroy the mailbox
+	arm();
+	for (function<void()>& fn : items)
+		fn();
+}
+
+static thread_local runloop_mailbox* g_shared_mailbox;
+
+runloop_mailbox* runloop_mailbox::acquire()
+{
+	if (!g_shared_mailbox)
+		g_shared_mailbox = new runloop_mailbox();
+	g_shared_mailbox->n_users++;
+	return g_shared_mailbox;
+}
+
+void runloop_mailbox::release()
+{
+	if (--n_users == 0)
+	{
+		if (g_shared_mailbox == this)
+			g_shared_mailbox = nullptr;
+		delete this;
+	}
+}
+#endif
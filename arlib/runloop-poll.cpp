@@ -1,5 +1,6 @@
-#if defined(__unix__) && (defined(ARLIB_GUI_GTK3) || !__has_include(<glib.h>))
+#if defined(__unix__) && (defined(ARLIB_GUI_GTK3) || !__has_include(<glib.h>)) && !defined(ARLIB_RUNLOOP_EPOLL) && !defined(ARLIB_RUNLOOP_URING)
 // if GLib is included but ARGUI is disabled, using this thing is unwise; block it
+// (if ARRUNLOOP=epoll or io_uring, runloop-epoll.cpp or runloop-uring.cpp takes over)
 #include "runloop2.h"
 #include "array.h"
 #include <sys/poll.h>
@@ -30,7 +31,8 @@ public:
 	
 #ifdef ARLIB_TESTRUNNER
 	timestamp last_iter;
-	bool test_has_runloop;
+	bool test_has_runloop = false;
+	bool test_is_main = false; // loops on other threads aren't part of the test, and mustn't report latency
 #endif
 	
 	class fds_t {
@@ -141,35 +143,7 @@ public:
 	fds_t fds;
 	
 	
-	class timeout_t {
-		struct waiter_node {
-			producer<void> prod = make_producer<&waiter_node::prod, &waiter_node::cancel>();
-			void cancel() { get_loop().timeouts.cancel(this); }
-			timestamp timeout;
-		};
-	public:
-		allocatable_array<waiter_node, [](waiter_node* n) { return &n->timeout.sec; }, [](waiter_node* n) { n->prod.moved(); }> waiting;
-	private:
-		void cancel(waiter_node* n)
-		{
-			waiting.dealloc(n);
-		}
-		
-	public:
-		async<void> await_timeout(timestamp timeout)
-		{
-			waiter_node* n = waiting.alloc();
-			n->timeout = timeout;
-			return &n->prod;
-		}
-		
-		void activate(waiter_node* n)
-		{
-			waiting.dealloc(n);
-			n->prod.complete();
-		}
-	};
-	timeout_t timeouts;
+	timer_wheel timeouts;
 	
 	
 	bool step(bool wait)
@@ -177,12 +151,7 @@ public:
 	again:
 		bool ret = false;
 		
-		timestamp timeout = timestamp::at_never();
-		for (auto& node : timeouts.waiting)
-		{
-			if (node.prod.has_waiter() && node.timeout <= timeout)
-				timeout = node.timeout;
-		}
+		timestamp timeout = timeouts.next();
 		
 		timestamp now = timestamp::now();
 		duration dur = timeout - now;
@@ -253,14 +222,7 @@ public:
 				ret = true;
 			}
 		}
-		for (auto& node : timeouts.waiting)
-		{
-			if (node.prod.has_waiter() && node.timeout <= now)
-			{
-				timeouts.activate(&node);
-				ret = true;
-			}
-		}
+		ret |= timeouts.run(now);
 		test_rethrow();
 		
 		if (ret && has_gui_events)
@@ -281,7 +243,7 @@ public:
 	
 	async<void> await_timeout(timestamp timeout)
 	{
-		return timeouts.await_timeout(timeout);
+		return timeouts.await(timeout);
 	}
 	
 #ifdef ARLIB_SOCKET
@@ -316,7 +278,7 @@ public:
 	}
 	void test_iter_end()
 	{
-		if (test_has_runloop)
+		if (test_is_main && test_has_runloop)
 			_test_runloop_latency(timestamp::now() - last_iter);
 	}
 	
@@ -324,6 +286,7 @@ public:
 	
 	void test_begin()
 	{
+		test_is_main = true;
 		test_has_runloop = false;
 		test_iter_begin();
 		
@@ -351,8 +314,7 @@ public:
 				n_wait_fds++;
 		}
 		assert_eq(n_global_waits, n_wait_fds);
-		for (auto& node : timeouts.waiting)
-			assert(!node.prod.has_waiter());
+		assert_eq(timeouts.size(), 0);
 	}
 #endif
 };
@@ -330,6 +330,33 @@ test("runloop coroutines", "", "runloop")
 }
 
 
+test("runloop coroutine frame pool", "", "runloop")
+{
+	struct waiter_t {
+		waiter<int> wait = make_waiter<&waiter_t::wait, &waiter_t::complete>();
+		int n = 0;
+		void complete(int val) { assert_eq(val, 42); n++; }
+	};
+	waiter_t wait;
+	coro_sync().then(&wait.wait); // make sure the freelist isn't empty
+	
+	coro_frame_alloc::stats_t before = coro_frame_alloc::stats();
+	assert(before.n_cached > 0);
+	test_nomalloc {
+		for (int i=0;i<10;i++)
+			coro_sync().then(&wait.wait);
+	}
+	assert_eq(wait.n, 11);
+	
+	coro_frame_alloc::stats_t after = coro_frame_alloc::stats();
+	assert_eq(after.n_cached, before.n_cached);
+#ifndef ARLIB_OPT
+	assert_eq(after.n_alloc, before.n_alloc+10);
+	assert_eq(after.n_malloc, before.n_malloc);
+#endif
+}
+
+
 co_test("runloop timeouts", "", "runloop")
 {
 	timestamp t1 = timestamp::now();
@@ -345,6 +372,83 @@ co_test("runloop timeouts", "", "runloop")
 	assert_range((t3-t2).ms(), 0, 100);
 }
 
+test("runloop timer wheel", "", "runloop")
+{
+	timer_wheel tw;
+	timestamp t0 = timestamp::now();
+	auto at = [&](int64_t ms) { return t0 + duration{ (time_t)(ms/1000), (long)(ms%1000*1000000) }; };
+	
+	struct waiter_t {
+		waiter<void> wait = make_waiter<&waiter_t::wait, &waiter_t::complete>();
+		int* fired;
+		int id;
+		void complete() { fired[id]++; }
+	};
+	
+	static const int64_t times[] = { 0, 1, 63, 64, 65, 4095, 4096, 100000, 3600000, 86400000, 86400000, 31536000000 };
+	static const size_t n_times = ARRAY_SIZE(times);
+	int fired[n_times+1] = {};
+	waiter_t waiters[n_times+1];
+	for (size_t i=0;i<n_times+1;i++)
+	{
+		waiters[i].fired = fired;
+		waiters[i].id = i;
+		tw.await(i < n_times ? at(times[i]) : timestamp::at_never()).then(&waiters[i].wait);
+	}
+	assert_eq(tw.size(), n_times+1);
+	
+	waiters[4].wait.cancel();
+	assert_eq(tw.size(), n_times);
+	
+	for (size_t i=0;i<n_times;i++)
+	{
+		if (i == 4 || (i > 0 && times[i-1] == times[i]))
+			continue;
+		testctx(tostring(times[i])) {
+			assert(tw.next() <= at(times[i]));
+			assert(!tw.run(at(times[i]) - duration{ 0, 500000 }));
+			assert_eq(fired[i], 0);
+			assert(tw.run(at(times[i])));
+			assert_eq(fired[i], 1);
+			for (size_t j=i+1;j<n_times+1;j++)
+			{
+				if (j != 4)
+					assert_eq(fired[j], (j < n_times && times[j] == times[i]));
+			}
+		}
+	}
+	assert_eq(fired[4], 0);
+	assert_eq(tw.size(), 1);
+	assert(tw.next() == timestamp::at_never());
+	
+	waiters[n_times].wait.cancel();
+	assert_eq(tw.size(), 0);
+	
+	// many timers in the same millisecond fire together, and cancelling one from another's completion works
+	timer_wheel tw2;
+	t0 = timestamp::now();
+	int n_fired = 0;
+	struct waiter2_t {
+		waiter<void> wait = make_waiter<&waiter2_t::wait, &waiter2_t::complete>();
+		int* n_fired;
+		waiter2_t* victim;
+		void complete() { (*n_fired)++; if (victim) victim->wait.cancel(); }
+	};
+	waiter2_t w2[100];
+	for (waiter2_t& w : w2)
+	{
+		w.n_fired = &n_fired;
+		w.victim = nullptr;
+		tw2.await(at(5000)).then(&w.wait);
+	}
+	w2[0].victim = &w2[1];
+	w2[1].victim = &w2[0];
+	assert(tw2.run(at(5000)));
+	assert_eq(n_fired, 99);
+	assert_eq(tw2.size(), 0);
+}
+
+
 
 static async<void> mut_test(co_mutex& mut, int& state, int a, int b, int c)
 {
@@ -548,6 +652,7 @@ test("runloop co_mutex", "", "")
 #ifdef __unix__
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/socket.h>
 #define HANDLE int
 static int mkevent() { return open("/bin/sh", O_RDONLY); } // Returns any fd that will immediately signal readability.
 static void rmevent(int fd) { close(fd); }
@@ -597,6 +702,111 @@ test("runloop dispatch", "", "")
 	rmevent(fd2);
 }
 
+#ifdef __unix__
+test("runloop fds", "", "")
+{
+	// reading and writing the same fd simultaneously, cancelling, and awaiting the same fd again
+	// (mostly exercises the epoll runloop's per-fd waiter lists; poll doesn't care much)
+	int fds[2];
+	assert_eq(socketpair(AF_UNIX, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0, fds), 0);
+	
+	struct waiters_t {
+		waiter<void> rd = make_waiter<&waiters_t::rd, &waiters_t::on_rd>();
+		waiter<void> wr = make_waiter<&waiters_t::wr, &waiters_t::on_wr>();
+		int n_rd = 0;
+		int n_wr = 0;
+		void on_rd() { n_rd++; }
+		void on_wr() { n_wr++; }
+	} w;
+	
+	runloop2::await_read(fds[0]).then(&w.rd);
+	runloop2::await_write(fds[0]).then(&w.wr);
+	while (w.wr.is_waiting())
+		runloop2::step();
+	assert_eq(w.n_rd, 0);
+	assert_eq(w.n_wr, 1);
+	
+	// cancel and await again, to ensure the stale registration doesn't confuse anything
+	w.rd.cancel();
+	runloop2::await_read(fds[0]).then(&w.rd);
+	runloop2::step(false);
+	assert_eq(w.n_rd, 0);
+	
+	assert_eq(send(fds[1], "x", 1, MSG_DONTWAIT), 1);
+	runloop2::await_write(fds[0]).then(&w.wr);
+	while (w.rd.is_waiting() || w.wr.is_waiting())
+		runloop2::step();
+	assert_eq(w.n_rd, 1);
+	assert_eq(w.n_wr, 2);
+	
+	// level triggered - it's still readable, so it should fire again
+	runloop2::await_read(fds[0]).then(&w.rd);
+	while (w.rd.is_waiting())
+		runloop2::step();
+	assert_eq(w.n_rd, 2);
+	
+	// and if it's drained, it should not fire
+	char c;
+	assert_eq(recv(fds[0], &c, 1, MSG_DONTWAIT), 1);
+	runloop2::await_read(fds[0]).then(&w.rd);
+	runloop2::step(false);
+	runloop2::step(false);
+	assert_eq(w.n_rd, 2);
+	w.rd.cancel();
+	
+	close(fds[0]);
+	close(fds[1]);
+}
+#endif
+
+#ifdef ARLIB_RUNLOOP_URING
+test("runloop ring_op", "", "")
+{
+	int fds[2];
+	assert_eq(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, fds), 0);
+	
+	struct waiters_t {
+		waiter<int> op = make_waiter<&waiters_t::op, &waiters_t::on_op>();
+		int res = 1234;
+		void on_op(int res) { this->res = res; }
+	} w;
+	
+	io_uring_sqe sqe = {};
+	sqe.opcode = IORING_OP_NOP;
+	runloop2::ring_op(sqe).then(&w.op);
+	while (w.op.is_waiting())
+		runloop2::step();
+	assert_eq(w.res, 0);
+	
+	char buf[4];
+	sqe = {};
+	sqe.opcode = IORING_OP_RECV;
+	sqe.fd = fds[0];
+	sqe.addr = (uintptr_t)buf;
+	sqe.len = sizeof(buf);
+	assert_eq(send(fds[1], "abc", 3, MSG_DONTWAIT), 3);
+	runloop2::ring_op(sqe).then(&w.op);
+	while (w.op.is_waiting())
+		runloop2::step();
+	assert_eq(w.res, 3);
+	assert_eq(cstring(bytesr((uint8_t*)buf, 3)), "abc");
+	
+	// a cancelled request calls the orphan handler, not the waiter
+	int orphan_res = 1234;
+	runloop2::ring_op(sqe, [p = &orphan_res](int res) { *p = res; }).then(&w.op);
+	runloop2::step(false);
+	w.op.cancel();
+	timestamp end = timestamp::in_ms(5000);
+	while (orphan_res == 1234 && timestamp::now() < end)
+		runloop2::step(false);
+	assert_eq(orphan_res, -ECANCELED);
+	assert_eq(w.res, 3);
+	
+	close(fds[0]);
+	close(fds[1]);
+}
+#endif
+
 co_test("runloop multi_waiter", "", "")
 {
 	{
@@ -634,3 +844,57 @@ co_test("runloop multi_waiter", "", "")
 		co_await multi_waiter(std::move(async1), std::move(async2));
 	}
 }
+
+#ifdef ARLIB_THREAD
+co_test("runloop run_on_pool", "", "")
+{
+	size_t main_thread = thread_get_id();
+	
+	size_t worker_thread = co_await runloop2::run_on_pool([]() { return thread_get_id(); });
+	assert(worker_thread != main_thread);
+	
+	int n = 0;
+	co_await runloop2::run_on_pool([&n]() { n = 42; });
+	assert_eq(n, 42);
+	
+	// bigger captures than function<> can hold
+	bytearray by;
+	by.resize(1000);
+	by[999] = 7;
+	// (not directly in the co_await; gcc destroys non-trivial temporaries in co_await expressions twice)
+	async<size_t> big = runloop2::run_on_pool([by = std::move(by)]() { return by.size() + by[999]; });
+	assert_eq(co_await std::move(big), 1007);
+	
+	// multiple simultaneous jobs, to make sure the mailbox is shared properly
+	async<int> a1 = runloop2::run_on_pool([]() { return 1; });
+	async<int> a2 = runloop2::run_on_pool([]() { return 2; });
+	async<int> a3 = runloop2::run_on_pool([]() { return 3; });
+	assert_eq(co_await std::move(a3), 3);
+	assert_eq(co_await std::move(a1), 1);
+	assert_eq(co_await std::move(a2), 2);
+	
+	// cancelling must discard the result on the owning thread, once the function is done
+	struct flagger {
+		int* p;
+		size_t owner;
+		flagger(int* p, size_t owner) : p(p), owner(owner) {}
+		flagger(flagger&& other) : p(other.p), owner(other.owner) { other.p = nullptr; }
+		~flagger() { if (p) { assert_eq(thread_get_id(), owner); (*p)++; } }
+	};
+	struct ctx_t {
+		semaphore sem;
+		int n_destroyed = 0;
+		size_t owner;
+	} ctx;
+	ctx.owner = main_thread;
+	
+	runloop2::run_on_pool([&ctx]() {
+		ctx.sem.wait();
+		return flagger(&ctx.n_destroyed, ctx.owner);
+	}).cancel();
+	ctx.sem.release();
+	while (!ctx.n_destroyed)
+		co_await runloop2::in_ms(1);
+	assert_eq(ctx.n_destroyed, 1);
+}
+#endif
@@ -0,0 +1,175 @@
+#include "runloop2.h"
+
+timer_wheel::timer_wheel()
+{
+	for (size_t& head : heads)
+		head = npos;
+	base = timestamp::now();
+}
+
+uint64_t timer_wheel::tick_of(timestamp ts)
+{
+	if (ts == timestamp::at_never())
+		return never;
+	duration dur = ts - base;
+	if (dur.sec < 0)
+		return 0;
+	if ((uint64_t)dur.sec >= ((uint64_t)1 << (lvl_bits*n_levels)) / 1000)
+		return never;
+	return dur.sec*1000 + dur.nsec/1000000;
+}
+
+void timer_wheel::link(size_t idx, uint16_t list)
+{
+	node& n = nodes.begin()[idx];
+	n.list = list;
+	n.next = npos;
+	n.prev = npos;
+	if (heads[list] == npos)
+		heads[list] = idx;
+	else
+	{
+		n.prev = tails[list];
+		nodes.begin()[n.prev].next = idx;
+	}
+	tails[list] = idx;
+	if (list < list_due)
+		occupied[list/lvl_size] |= (uint64_t)1 << (list%lvl_size);
+}
+
+void timer_wheel::unlink(size_t idx)
+{
+	node& n = nodes.begin()[idx];
+	if (n.prev != npos)
+		nodes.begin()[n.prev].next = n.next;
+	else
+		heads[n.list] = n.next;
+	if (n.next != npos)
+		nodes.begin()[n.next].prev = n.prev;
+	else
+		tails[n.list] = n.prev;
+	if (heads[n.list] == npos && n.list < list_due)
+		occupied[n.list/lvl_size] &= ~((uint64_t)1 << (n.list%lvl_size));
+}
+
+void timer_wheel::insert(size_t idx)
+{
+	node& n = nodes.begin()[idx];
+	if (n.tick == never)
+		return link(idx, list_never);
+	if (n.tick < cur)
+		n.tick = cur;
+	// the highest bit that differs from the current time decides the level
+	uint64_t diff = n.tick ^ cur;
+	int level = (diff ? ilog2(diff) / lvl_bits : 0);
+	size_t slot = (n.tick >> (level*lvl_bits)) % lvl_size;
+	link(idx, level*lvl_size + slot);
+}
+
+// Returns the first tick where something may happen. For level 0, that's exact; for higher levels, it's where that slot starts.
+uint64_t timer_wheel::next_tick()
+{
+	for (int level=0;level<n_levels;level++)
+	{
+		if (!occupied[level])
+			continue;
+		// only slots after the current one can be occupied (or, for level 0, current or after)
+		int shift = level*lvl_bits;
+		uint64_t block = cur >> (shift+lvl_bits) << (shift+lvl_bits);
+		return block | (uint64_t)__builtin_ctzll(occupied[level]) << shift;
+	}
+	return never;
+}
+
+void timer_wheel::cancel(node* n)
+{
+	unlink(n - nodes.begin());
+	nodes.dealloc(n);
+	n_pending--;
+}
+
+async<void> timer_wheel::await(timestamp timeout)
+{
+	node* n = nodes.alloc();
+	n->parent = this;
+	n->timeout = timeout;
+	n->tick = tick_of(timeout);
+	insert(n - nodes.begin());
+	n_pending++;
+	return &n->prod;
+}
+
+timestamp timer_wheel::next()
+{
+	uint64_t tick = next_tick();
+	if (tick == never)
+		return timestamp::at_never();
+	if (tick == cur)
+	{
+		// the current tick is partially processed, and waiting for its start would be a busy loop; find the exact time
+		timestamp ret = timestamp::at_never();
+		for (size_t idx = heads[cur % lvl_size]; idx != npos; idx = nodes.begin()[idx].next)
+			ret = min(ret, nodes.begin()[idx].timeout);
+		return ret;
+	}
+	return base + duration{ (time_t)(tick/1000), (long)(tick%1000*1000000) };
+}
+
+bool timer_wheel::run(timestamp now)
+{
+	uint64_t target = tick_of(now);
+	if (target == never || target < cur) // if the clock went backwards, just wait for it to catch up
+		return false;
+	
+	while (true)
+	{
+		uint64_t tick = next_tick();
+		if (tick > target)
+		{
+			cur = target;
+			break;
+		}
+		cur = tick;
+		
+		for (int level=n_levels-1;level>0;level--)
+		{
+			size_t list = level*lvl_size + (cur >> (level*lvl_bits)) % lvl_size;
+			if (heads[list] == npos)
+				continue;
+			// everything here expires in the current block, so it goes to a lower level
+			size_t idx = heads[list];
+			heads[list] = npos;
+			occupied[level] &= ~((uint64_t)1 << (list%lvl_size));
+			while (idx != npos)
+			{
+				size_t next = nodes.begin()[idx].next;
+				insert(idx);
+				idx = next;
+			}
+		}
+		
+		size_t idx = heads[cur % lvl_size];
+		while (idx != npos)
+		{
+			size_t next = nodes.begin()[idx].next;
+			if (cur < target || nodes.begin()[idx].timeout <= now)
+			{
+				unlink(idx);
+				link(idx, list_due);
+			}
+			idx = next;
+		}
+		if (cur == target)
+			break;
+	}
+	
+	// completions can arm or cancel timers; anything armed now goes to the wheel, not the due list
+	bool ret = (heads[list_due] != npos);
+	while (heads[list_due] != npos)
+	{
+		node* n = &nodes.begin()[heads[list_due]];
+		cancel(n);
+		n->prod.complete();
+	}
+	return ret;
+}
@@ -0,0 +1,536 @@
+#if defined(__linux__) && defined(ARLIB_RUNLOOP_URING)
+#include "runloop2.h"
+#include "array.h"
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#ifdef ARLIB_SOCKET
+#include "socket.h"
+#endif
+
+#ifdef ARLIB_GUI
+#error the io_uring runloop does not support GUI events, use the poll runloop instead
+#endif
+
+// Same contract as runloop-poll.cpp, but fd waits are IORING_OP_POLL_ADD requests on an io_uring.
+// await_fd() and cancellation only write to an in-memory queue; everything queued during a step is copied to the
+//  submission ring and handed to the kernel in the same io_uring_enter that waits for events,
+//  so a step costs one syscall no matter how many fds were armed, and zero if nothing was armed and nothing is waited for.
+// Completions are read straight from the shared completion ring, no syscall per event.
+// Other requests can be issued with ring_op(); socket2 and socketlisten use that for recv, send and accept, so a ready
+//  socket costs no syscall of its own either.
+// Needs Linux 5.11 or newer (IORING_FEAT_EXT_ARG).
+
+namespace {
+
+class runloop2_uring;
+runloop2_uring& get_loop();
+
+class ring_t {
+	int fd;
+	
+	void* sq_map;
+	size_t sq_map_size;
+	void* cq_map;
+	size_t cq_map_size;
+	io_uring_sqe* sqes;
+	
+	uint32_t* sq_head;
+	uint32_t* sq_tail;
+	uint32_t* sq_flags;
+	uint32_t* sq_array;
+	uint32_t sq_mask;
+	uint32_t sq_entries;
+	
+	uint32_t* cq_head;
+	uint32_t* cq_tail;
+	uint32_t cq_mask;
+	io_uring_cqe* cqes;
+	
+	uint32_t sq_local_tail; // not yet visible to the kernel
+	uint32_t to_submit = 0;
+	
+	int enter(uint32_t submit, uint32_t min_complete, uint32_t flags, void* arg, size_t argsz)
+	{
+		return syscall(__NR_io_uring_enter, fd, submit, min_complete, flags, arg, argsz);
+	}
+	
+	void publish()
+	{
+		__atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+	}
+
+public:
+	ring_t(uint32_t entries)
+	{
+		io_uring_params p = {};
+		fd = syscall(__NR_io_uring_setup, entries, &p);
+		if (fd < 0)
+			abort();
+		if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP))
+			abort();
+		
+		sq_map_size = p.sq_off.array + p.sq_entries*sizeof(uint32_t);
+		cq_map_size = p.cq_off.cqes + p.cq_entries*sizeof(io_uring_cqe);
+		if (p.features & IORING_FEAT_SINGLE_MMAP)
+			sq_map_size = cq_map_size = max(sq_map_size, cq_map_size);
+		
+		sq_map = mmap(nullptr, sq_map_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		if (p.features & IORING_FEAT_SINGLE_MMAP)
+			cq_map = sq_map;
+		else
+			cq_map = mmap(nullptr, cq_map_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		sqes = (io_uring_sqe*)mmap(nullptr, p.sq_entries*sizeof(io_uring_sqe), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+		                           fd, IORING_OFF_SQES);
+		if (sq_map == MAP_FAILED || cq_map == MAP_FAILED || sqes == MAP_FAILED)
+			abort();
+		
+		uint8_t* sq = (uint8_t*)sq_map;
+		sq_head = (uint32_t*)(sq + p.sq_off.head);
+		sq_tail = (uint32_t*)(sq + p.sq_off.tail);
+		sq_flags = (uint32_t*)(sq + p.sq_off.flags);
+		sq_array = (uint32_t*)(sq + p.sq_off.array);
+		sq_mask = *(uint32_t*)(sq + p.sq_off.ring_mask);
+		sq_entries = p.sq_entries;
+		sq_local_tail = *sq_tail;
+		
+		uint8_t* cq = (uint8_t*)cq_map;
+		cq_head = (uint32_t*)(cq + p.cq_off.head);
+		cq_tail = (uint32_t*)(cq + p.cq_off.tail);
+		cq_mask = *(uint32_t*)(cq + p.cq_off.ring_mask);
+		cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+	}
+	~ring_t()
+	{
+		munmap(sqes, sq_entries*sizeof(io_uring_sqe));
+		if (cq_map != sq_map)
+			munmap(cq_map, cq_map_size);
+		munmap(sq_map, sq_map_size);
+		close(fd);
+	}
+	
+	// The returned entry is zeroed. It's submitted on the next submit() or wait().
+	io_uring_sqe* get_sqe()
+	{
+		if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == sq_entries)
+			submit(); // ring is full, push it to the kernel early
+		
+		uint32_t idx = sq_local_tail & sq_mask;
+		sq_array[idx] = idx;
+		sq_local_tail++;
+		to_submit++;
+		memset(&sqes[idx], 0, sizeof(io_uring_sqe));
+		return &sqes[idx];
+	}
+	
+	void submit()
+	{
+		publish();
+		while (to_submit)
+		{
+			int n = enter(to_submit, 0, 0, nullptr, 0);
+			if (n < 0)
+			{
+				if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+					continue;
+				abort();
+			}
+			to_submit -= n;
+		}
+	}
+	
+	// Submits everything queued, then waits until at least one completion is available or the timeout expires.
+	// Null timeout means wait forever.
+	void wait(__kernel_timespec* timeout)
+	{
+		publish();
+		io_uring_getevents_arg arg = { .sigmask = 0, .sigmask_sz = _NSIG/8, .pad = 0, .ts = (uint64_t)(uintptr_t)timeout };
+		int n = enter(to_submit, 1, IORING_ENTER_GETEVENTS|IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+		if (n > 0)
+			to_submit -= n;
+		// else ETIME or EINTR, or EBUSY if the completion ring is full (in which case there's something to do anyways)
+		// if anything wasn't submitted, the next step will submit it
+	}
+	
+	bool has_cqe()
+	{
+		return *cq_head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+	}
+	
+	// Returns false if the completion ring is empty. Must not be called again until the returned entry is consumed.
+	bool peek_cqe(io_uring_cqe& out)
+	{
+		uint32_t head = *cq_head;
+		if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+		{
+			// if the completion ring overflowed, the kernel holds the rest until asked for them
+			if (!(__atomic_load_n(sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW))
+				return false;
+			enter(0, 0, IORING_ENTER_GETEVENTS, nullptr, 0);
+			if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+				return false;
+		}
+		out = cqes[head & cq_mask];
+		__atomic_store_n(cq_head, head+1, __ATOMIC_RELEASE);
+		return true;
+	}
+};
+
+class runloop2_uring {
+public:
+#ifdef ARLIB_TESTRUNNER
+	timestamp last_iter;
+	bool test_has_runloop = false;
+	bool test_is_main = false; // loops on other threads aren't part of the test, and mustn't report latency
+#endif
+	
+	ring_t ring { 256 };
+	
+	static const uint64_t ud_ignore = (uint64_t)-1; // completions of POLL_REMOVE and ASYNC_CANCEL requests
+	static const uint64_t ud_op = (uint64_t)1 << 62; // set for ring_op() requests, clear for fd waits
+	
+	class fds_t {
+		
+		struct waiter_node {
+			producer<void> prod = make_producer<&waiter_node::prod, &waiter_node::cancel>();
+			void cancel() { get_loop().fds.cancel(this); }
+			size_t next; // freelist
+			int fd;
+			bool want_write;
+			bool submitted;
+			// Incremented every time the node is deallocated, so completions of cancelled requests can be discarded.
+			// Survives the node going through the freelist, since only next is overwritten.
+			uint32_t gen = 0;
+			
+			uint64_t user_data(size_t idx) { return idx | (uint64_t)gen<<32; }
+		};
+	public:
+		allocatable_array<waiter_node, [](waiter_node* n) { return &n->next; }, [](waiter_node* n) { n->prod.moved(); }> nodes;
+	private:
+		array<uint64_t> pending_add; // user_data of nodes not yet in the submission ring
+		array<uint64_t> pending_remove; // user_data of requests to cancel
+		
+		waiter_node* find(uint64_t user_data)
+		{
+			size_t idx = (uint32_t)user_data;
+			if (idx >= nodes.size())
+				return nullptr;
+			waiter_node* n = &nodes.begin()[idx];
+			if (n->gen != (uint32_t)(user_data >> 32))
+				return nullptr;
+			return n;
+		}
+		
+		void dealloc(waiter_node* n)
+		{
+			n->gen++;
+			nodes.dealloc(n);
+		}
+		
+		void cancel(waiter_node* n)
+		{
+			if (n->submitted)
+				pending_remove.append(n->user_data(n - nodes.begin()));
+			// else it's in pending_add, and the gen bump will make flush() skip it
+			dealloc(n);
+		}
+	
+	public:
+		async<void> await_fd(int fd, bool want_write)
+		{
+			waiter_node* n = nodes.alloc();
+			n->fd = fd;
+			n->want_write = want_write;
+			n->submitted = false;
+			pending_add.append(n->user_data(n - nodes.begin()));
+			return &n->prod;
+		}
+		
+		// Moves everything queued to the submission ring.
+		void flush(ring_t& ring)
+		{
+			for (uint64_t ud : pending_remove)
+			{
+				io_uring_sqe* sqe = ring.get_sqe();
+				sqe->opcode = IORING_OP_POLL_REMOVE;
+				sqe->fd = -1;
+				sqe->addr = ud;
+				sqe->user_data = ud_ignore;
+			}
+			pending_remove.reset();
+			
+			for (uint64_t ud : pending_add)
+			{
+				waiter_node* n = find(ud);
+				if (!n)
+					continue;
+				io_uring_sqe* sqe = ring.get_sqe();
+				sqe->opcode = IORING_OP_POLL_ADD;
+				sqe->fd = n->fd;
+				// kernel always returns HUP and ERR, whether requested or not
+				sqe->poll32_events = (n->want_write ? POLLOUT : POLLIN);
+				sqe->user_data = ud;
+				n->submitted = true;
+			}
+			pending_add.reset();
+		}
+		
+		// Returns whether anything happened.
+		bool dispatch(const io_uring_cqe& cqe)
+		{
+			if (cqe.user_data == ud_ignore)
+				return false;
+			waiter_node* n = find(cqe.user_data);
+			if (!n)
+				return false; // cancelled while the request was in flight
+			// if res is negative, the fd is closed or otherwise unpollable; nothing will change if we retry, so just wake it
+			dealloc(n);
+			n->prod.complete();
+			return true;
+		}
+	};
+	fds_t fds;
+	
+	class ops_t {
+		struct op_node {
+			producer<int> prod = make_producer<&op_node::prod, &op_node::cancel>();
+			void cancel() { get_loop().ops.cancel(this); }
+			size_t next; // freelist
+			// Unlike fd waits, the node isn't deallocated until the kernel is done with the request, so no generation counter.
+			bool orphaned;
+			function<void(int)> orphan;
+		};
+	public:
+		allocatable_array<op_node, [](op_node* n) { return &n->next; }, [](op_node* n) { n->prod.moved(); }> nodes;
+	private:
+		void cancel(op_node* n)
+		{
+			n->orphaned = true;
+			io_uring_sqe* sqe = get_loop().ring.get_sqe();
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->fd = -1;
+			sqe->addr = ud_op | (n - nodes.begin());
+			sqe->user_data = ud_ignore;
+		}
+		
+	public:
+		// Unlike fd waits, these go straight to the submission ring; they're only ever cancelled after they're submitted.
+		async<int> submit(ring_t& ring, const io_uring_sqe& sqe, function<void(int)> orphan)
+		{
+			op_node* n = nodes.alloc();
+			n->orphaned = false;
+			n->orphan = orphan;
+			io_uring_sqe* out = ring.get_sqe();
+			*out = sqe;
+			out->user_data = ud_op | (n - nodes.begin());
+			return &n->prod;
+		}
+		
+		// Returns whether anything happened.
+		bool dispatch(const io_uring_cqe& cqe)
+		{
+			op_node* n = &nodes.begin()[(uint32_t)cqe.user_data];
+			nodes.dealloc(n);
+			if (n->orphaned)
+			{
+				function<void(int)> orphan = n->orphan; // it may issue new requests, which can reuse the node
+				if (orphan)
+					orphan(cqe.res);
+				return false;
+			}
+			n->prod.complete(cqe.res);
+			return true;
+		}
+	};
+	ops_t ops;
+	
+	
+	timer_wheel timeouts;
+	
+	
+	bool step(bool wait)
+	{
+		bool ret = false;
+		
+		timestamp timeout = timeouts.next();
+		
+		fds.flush(ring);
+		
+		test_rethrow();
+#ifdef ARLIB_TESTRUNNER
+		test_has_runloop = true;
+		test_iter_end();
+#endif
+		if (wait && !ring.has_cqe())
+		{
+			__kernel_timespec ts = {};
+			__kernel_timespec* tsp = nullptr;
+			if (timeout != timestamp::at_never())
+			{
+				duration dur = timeout - timestamp::now();
+				if (dur.sec >= 0)
+				{
+					ts.tv_sec = dur.sec;
+					ts.tv_nsec = dur.nsec;
+				}
+				tsp = &ts;
+			}
+			ring.wait(tsp);
+		}
+		else
+		{
+			ring.submit();
+		}
+#ifdef ARLIB_TESTRUNNER
+		test_iter_begin();
+#endif
+		
+		// don't loop until the ring is empty; completions can queue new requests, which can complete immediately,
+		//  and a step must not run forever
+		io_uring_cqe cqe;
+		size_t max_events = 256;
+		while (max_events-- && ring.peek_cqe(cqe))
+		{
+			if (cqe.user_data != ud_ignore && (cqe.user_data & ud_op))
+				ret |= ops.dispatch(cqe);
+			else
+				ret |= fds.dispatch(cqe);
+		}
+		
+		ret |= timeouts.run(timestamp::now());
+		test_rethrow();
+		
+		return ret;
+	}
+	
+	async<void> await_fd(int fd, bool want_write)
+	{
+		return fds.await_fd(fd, want_write);
+	}
+	
+	async<void> await_timeout(timestamp timeout)
+	{
+		return timeouts.await(timeout);
+	}
+	
+	async<int> ring_op(const io_uring_sqe& sqe, function<void(int)> orphan)
+	{
+		return ops.submit(ring, sqe, orphan);
+	}
+	
+#ifdef ARLIB_SOCKET
+	void* dns = nullptr;
+	runloop2_uring()
+	{
+#ifndef ARLIB_THREAD
+		dns = socket2::dns_create();
+#endif
+	}
+	~runloop2_uring()
+	{
+#if defined(ARLIB_THREAD) || defined(ARLIB_TESTRUNNER)
+		if (dns)
+#endif
+			socket2::dns_destroy(dns);
+	}
+	void* get_dns()
+	{
+#if defined(ARLIB_THREAD) || defined(ARLIB_TESTRUNNER)
+		if (!dns)
+			dns = socket2::dns_create();
+#endif
+		return dns;
+	}
+#endif
+	
+#ifdef ARLIB_TESTRUNNER
+	void test_iter_begin()
+	{
+		last_iter = timestamp::now();
+	}
+	void test_iter_end()
+	{
+		if (test_is_main && test_has_runloop)
+			_test_runloop_latency(timestamp::now() - last_iter);
+	}
+	
+	size_t n_global_waits;
+	
+	size_t n_fd_waits()
+	{
+		size_t ret = 0;
+		for (auto& node : fds.nodes)
+		{
+			if (node.prod.has_waiter())
+				ret++;
+		}
+		return ret;
+	}
+	
+	void test_begin()
+	{
+		test_is_main = true;
+		test_has_runloop = false;
+		test_iter_begin();
+		n_global_waits = n_fd_waits();
+	}
+	void test_end()
+	{
+		test_iter_end();
+#ifdef ARLIB_SOCKET
+		if (dns)
+		{
+			socket2::dns_destroy(dns);
+			dns = nullptr;
+		}
+#endif
+		assert_eq(n_global_waits, n_fd_waits());
+		assert_eq(timeouts.size(), 0);
+	}
+#endif
+};
+
+#ifdef ARLIB_THREAD
+static thread_local runloop2_uring* g_loop;
+runloop2_uring& get_loop()
+{
+	runloop2_uring*& loop = g_loop;
+	if (!loop)
+		loop = new runloop2_uring();
+	return *loop;
+}
+#else
+__attribute__((init_priority(101))) // objects without a constructor priority are constructed after ones with
+static runloop2_uring g_loop;
+runloop2_uring& get_loop() { return g_loop; }
+#endif
+
+}
+
+namespace runloop2 {
+	bool step(bool wait) { return get_loop().step(wait); }
+	void run(async<void> event)
+	{
+		waiter<void> wait;
+		event.then(&wait);
+		auto& loop = get_loop();
+		while (wait.is_waiting())
+			loop.step(true);
+	}
+	async<void> await_fd(int fd, bool want_write) { return get_loop().await_fd(fd, want_write); }
+	async<void> await_timeout(timestamp timeout) { return get_loop().await_timeout(timeout); }
+	async<int> ring_op(const io_uring_sqe& sqe, function<void(int)> orphan) { return get_loop().ring_op(sqe, std::move(orphan)); }
+	async<void> in_ms(int ms) { return get_loop().await_timeout(timestamp::in_ms(ms)); }
+#ifdef ARLIB_SOCKET
+	void* get_dns() { return get_loop().get_dns(); }
+#endif
+#ifdef ARLIB_TESTRUNNER
+	void test_begin() { get_loop().test_begin(); }
+	void test_end() { get_loop().test_end(); }
+#endif
+}
+#endif
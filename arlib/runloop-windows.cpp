@@ -27,7 +27,8 @@ public:
 	
 #ifdef ARLIB_TESTRUNNER
 	timestamp last_iter;
-	bool test_has_runloop;
+	bool test_has_runloop = false;
+	bool test_is_main = false; // loops on other threads aren't part of the test, and mustn't report latency
 #endif
 	
 	struct handle_node {
@@ -53,38 +54,12 @@ public:
 		handles.dealloc(n);
 	}
 	
-	struct timer_node {
-		producer<void> prod = make_producer<&timer_node::prod, &timer_node::cancel>();
-		void cancel() { get_loop().timer_cancel(this); }
-		timestamp timeout;
-	};
-	allocatable_array<timer_node, [](timer_node* n) { return &n->timeout.sec; }, [](timer_node* n) { n->prod.moved(); }> timers;
-	
-	async<void> timer_set(timestamp timeout)
-	{
-		timer_node& n = *timers.alloc();
-		n.timeout = timeout;
-		return &n.prod;
-	}
-	void timer_activate(timer_node* n)
-	{
-		timers.dealloc(n);
-		n->prod.complete();
-	}
-	void timer_cancel(timer_node* n)
-	{
-		timers.dealloc(n);
-	}
+	timer_wheel timers;
 	
 	
 	bool step(bool wait)
 	{
-		timestamp timeout = timestamp::at_never();
-		for (auto& node : timers)
-		{
-			if (node.prod.has_waiter() && node.timeout <= timeout)
-				timeout = node.timeout;
-		}
+		timestamp timeout = timers.next();
 		
 		HANDLE hs[MAXIMUM_WAIT_OBJECTS];
 		handle_node* nodes[MAXIMUM_WAIT_OBJECTS];
@@ -136,11 +111,7 @@ public:
 		
 		now = timestamp::now();
 		
-		for (auto& node : timers)
-		{
-			if (node.prod.has_waiter() && node.timeout <= now)
-				timer_activate(&node);
-		}
+		timers.run(now);
 		
 		return false;
 	}
@@ -176,11 +147,12 @@ public:
 	}
 	void test_iter_end()
 	{
-		if (test_has_runloop)
+		if (test_is_main && test_has_runloop)
 			_test_runloop_latency(timestamp::now() - last_iter);
 	}
 	void test_begin()
 	{
+		test_is_main = true;
 		test_has_runloop = false;
 		test_iter_begin();
 	}
@@ -196,8 +168,7 @@ public:
 #endif
 		for (auto& node : handles)
 			assert(!node.prod.has_waiter());
-		for (auto& node : timers)
-			assert(!node.prod.has_waiter());
+		assert_eq(timers.size(), 0);
 	}
 #endif
 };
@@ -243,8 +214,8 @@ namespace runloop2 {
 			loop.step(true);
 	}
 	async<void> await_handle(HANDLE h) { return get_loop().handle_set(h); }
-	async<void> await_timeout(timestamp timeout) { return get_loop().timer_set(timeout); }
-	async<void> in_ms(int ms) { return get_loop().timer_set(timestamp::in_ms(ms)); }
+	async<void> await_timeout(timestamp timeout) { return get_loop().timers.await(timeout); }
+	async<void> in_ms(int ms) { return get_loop().timers.await(timestamp::in_ms(ms)); }
 #ifdef ARLIB_SOCKET
 	void* get_dns() { return get_loop().get_dns(); }
 #endif
@@ -6,6 +6,9 @@
 #ifdef _WIN32
 typedef void* HANDLE;
 #endif
+#ifdef ARLIB_RUNLOOP_URING
+#include <linux/io_uring.h>
+#endif
 #ifndef ARLIB_OPT
 #include "os.h"
 #endif
@@ -124,6 +127,14 @@ namespace runloop2 {
 	async<void> await_read(int fd) { return await_fd(fd, false); }
 	async<void> await_write(int fd) { return await_fd(fd, true); }
 #endif
+#ifdef ARLIB_RUNLOOP_URING
+	// Issues an io_uring request, for example IORING_OP_RECV; the result is the completion's res field, which is negative
+	//  errno on failure. Like fd waits, it's submitted in the same syscall that waits for events. user_data is overwritten.
+	// If the returned async is cancelled, so is the request, but the kernel may already be in the middle of it, so anything
+	//  it points to must remain valid until it's done. Once it is, orphan (if any) is called with the result;
+	//  use it to free the buffer, close the accepted fd, or similar.
+	async<int> ring_op(const io_uring_sqe& sqe, function<void(int)> orphan = nullptr);
+#endif
 #ifdef _WIN32
 	// Limited to MAXIMUM_WAIT_OBJECTS (64) because lol windows.
 	// OVERLAPPED and completion routines is often better,
@@ -171,10 +182,24 @@ public:
 	T* end();
 }
 
+// A timer wheel holds a bunch of timeouts. It's the timeout half of a runloop backend; everything else should use runloop2::await_timeout.
+// Arming, cancelling and firing a timer is O(1), regardless of how many are pending.
+// Timers are bucketed per millisecond, and everything due in the same step fires as one batch, in the order they were armed.
+// Like allocatable_array, the object does not allocate memory, other than resizing its internal array.
+class timer_wheel {
+public:
+	async<void> await(timestamp timeout);
+	// When the earliest timer may fire. May be too early (in which case run() does nothing), but never too late.
+	timestamp next();
+	// Fires every timer that expired at or before now. Returns whether anything fired.
+	bool run(timestamp now);
+	size_t size(); // Number of pending timers.
+}
+
 // A co_mutex is a mutex for coroutines; only one coroutine at the time may enter this region.
 // This object is designed for coroutines only; normal functions cannot call it.
 // Unlike a normal mutex, waiters are ordered.
-// The object is not thread safe. Arlib does not, at this point, support any kind of interaction between coroutines and threads.
+// The object is not thread safe. To interact with other threads, use runloop_mailbox or run_on_pool, below.
 // Releasing the mutex will execute the successor when the current coro finishes, not run it immediately; code like
 // async<void> my_coro() { { auto lock = co_await mut1; co_await something(); } { auto lock = co_await mut2; co_await something2(); } }
 // will not allow any coroutine to overtake another, even if some of the something()s are synchronous.
@@ -582,8 +607,72 @@ public:
 	}
 };
 
+// Coroutine frames are usually short lived, and a few sizes are far more common than others. Rather than malloc,
+//  async<T> frames come from per-thread size-class freelists, and go back there when the coroutine finishes.
+// A frame may be freed on another thread than it was allocated on; it just ends up in that thread's freelist.
+class coro_frame_alloc {
+	static const size_t granularity = 64;
+	static const size_t n_classes = 16; // anything bigger than 1KB goes straight to malloc
+	static const uint32_t max_cached = 64; // per class
+	
+	struct freelist_t {
+		void* head[n_classes];
+		uint32_t count[n_classes];
+		bool registered; // whether the thread exit handler is registered
+#ifndef ARLIB_OPT
+		size_t n_alloc;
+		size_t n_malloc;
+#endif
+	};
+	static thread_local freelist_t freelist;
+	
+	struct thread_cleanup { ~thread_cleanup(); };
+	static void register_cleanup();
+	static void* alloc_slow(size_t size);
+	
+public:
+	static void* operator new(size_t size)
+	{
+#ifndef ARLIB_OPT
+		freelist.n_alloc++;
+#endif
+		size_t cls = (size-1) / granularity;
+		if (cls < n_classes && freelist.head[cls])
+		{
+			void* ret = freelist.head[cls];
+			freelist.head[cls] = *(void**)ret;
+			freelist.count[cls]--;
+			return ret;
+		}
+		return alloc_slow(size);
+	}
+	static void operator delete(void* ptr, size_t size)
+	{
+		size_t cls = (size-1) / granularity;
+		if (cls < n_classes && freelist.count[cls] < max_cached)
+		{
+			// a thread may free frames without ever allocating any, so this needs checking here too
+			if (UNLIKELY(!freelist.registered))
+				register_cleanup();
+			*(void**)ptr = freelist.head[cls];
+			freelist.head[cls] = ptr;
+			freelist.count[cls]++;
+			return;
+		}
+		free(ptr);
+	}
+	
+	struct stats_t {
+		size_t n_alloc; // Total number of frames allocated.
+		size_t n_malloc; // Number of those that weren't in a freelist. Includes oversized frames.
+		size_t n_cached; // Number of frames currently in the freelists.
+	};
+	// Returns statistics for the calling thread. Only n_cached is available under ARLIB_OPT, the rest are zero.
+	static stats_t stats();
+};
+
 template<typename T>
-class producer_coro : public producer<T> {
+class producer_coro : public producer<T>, public coro_frame_alloc {
 	static void cancel_s(producer<T>* self_)
 	{
 		producer_coro* self = (producer_coro*)self_;
@@ -614,7 +703,7 @@ public:
 };
 
 template<> // can't declare return_void and return_value in the same promise for some complicated reason
-class producer_coro<void> : public producer<void> {
+class producer_coro<void> : public producer<void>, public coro_frame_alloc {
 	static void cancel_s(producer<void>* self_)
 	{
 		producer_coro* self = (producer_coro*)self_;
@@ -736,6 +825,9 @@ namespace runloop2 {
 	inline async<void> await_read(int fd) { return await_fd(fd, false); }
 	inline async<void> await_write(int fd) { return await_fd(fd, true); }
 #endif
+#ifdef ARLIB_RUNLOOP_URING
+	async<int> ring_op(const io_uring_sqe& sqe, function<void(int)> orphan = nullptr);
+#endif
 #ifdef _WIN32
 	async<void> await_handle(HANDLE h);
 #endif
@@ -798,6 +890,61 @@ public:
 	T* end() { return inner.end(); }
 };
 
+class timer_wheel {
+	// A hierarchical wheel, much like the Linux kernel's. Time is measured in ticks (milliseconds) since the object was created.
+	// Level 0 holds timers expiring in the current 64-tick block, one slot per tick.
+	// Level N holds timers in the current 64^(N+1)-tick block, but not in the current 64^N-tick block; one slot per 64^N-tick block.
+	// When a higher-level slot is reached, its timers are redistributed to lower levels.
+	// Timers in past ticks fire unconditionally; timers in the current tick fire if their exact timestamp has passed.
+	static const int lvl_bits = 6;
+	static const int lvl_size = 1<<lvl_bits;
+	static const int n_levels = 8; // 2^48 ms is almost 9000 years, anything past that is treated as never
+	static const uint64_t never = (uint64_t)-1;
+	static const size_t npos = (size_t)-1;
+	
+	static const uint16_t list_due = n_levels*lvl_size;
+	static const uint16_t list_never = list_due+1;
+	
+	struct node {
+		producer<void> prod = make_producer<&node::prod, &node::cancel>();
+		void cancel() { parent->cancel(this); }
+		timer_wheel* parent;
+		timestamp timeout;
+		uint64_t tick;
+		size_t next; // also used as freelist
+		size_t prev;
+		uint16_t list;
+		
+		static size_t* get_freelist(node* n) { return &n->next; }
+		static void on_move(node* n) { n->prod.moved(); }
+	};
+	allocatable_array<node, &node::get_freelist, &node::on_move> nodes;
+	
+	// the lists are FIFO, so timers in the same tick fire in the order they were armed
+	size_t heads[n_levels*lvl_size + 2];
+	size_t tails[n_levels*lvl_size + 2];
+	uint64_t occupied[n_levels] = {};
+	timestamp base;
+	uint64_t cur = 0;
+	size_t n_pending = 0;
+	
+	uint64_t tick_of(timestamp ts);
+	void link(size_t idx, uint16_t list);
+	void unlink(size_t idx);
+	void insert(size_t idx);
+	uint64_t next_tick();
+	void cancel(node* n);
+	
+public:
+	timer_wheel();
+	timer_wheel(const timer_wheel&) = delete;
+	
+	async<void> await(timestamp timeout);
+	timestamp next();
+	bool run(timestamp now);
+	size_t size() { return n_pending; }
+};
+
 // A co_mutex stops multiple coroutines from running in the same critical section.
 // They will continue in the same order they stop, so you can send three HTTP requests to the same socket,
 //  enter a co_mutex, and read the responses.
@@ -995,3 +1142,103 @@ multi_waiter_t<R1, R2> multi_waiter(async<R1> a1, async<R2> a2)
 {
 	return { std::move(a1), std::move(a2) };
 }
+
+#ifdef ARLIB_THREAD
+#include "array.h"
+#include "thread.h"
+
+// A runloop_mailbox allows other threads to call functions on this thread's runloop.
+// It must be created and destroyed on the thread owning the runloop; post() can be called from any thread, as long as the object exists.
+// Posted functions are called in order, from the runloop. The wakeup is an eventfd (a pipe on other unixes, an event on Windows),
+//  and it's only signalled if it isn't already, so a burst of posts costs one syscall on each side.
+class runloop_mailbox : nomove {
+	mutex lock;
+	array<function<void()>> queue;
+	bool signalled = false;
+#ifdef __unix__
+	int fd_rd;
+	int fd_wr; // same as fd_rd on Linux
+#endif
+#ifdef _WIN32
+	HANDLE event;
+#endif
+	size_t n_users = 0;
+	
+	waiter<void> wake_wait = make_waiter<&runloop_mailbox::wake_wait, &runloop_mailbox::on_wake>();
+	void arm();
+	void on_wake();
+	
+public:
+	runloop_mailbox();
+	~runloop_mailbox();
+	
+	// Thread safe. The function will be called on the runloop of the thread owning this mailbox.
+	void post(function<void()> fn);
+	
+	// Returns a mailbox for the calling thread, shared with everyone else who wants one. Call release() when done with it.
+	// The mailbox is destroyed once everyone has released it.
+	static runloop_mailbox* acquire();
+	void release();
+};
+
+namespace runloop2 {
+	template<typename T, typename Tl>
+	class pool_job {
+		producer<T> prod = make_producer<&pool_job::prod, &pool_job::cancel>();
+		Tl fn; // not function<>, so it can capture anything
+		runloop_mailbox* box;
+		variant_raw<empty_if_void<T>> result;
+		bool cancelled = false;
+		
+		void cancel() { cancelled = true; }
+		
+		void run()
+		{
+			if constexpr (std::is_same_v<T, void>)
+				fn();
+			else
+				result.template construct<T>(fn());
+			box->post(bind_this(&pool_job::finish));
+		}
+		
+		void finish()
+		{
+			runloop_mailbox* box = this->box;
+			if constexpr (std::is_same_v<T, void>)
+			{
+				if (!cancelled)
+					prod.complete();
+			}
+			else
+			{
+				if (!cancelled)
+					prod.complete(result.template get_destruct<T>());
+				else
+					result.template destruct<T>();
+			}
+			delete this;
+			box->release();
+		}
+		
+		pool_job(Tl fn) : fn(std::move(fn)), box(runloop_mailbox::acquire()) {}
+	public:
+		static async<T> start(Tl fn)
+		{
+			pool_job* job = new pool_job(std::move(fn));
+			thread_pool_run(bind_ptr(&pool_job::run, job));
+			return &job->prod;
+		}
+	};
+	
+	// Calls fn on a worker thread (see thread_pool_run), and returns the result to the calling thread's runloop.
+	// fn must not use the runloop, or anything else owned by the calling thread, or anything else that isn't thread safe.
+	// Cancelling the returned async does not stop fn; the result is just discarded once it's done.
+	// fn can capture anything movable; it's destroyed on the calling thread.
+	template<typename Tl>
+	auto run_on_pool(Tl fn)
+	{
+		using T = decltype(fn());
+		return pool_job<T, Tl>::start(std::move(fn));
+	}
+}
+#endif
@@ -255,6 +255,106 @@ test("set", "array,string", "set")
 		assert(!b.contains(custom_hash(2)));
 		assert(b.contains(custom_hash(3)));
 	}
+	
+	{
+		// enough items to need many groups, and enough removals to leave deleted slots everywhere
+		set<int> item;
+		array<bool> ref;
+		ref.resize(20000);
+		for (int i=0;i<20000;i+=2)
+		{
+			item.add(i);
+			ref[i] = true;
+		}
+		for (int i=0;i<20000;i+=6)
+		{
+			item.remove(i);
+			ref[i] = false;
+		}
+		for (int i=1;i<20000;i+=6)
+		{
+			item.add(i);
+			ref[i] = true;
+		}
+		
+		size_t n = 0;
+		for (int i=0;i<20000;i++)
+		{
+			assert_eq(item.contains(i), ref[i]);
+			n += ref[i];
+		}
+		assert_eq(item.size(), n);
+		
+		size_t n_iter = 0;
+		for (int i : item)
+		{
+			assert(ref[i]);
+			n_iter++;
+		}
+		assert_eq(n_iter, n);
+	}
+	
+	{
+		// same as above, but incremental; also check everything at random points, when a migration is probably in progress
+		set<int> item;
+		item.incremental_rehash();
+		array<bool> ref;
+		ref.resize(20000);
+		auto check = [&]() {
+			size_t n = 0;
+			for (int i=0;i<20000;i++)
+			{
+				assert_eq(item.contains(i), ref[i]);
+				n += ref[i];
+			}
+			assert_eq(item.size(), n);
+			size_t n_iter = 0;
+			for (int i : item)
+			{
+				assert(ref[i]);
+				n_iter++;
+			}
+			assert_eq(n_iter, n);
+			
+			set<int> copy = item;
+			assert_eq(copy.size(), n);
+			for (int i : copy)
+				assert(ref[i]);
+		};
+		for (int i=0;i<20000;i+=2)
+		{
+			item.add(i);
+			ref[i] = true;
+			if (i == 1000 || i == 9000) check();
+		}
+		for (int i=0;i<20000;i+=6)
+		{
+			item.remove(i);
+			ref[i] = false;
+		}
+		check();
+		for (int i=1;i<20000;i+=6)
+		{
+			item.add(i);
+			ref[i] = true;
+		}
+		check();
+		
+		set<int> moved = std::move(item);
+		item = std::move(moved);
+		for (int i=0;i<20000;i++)
+		{
+			item.remove(i);
+			ref[i] = false;
+			if (i == 15000) check();
+		}
+		check();
+		
+		item.add(1);
+		ref[1] = true;
+		item.incremental_rehash(false);
+		check();
+	}
 }
 
 test("map", "array", "set")
@@ -421,5 +521,18 @@ test("map", "array", "set")
 #undef B
 #undef C
 	}
+	
+	{
+		map<int,int> x;
+		x.incremental_rehash();
+		for (int i=0;i<1000;i++)
+		{
+			int& y = x.get_create(i);
+			x.get_create(i/2); // must not invalidate references, even if a migration is in progress
+			y = i*2;
+		}
+		for (int i=0;i<1000;i++)
+			assert_eq(x.get(i), i*2);
+	}
 }
 #endif
@@ -5,89 +5,176 @@
 #include "string.h"
 #include "stringconv.h"
 #include "tuple.h"
+#include "endian.h"
+#include "simd.h"
 
 template<typename T, typename Thasher = void>
 class set {
 	template<typename,typename,typename>
 	friend class map;
+	template<typename,typename,typename>
+	friend class concurrent_map;
 	
-	//this is a hashtable, using open addressing and linear probing
+	//this is a hashtable, using open addressing; the layout is similar to Abseil's Swiss tables
+	//every slot has a control byte; if the top bit is clear, the slot is in use, and the low seven bits are part of the item's hash
+	//the slots are grouped by 16, and a lookup checks all control bytes in a group at once (one instruction on SSE2),
+	// and only compares the actual items if the hash bits match; if the item exists, that's usually one compare, otherwise usually zero
+	//a lookup stops at the first group that has an empty slot
 	
-	enum { i_empty, i_deleted };
-	// char can alias anything, so use that for tag type; the above two are the only valid tags
-	char& tag(size_t id) { return *(char*)(m_data+id); }
-	char tag(size_t id) const { return *(char*)(m_data+id); }
+	enum : uint8_t { c_empty = 0x80, c_deleted = 0xFE };
+	static const size_t group_size = 16;
 	
-	T* m_data; // length is always same as m_valid, no need to duplicate its length
-	bitarray m_valid;
-	size_t m_used_slots; // number of nodes in m_data that are not i_empty
-	size_t m_count; // number of nodes in m_data currently containing valid data
+	class group {
+#ifdef __SSE2__
+		__m128i ctrl;
+	public:
+		group(const uint8_t * ptr) : ctrl(_mm_load_si128((__m128i*)ptr)) {}
+		// these return one bit per slot
+		uint32_t match(uint8_t h2) const { return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2))); }
+		uint32_t match_empty() const { return match(c_empty); }
+		uint32_t match_free() const { return _mm_movemask_epi8(ctrl); } // empty or deleted
+#else
+		// same as above, but SWAR; 0x80 in each byte where the condition holds
+		uint64_t ctrl[2];
+		static const uint64_t lsb = 0x0101010101010101;
+		static const uint64_t msb = 0x8080808080808080;
+		
+		static uint32_t compress(uint64_t lo, uint64_t hi)
+		{
+			// moves bit 7 of each byte to bit 0-7 of the output
+			return (((lo&msb) >> 7) * 0x0102040810204080 >> 56) | (((hi&msb) >> 7) * 0x0102040810204080 >> 56 << 8);
+		}
+		static uint64_t match_word(uint64_t word, uint8_t h2)
+		{
+			// can give false positives if the previous byte matched; they'll just be rejected by the key compare
+			uint64_t x = word ^ (lsb*h2);
+			return (x - lsb) & ~x & msb;
+		}
+	public:
+		group(const uint8_t * ptr) { ctrl[0] = readu_le64(ptr); ctrl[1] = readu_le64(ptr+8); }
+		uint32_t match(uint8_t h2) const { return compress(match_word(ctrl[0], h2), match_word(ctrl[1], h2)); }
+		// c_empty is the only control byte with bit 7 set and bit 1 clear, so this one is exact
+		uint32_t match_empty() const { return compress(ctrl[0] & ~(ctrl[0] << 6), ctrl[1] & ~(ctrl[1] << 6)); }
+		uint32_t match_free() const { return compress(ctrl[0], ctrl[1]); }
+#endif
+	};
 	
-	// will spuriously fail during rehash
-	//void validate() const
-	//{
-	//	if (!m_data) return;
-	//	
-	//	size_t a = 0;
-	//	size_t b = 0;
-	//	size_t c = 0;
-	//	for (size_t n=0;n<m_valid.size();n++)
-	//	{
-	//		if (m_valid[n]) a++;
-	//		else if (tag(n) == i_empty) b++;
-	//		else c++;
-	//	}
-	//	size_t a2 = m_count;
-	//	size_t b2 = m_valid.size()-m_used_slots;
-	//	size_t c2 = m_used_slots-m_count;
-	//	if (a != a2 || b != b2 || c != c2)
-	//	{
-	//		printf("%lu,%lu %lu,%lu %lu,%lu\n", a,a2, b,b2, c,c2);
-	//		*(char*)1 = 1;
-	//	}
-	//}
+	// The control bytes are stored right after the items, in the same allocation. Capacity is a multiple of 16,
+	//  and malloc returns 16-aligned memory, so they're aligned too.
+	T* m_data;
+	uint8_t* m_ctrl;
+	size_t m_capacity; // zero, or a power of two and at least group_size
+	size_t m_used_slots; // number of slots in the current table that are not c_empty
+	size_t m_count; // number of slots currently containing valid data, in both tables
+	
+	// In incremental mode, resizing doesn't move all items at once. The previous table is kept, and every insert and remove
+	//  moves a few groups of it to the new one; until that's done, lookups check both tables.
+	// Indices past m_capacity refer to the old table, so a single size_t can point into either.
+	struct old_table {
+		T* data;
+		uint8_t* ctrl;
+		size_t capacity;
+		size_t pos; // everything before this slot has been moved
+	};
+	old_table* m_old;
+	bool m_incremental = false;
+	// Must be big enough that the old table is empty before the new one fills up; two groups per call is plenty.
+	static const size_t migrate_step = group_size*2;
+	
+	static bool ctrl_used(uint8_t ctrl) { return !(ctrl & 0x80); }
+	
+	T* slot(size_t pos) const { return pos < m_capacity ? &m_data[pos] : &m_old->data[pos-m_capacity]; }
+	uint8_t* ctrl_at(size_t pos) const { return pos < m_capacity ? &m_ctrl[pos] : &m_old->ctrl[pos-m_capacity]; }
+	size_t n_slots() const { return m_capacity + (m_old ? m_old->capacity : 0); }
+	
+	void alloc(size_t newsize)
+	{
+		static_assert(alignof(T) <= 16);
+		m_data = xmalloc(newsize*sizeof(T) + newsize);
+		m_ctrl = (uint8_t*)(m_data + newsize);
+		memset(m_ctrl, c_empty, newsize);
+		m_capacity = newsize;
+		m_used_slots = 0;
+	}
+	
+	// Moves an item from another table into the current one, which must have room.
+	void move_in(T* item, uint8_t ctrl)
+	{
+		// the hash bits are already known, but the high ones aren't; recalculating is easier than storing them
+		size_t pos = find_in<true, false>(m_data, m_ctrl, m_capacity, *item, hash_of(*item));
+		//this is known to not overwrite any existing object; if it does, someone screwed up
+		memcpy((void*)&m_data[pos], (void*)item, sizeof(T));
+		if (m_ctrl[pos] == c_empty) m_used_slots++;
+		m_ctrl[pos] = ctrl;
+	}
 	
 	void rehash(size_t newsize)
 	{
+		finish_migration();
+		
 		T* prev_data = m_data;
-		bitarray prev_valid = std::move(m_valid);
+		uint8_t* prev_ctrl = m_ctrl;
+		size_t prev_capacity = m_capacity;
 		
-		m_data = xcalloc(newsize, sizeof(T));
-		static_assert(sizeof(T) >= 1); // otherwise the tags mess up (zero-size objects are useless in sets, 
-		m_valid.reset();               // and I'm not sure if they're expressible in standard C++, but no reason not to check)
-		m_valid.resize(newsize);
+		alloc(newsize);
 		
-		for (size_t i=0;i<prev_valid.size();i++)
+		for (size_t i=0;i<prev_capacity;i++)
 		{
-			if (!prev_valid[i]) continue;
-			
-			size_t pos = find_pos_full<true, false>(prev_data[i]);
-			//this is known to not overwrite any existing object; if it does, someone screwed up
-			memcpy((void*)&m_data[pos], (void*)&prev_data[i], sizeof(T));
-			m_valid[pos] = true;
+			if (ctrl_used(prev_ctrl[i]))
+				move_in(&prev_data[i], prev_ctrl[i]);
 		}
 		free(prev_data);
-		m_used_slots = m_count;
+	}
+	
+	void begin_migration(size_t newsize)
+	{
+		finish_migration();
+		m_old = new old_table{ m_data, m_ctrl, m_capacity, 0 };
+		alloc(newsize);
+	}
+	
+	void migrate(size_t count)
+	{
+		old_table* old = m_old;
+		size_t end = min(old->pos + count, old->capacity);
+		for (size_t i=old->pos;i<end;i++)
+		{
+			if (!ctrl_used(old->ctrl[i])) continue;
+			move_in(&old->data[i], old->ctrl[i]);
+			// lookups in the old table must not find it anymore, but must still continue past it
+			old->ctrl[i] = c_deleted;
+		}
+		old->pos = end;
+		if (end == old->capacity)
+		{
+			free(old->data);
+			delete old;
+			m_old = NULL;
+		}
+	}
+	
+	void finish_migration()
+	{
+		if (m_old)
+			migrate(m_old->capacity);
+	}
+	
+	void resize(size_t newsize)
+	{
+		if (m_incremental) begin_migration(newsize);
+		else rehash(newsize);
 	}
 	
 	// Returns whether it did anything.
 	bool grow()
 	{
-		// half full -> rehash
-		if (m_count >= m_valid.size()/2)
-			rehash(m_valid.size()*2);
-		else if (m_used_slots >= m_valid.size()/4*3)
-			rehash(m_valid.size());
-		else
+		// 7/8 of the slots used or deleted -> rehash, to a bigger table if at least half of them are real items
+		if (m_used_slots < m_capacity/8*7)
 			return false;
+		resize(m_count >= m_capacity/2 ? m_capacity*2 : m_capacity);
 		return true;
 	}
 	
-	bool slot_empty(size_t pos) const
-	{
-		return !m_valid[pos];
-	}
-	
 	
 	template<typename T2>
 	static auto local_hash(const T2& item)
@@ -101,50 +188,79 @@ class set {
 		else static_assert(sizeof(T2) < 0);
 	}
 	
-	//If the object exists, returns the index where it can be found.
-	//If not, and want_empty is true, returns a suitable empty slot to insert it in, or -1 if the object should rehash.
+	template<typename T2>
+	static size_t hash_of(const T2& item)
+	{
+		return hash_shuffle(local_hash<T2>(item));
+	}
+	// low seven bits go in the control byte, the rest select the group
+	static uint8_t h2_of(size_t hashv) { return hashv & 0x7F; }
+	
+	//If the object exists in the given table, returns the index where it can be found.
+	//If not, and want_empty is true, returns a suitable empty slot to insert it in (the caller must ensure there's room).
 	//If no such object and want_empty is false, returns -1.
 	template<bool want_empty, bool want_used = true, typename T2>
-	size_t find_pos_full(const T2& item) const
+	static size_t find_in(T* data, const uint8_t * ctrl, size_t capacity, const T2& item, size_t hashv)
 	{
-		if (!m_data) return -1;
+		if (!capacity) return -1;
 		
-		size_t hashv = hash_shuffle(local_hash<T2>(item));
-		size_t i = 0;
+		uint8_t h2 = h2_of(hashv);
+		size_t group_mask = capacity/group_size - 1;
+		size_t grp_id = (hashv >> 7) & group_mask;
 		
 		size_t emptyslot = -1;
 		
-		while (true)
+		for (size_t i=1;;i++)
 		{
-			//some hashsets use hashv + i+(i+1)/2 <http://stackoverflow.com/a/15770445>
-			//but that only helps on poor hash functions, which mine is not
-			size_t pos = (hashv + i) & (m_valid.size()-1);
-			if (want_used && m_valid[pos] && m_data[pos] == item)
-				return pos;
-			if (!m_valid[pos])
+			size_t base = grp_id*group_size;
+			group grp(ctrl + base);
+			if (want_used)
+			{
+				for (uint32_t match = grp.match(h2); match; match &= match-1)
+				{
+					size_t pos = base + __builtin_ctz(match);
+					if (data[pos] == item)
+						return pos;
+				}
+			}
+			if (want_empty && emptyslot == (size_t)-1)
 			{
-				if (emptyslot == (size_t)-1) emptyslot = pos;
-				if (tag(pos) == i_empty)
+				uint32_t avail = grp.match_free();
+				if (avail)
 				{
-					if (want_empty) return emptyslot;
-					else return -1;
+					// start the search at a hash-dependent slot, so the iteration order isn't just the insertion order
+					// (that would make it easy to accidentally depend on)
+					unsigned rot = hashv & (group_size-1);
+					avail = (avail >> rot) | (avail << (group_size-rot));
+					emptyslot = base + ((__builtin_ctz(avail) + rot) & (group_size-1));
 				}
 			}
-			i++;
-//if(i > m_valid.size()) *(char*)1=1;
+			if (grp.match_empty())
+			{
+				if (want_empty) return emptyslot;
+				else return -1;
+			}
+			// triangular numbers visit every group, if the group count is a power of two
+			grp_id = (grp_id + i) & group_mask;
 		}
 	}
 	
 	template<typename T2>
-	size_t find_pos_const(const T2& item) const
+	size_t find_in_old(const T2& item, size_t hashv) const
 	{
-		return find_pos_full<false>(item);
+		if (!m_old) return -1;
+		size_t pos = find_in<false>(m_old->data, m_old->ctrl, m_old->capacity, item, hashv);
+		if (pos == (size_t)-1) return -1;
+		return m_capacity + pos;
 	}
 	
 	template<typename T2>
-	size_t find_pos_insert(const T2& item)
+	size_t find_pos_const(const T2& item) const
 	{
-		return find_pos_full<true>(item);
+		size_t hashv = hash_of(item);
+		size_t pos = find_in<false>(m_data, m_ctrl, m_capacity, item, hashv);
+		if (pos == (size_t)-1) pos = find_in_old(item, hashv);
+		return pos;
 	}
 	
 	//if the item doesn't exist, NULL
@@ -152,7 +268,7 @@ class set {
 	T* get_or_null(const T2& item) const
 	{
 		size_t pos = find_pos_const(item);
-		if (pos != (size_t)-1) return &m_data[pos];
+		if (pos != (size_t)-1) return slot(pos);
 		else return NULL;
 	}
 	// returns either false and a normal pointer, or true and an uninitialized pointer
@@ -160,71 +276,101 @@ class set {
 	template<typename T2>
 	tuple<bool,T*> get_or_prepare_create(const T2& item, bool known_new = false)
 	{
-		if (!m_data)
-			rehash(m_valid.size());
+		if (!m_capacity)
+			alloc(group_size);
 		
-		size_t pos = known_new ? 0 : find_pos_insert(item);
+		size_t hashv = hash_of(item);
+		size_t pos = (known_new ? find_in<true, false>(m_data, m_ctrl, m_capacity, item, hashv) :
+		                          find_in<true>(m_data, m_ctrl, m_capacity, item, hashv));
+		if (ctrl_used(m_ctrl[pos]))
+			return { false, &m_data[pos] };
 		
-		if (known_new || !m_valid[pos])
+		//do not move or migrate anything before knowing the item is new; it invalidates references,
+		// get_create(item_that_exists) is not allowed to do that
+		bool moved = false;
+		if (m_old)
 		{
-			if (grow())
-				pos = find_pos_insert(item); // recalculate this if grow() moved it
-			//do not move grow() earlier; it invalidates references, get_create(item_that_exists) is not allowed to do that
-			
-			if (tag(pos) == i_empty) m_used_slots++;
-			m_valid[pos] = true;
-			m_count++;
-			return { true, &m_data[pos] };
+			if (!known_new)
+			{
+				size_t oldpos = find_in_old(item, hashv);
+				if (oldpos != (size_t)-1)
+					return { false, slot(oldpos) };
+			}
+			migrate(migrate_step);
+			moved = true;
 		}
-		return { false, &m_data[pos] };
+		if (grow())
+			moved = true;
+		if (moved)
+			pos = find_in<true, false>(m_data, m_ctrl, m_capacity, item, hashv); // recalculate this if something else took the slot
+		
+		if (m_ctrl[pos] == c_empty) m_used_slots++;
+		m_ctrl[pos] = h2_of(hashv);
+		m_count++;
+		return { true, &m_data[pos] };
 	}
 	
 	void construct()
 	{
 		m_data = NULL;
-		m_valid.resize(8);
+		m_ctrl = NULL;
+		m_capacity = 0;
 		m_count = 0;
 		m_used_slots = 0;
+		m_old = NULL;
 	}
 	void construct(const set& other)
 	{
-		m_data = xcalloc(other.m_valid.size(), sizeof(T));
-		m_valid = other.m_valid;
-		m_count = other.m_count;
-		m_used_slots = other.m_count;
-		
-		for (size_t i=0;i<m_valid.size();i++)
+		construct();
+		m_incremental = other.m_incremental;
+		if (!other.m_count)
+			return;
+		// copy into a fresh table, rather than slot by slot, to get rid of the deleted slots and any unfinished migration
+		size_t newsize = other.m_capacity;
+		while (other.m_count >= newsize/8*7)
+			newsize *= 2;
+		alloc(newsize);
+		for (size_t i=0;i<other.n_slots();i++)
 		{
-			if (m_valid[i])
-			{
-				new(&m_data[i]) T(other.m_data[i]);
-			}
+			uint8_t ctrl = *other.ctrl_at(i);
+			if (!ctrl_used(ctrl)) continue;
+			T* item = other.slot(i);
+			size_t pos = find_in<true, false>(m_data, m_ctrl, m_capacity, *item, hash_of(*item));
+			new(&m_data[pos]) T(*item);
+			m_ctrl[pos] = ctrl;
 		}
-		rehash(m_valid.size());
+		m_count = other.m_count;
+		m_used_slots = other.m_count;
 	}
 	void construct(set&& other)
 	{
-		m_data = std::move(other.m_data);
-		m_valid = std::move(other.m_valid);
-		m_count = std::move(other.m_count);
-		m_used_slots = std::move(other.m_used_slots);
+		m_data = other.m_data;
+		m_ctrl = other.m_ctrl;
+		m_capacity = other.m_capacity;
+		m_count = other.m_count;
+		m_used_slots = other.m_used_slots;
+		m_old = other.m_old;
+		m_incremental = other.m_incremental;
 		
 		other.construct();
 	}
 	
 	void destruct()
 	{
-		for (size_t i=0;i<m_valid.size();i++)
+		for (size_t i=0;i<n_slots();i++)
 		{
-			if (m_valid[i])
+			if (ctrl_used(*ctrl_at(i)))
 			{
-				m_data[i].~T();
+				slot(i)->~T();
 			}
 		}
-		m_count = 0;
-		m_used_slots = 0;
 		free(m_data);
-		m_valid.reset();
+		if (m_old)
+		{
+			free(m_old->data);
+			delete m_old;
+		}
+		construct();
 	}
 	
 public:
@@ -240,6 +386,16 @@ public:
 	set& operator=(set&& other) { destruct(); construct(std::move(other)); return *this; }
 	~set() { destruct(); }
 	
+	//In incremental mode, growing or shrinking the table is spread over the following inserts and removes,
+	// so no single call takes more than O(1) time. Lookups are a little slower until the move is done.
+	//Good for big sets on latency sensitive threads. The setting is kept by reset(), and copied by the copy constructor.
+	void incremental_rehash(bool enable = true)
+	{
+		m_incremental = enable;
+		if (!enable)
+			finish_migration();
+	}
+	
 	void add(const T& item)
 	{
 		auto[create,ptr] = get_or_prepare_create(item);
@@ -265,11 +421,20 @@ public:
 		size_t pos = find_pos_const(item);
 		if (pos == (size_t)-1) return;
 		
-		m_data[pos].~T();
-		tag(pos) = i_deleted;
-		m_valid[pos] = false;
+		slot(pos)->~T();
+		// if the group has an empty slot, no lookup continues past this group, so this slot can be empty rather than deleted
+		if (pos < m_capacity && group(m_ctrl + (pos & ~(group_size-1))).match_empty())
+		{
+			m_ctrl[pos] = c_empty;
+			m_used_slots--;
+		}
+		else
+			*ctrl_at(pos) = c_deleted;
 		m_count--;
-		if (m_count < m_valid.size()/4 && m_valid.size() > 8) rehash(m_valid.size()/2);
+		if (m_old)
+			migrate(migrate_step);
+		else if (m_count < m_capacity/4 && m_capacity > group_size)
+			resize(m_capacity/2);
 	}
 	
 	size_t size() const { return m_count; }
@@ -284,7 +449,7 @@ public:
 		
 		void to_valid()
 		{
-			while (pos < parent->m_valid.size() && !parent->m_valid[pos])
+			while (pos < parent->n_slots() && !ctrl_used(*parent->ctrl_at(pos)))
 				pos++;
 		}
 		
@@ -297,7 +462,7 @@ public:
 		
 		const T& operator*()
 		{
-			return parent->m_data[pos];
+			return *parent->slot(pos);
 		}
 		void operator++()
 		{
@@ -306,7 +471,7 @@ public:
 		}
 		bool operator!=(const end_iterator&)
 		{
-			return (pos < parent->m_valid.size());
+			return (pos < parent->n_slots());
 		}
 	};
 	
@@ -528,6 +693,8 @@ public:
 		items.reset();
 	}
 	
+	void incremental_rehash(bool enable = true) { items.incremental_rehash(enable); }
+	
 	size_t size() const { return items.size(); }
 	
 private:
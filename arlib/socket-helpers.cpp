@@ -1,6 +1,10 @@
 #ifdef ARLIB_SOCKET
 #include "socket.h"
 #include <errno.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 // some of this should be deduplicated into calling each other, but not until compilers are better at inlining coroutines
 async<socket2::address> socket2::dns_port(cstring host, uint16_t port, size_t tries)
@@ -55,12 +59,210 @@ async<autoptr<socket2>> socket2::create_sslmaybe(bool ssl, cstring host, uint16_
 #endif
 }
 
+ssize_t socket2::recvv_sync(arrayview<iovec> bufs)
+{
+	size_t total = 0;
+	for (const iovec& buf : bufs)
+	{
+		if (!buf.iov_len)
+			continue;
+		ssize_t n = recv_sync(bytesw((uint8_t*)buf.iov_base, buf.iov_len));
+		if (n < 0)
+			return total ? total : n; // the error will show up again on the next call
+		total += n;
+		if ((size_t)n < buf.iov_len)
+			break;
+	}
+	return total;
+}
+ssize_t socket2::sendv_sync(arrayview<iovec> bufs)
+{
+	size_t total = 0;
+	for (const iovec& buf : bufs)
+	{
+		if (!buf.iov_len)
+			continue;
+		ssize_t n = send_sync(bytesr((uint8_t*)buf.iov_base, buf.iov_len));
+		if (n < 0)
+			return total ? total : n;
+		total += n;
+		if ((size_t)n < buf.iov_len)
+			break;
+	}
+	return total;
+}
 
+namespace {
+class socket2_relay {
+	struct direction {
+		socket2* src;
+		socket2* dst;
+		uint64_t* count;
+		bool done = false;
+		size_t pending = 0; // bytes in the pipe or buffer, not yet sent
+#ifdef __linux__
+		fd_t pipe_rd;
+		fd_t pipe_wr;
+		size_t pipe_size = 0;
+#endif
+		size_t buf_start = 0;
+		bytearray buf;
+		
+		void init(socket2* src, socket2* dst, uint64_t* count)
+		{
+			this->src = src;
+			this->dst = dst;
+			this->count = count;
+#ifdef __linux__
+			int fds[2];
+			if (src->get_fd() >= 0 && dst->get_fd() >= 0 && pipe2(fds, O_NONBLOCK|O_CLOEXEC) == 0)
+			{
+				pipe_rd = fds[0];
+				pipe_wr = fds[1];
+				// a bigger pipe means fewer syscalls; if the kernel refuses, the default 64KB is fine too
+				int size = fcntl(pipe_wr, F_SETPIPE_SZ, 256*1024);
+				pipe_size = (size > 0 ? size : 65536);
+				return;
+			}
+#endif
+			buf.resize(65536);
+		}
+		
+		// Same return values as socket2::recv_sync and send_sync.
+		ssize_t recv()
+		{
+#ifdef __linux__
+			if (pipe_rd.valid())
+			{
+				ssize_t n = splice(src->get_fd(), nullptr, pipe_wr, nullptr, pipe_size, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+				if (n == 0)
+					errno = ESHUTDOWN;
+				if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+					return 0;
+				return (n > 0 ? n : -1);
+			}
+#endif
+			buf_start = 0;
+			return src->recv_sync(buf);
+		}
+		ssize_t send()
+		{
+#ifdef __linux__
+			if (pipe_rd.valid())
+			{
+				ssize_t n = splice(pipe_rd, nullptr, dst->get_fd(), nullptr, pending, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+				if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+					return 0;
+				return n;
+			}
+#endif
+			ssize_t n = dst->send_sync(buf.slice(buf_start, pending));
+			if (n > 0)
+				buf_start += n;
+			return n;
+		}
+	};
+	direction dirs[2];
+	
+	producer<void> prod = make_producer<&socket2_relay::prod, &socket2_relay::cancel>();
+	waiter<void> wait0 = make_waiter<&socket2_relay::wait0, &socket2_relay::complete0>();
+	waiter<void> wait1 = make_waiter<&socket2_relay::wait1, &socket2_relay::complete1>();
+	
+	void complete0() { step(0); }
+	void complete1() { step(1); }
+	
+	void cancel()
+	{
+		wait0.cancel();
+		wait1.cancel();
+	}
+	
+	void step(int idx)
+	{
+		direction& dir = dirs[idx];
+		waiter<void>* wait = (idx == 0 ? &wait0 : &wait1);
+		// don't let a fast sender starve the other direction; awaiting can_recv will complete immediately anyways
+		for (int rounds=0;rounds<16;rounds++)
+		{
+			if (dir.pending == 0)
+			{
+				ssize_t n = dir.recv();
+				if (n < 0 && errno == ESHUTDOWN)
+				{
+					dir.dst->shutdown_send();
+					dir.done = true;
+					if (dirs[0].done && dirs[1].done)
+						prod.complete(); // must be last, it may delete this object
+					return;
+				}
+				if (n < 0)
+					return fail();
+				if (n == 0)
+					break;
+				dir.pending = n;
+			}
+			
+			ssize_t n = dir.send();
+			if (n < 0)
+				return fail();
+			*dir.count += n;
+			dir.pending -= n;
+			if (dir.pending)
+			{
+				dir.dst->can_send().then(wait);
+				return;
+			}
+		}
+		dir.src->can_recv().then(wait);
+	}
+	
+	void fail()
+	{
+		stats.error = errno;
+		cancel();
+		prod.complete();
+	}
+	
+public:
+	socket2::relay_stats stats;
+	
+	async<void> run(socket2* a, socket2* b)
+	{
+		dirs[0].init(a, b, &stats.a_to_b);
+		dirs[1].init(b, a, &stats.b_to_a);
+		async<void> ret = &prod;
+		a->can_recv().then(&wait0);
+		b->can_recv().then(&wait1);
+		return ret;
+	}
+};
+}
 
+async<socket2::relay_stats> socket2::relay(socket2* a, socket2* b)
+{
+	socket2_relay r;
+	co_await r.run(a, b);
+	co_return r.stats;
+}
+
+
+
+void socketbuf::send_release()
+{
+	// the kernel may still be reading partially sent zero-copy buffers, so they can't be freed yet
+	if (sock && zerocopy)
+	{
+		array<bytearray> bufs;
+		send_by.reset(&bufs);
+		for (bytearray& by : bufs)
+			sock->zerocopy_hold(std::move(by));
+	}
+}
 void socketbuf::socket_failed()
 {
 	send_wait.cancel();
 	recv_wait.cancel();
+	send_release();
 	sock = nullptr;
 	if (send_prod.has_waiter())
 		RETURN_IF_CALLBACK_DESTRUCTS(send_prod.complete(false));
@@ -168,12 +370,25 @@ void socketbuf::send_ready()
 {
 	if (!sock)
 		return;
-	ssize_t n = sock->send_sync(send_by.pull_begin());
+	ssize_t n;
+	if (zerocopy && send_by.size() >= zerocopy_min)
+		n = sock->sendv_zerocopy_sync(send_by.pull_iov());
+	else
+		n = sock->sendv_sync(send_by.pull_iov());
 	if (n < 0)
 		socket_failed();
 	if (!sock)
 		return;
-	send_by.pull_finish(n);
+	if (zerocopy)
+	{
+		// even if this send copied, an earlier one may have used the same buffers
+		array<bytearray> done;
+		send_by.pull_finish(n, &done);
+		for (bytearray& by : done)
+			sock->zerocopy_hold(std::move(by));
+	}
+	else
+		send_by.pull_finish(n);
 	send_prepare();
 }
 void socketbuf::send_prepare()
@@ -189,10 +404,43 @@ void socketbuf::send_prepare()
 			send_prod.complete(true);
 	}
 }
+void socketbuf::send(bytearray&& by)
+{
+	if (!sock)
+		return;
+	if (zerocopy && by.size() >= zerocopy_min)
+	{
+		send_by.push(std::move(by));
+		send_ready();
+		return;
+	}
+	if (LIKELY(send_by.size() == 0))
+	{
+		ssize_t n = sock->send_sync(by);
+		if (n < 0)
+		{
+			socket_failed();
+			return;
+		}
+		if (LIKELY((size_t)n == by.size()))
+			return;
+		send_by.push(std::move(by));
+		send_by.pull_finish(n);
+	}
+	else
+		send_by.push(std::move(by));
+	send_prepare();
+}
 void socketbuf::send(bytesr by)
 {
 	if (!sock)
 		return;
+	if (zerocopy && by.size() >= zerocopy_min)
+	{
+		send_by.push(std::move(by));
+		send_ready();
+		return;
+	}
 	if (LIKELY(send_by.size() == 0))
 	{
 		ssize_t n = sock->send_sync(by);
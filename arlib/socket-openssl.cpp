@@ -4,6 +4,13 @@
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <openssl/x509v3.h>
+#ifdef __linux__
+#include <openssl/kdf.h>
+#include <openssl/core_names.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <linux/tls.h>
+#endif
 
 namespace {
 
@@ -11,12 +18,111 @@ namespace {
 static SSL_CTX* g_ctx;
 static BIO_METHOD* g_bio_meth;
 
+#ifdef __linux__
+// Kernel TLS. Once the handshake is done, the record keys are given to the kernel, which then encrypts and decrypts
+//  everything; OpenSSL isn't involved anymore, and the fd can be used with sendfile() and splice().
+// OpenSSL can do that by itself (SSL_OP_ENABLE_KTLS), but only if it owns the fd, which it doesn't (see below);
+//  and 3.0 can't do RX for TLS 1.3.
+union ktls_crypto_info {
+	tls_crypto_info info;
+	tls12_crypto_info_aes_gcm_128 aes128;
+	tls12_crypto_info_aes_gcm_256 aes256;
+	tls12_crypto_info_chacha20_poly1305 chacha;
+};
+
+// For TLS 1.2, iv is the 4-byte implicit nonce; for 1.3, it's the full 12 bytes. Returns the size, or 0 if unsupported.
+static size_t ktls_fill(ktls_crypto_info& ci, int version, int nid, bytesr key, bytesr iv, uint64_t seq)
+{
+	memset(&ci, 0, sizeof(ci));
+	ci.info.version = version; // OpenSSL and Linux use the same numbers, the ones from the protocol
+	if (nid == NID_aes_128_gcm || nid == NID_aes_256_gcm)
+	{
+		// same layout, different key size
+		bool is128 = (nid == NID_aes_128_gcm);
+		ci.info.cipher_type = (is128 ? TLS_CIPHER_AES_GCM_128 : TLS_CIPHER_AES_GCM_256);
+		uint8_t* ci_iv = (is128 ? ci.aes128.iv : ci.aes256.iv);
+		uint8_t* ci_key = (is128 ? ci.aes128.key : ci.aes256.key);
+		uint8_t* ci_salt = (is128 ? ci.aes128.salt : ci.aes256.salt);
+		uint8_t* ci_seq = (is128 ? ci.aes128.rec_seq : ci.aes256.rec_seq);
+		memcpy(ci_key, key.ptr(), key.size());
+		memcpy(ci_salt, iv.ptr(), 4);
+		if (version == TLS1_3_VERSION)
+			memcpy(ci_iv, iv.ptr()+4, 8);
+		else
+			writeu_be64(ci_iv, seq); // the explicit nonce; anything unique works, the sequence number is the usual choice
+		writeu_be64(ci_seq, seq);
+		return (is128 ? sizeof(ci.aes128) : sizeof(ci.aes256));
+	}
+	if (nid == NID_chacha20_poly1305)
+	{
+		ci.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+		memcpy(ci.chacha.key, key.ptr(), key.size());
+		memcpy(ci.chacha.iv, iv.ptr(), iv.size());
+		writeu_be64(ci.chacha.rec_seq, seq);
+		return sizeof(ci.chacha);
+	}
+	return 0;
+}
+
+static bool ktls_kdf(const char * name, const EVP_MD* md, int mode, bytesr secret, bytesr seed, bytesw out)
+{
+	EVP_KDF* kdf = EVP_KDF_fetch(nullptr, name, nullptr);
+	if (!kdf)
+		return false;
+	EVP_KDF_CTX* ctx = EVP_KDF_CTX_new(kdf);
+	EVP_KDF_free(kdf);
+	if (!ctx)
+		return false;
+	
+	OSSL_PARAM params[5];
+	OSSL_PARAM* p = params;
+	*p++ = OSSL_PARAM_construct_utf8_string(OSSL_KDF_PARAM_DIGEST, (char*)EVP_MD_get0_name(md), 0);
+	*p++ = OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SECRET, (void*)secret.ptr(), secret.size());
+	if (mode >= 0)
+	{
+		*p++ = OSSL_PARAM_construct_int(OSSL_KDF_PARAM_MODE, &mode);
+		*p++ = OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_INFO, (void*)seed.ptr(), seed.size());
+	}
+	else
+		*p++ = OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SEED, (void*)seed.ptr(), seed.size());
+	*p = OSSL_PARAM_construct_end();
+	
+	bool ok = (EVP_KDF_derive(ctx, out.ptr(), out.size(), params) > 0);
+	EVP_KDF_CTX_free(ctx);
+	return ok;
+}
+
+// HKDF-Expand-Label from RFC 8446, with empty context.
+static bool ktls_expand_label(const EVP_MD* md, bytesr secret, cstring label, bytesw out)
+{
+	uint8_t info[2+1+6+16+1];
+	size_t len = 0;
+	info[len++] = out.size() >> 8;
+	info[len++] = out.size();
+	info[len++] = 6 + label.length();
+	memcpy(info+len, "tls13 ", 6);
+	len += 6;
+	memcpy(info+len, label.bytes().ptr(), label.length());
+	len += label.length();
+	info[len++] = 0;
+	return ktls_kdf(OSSL_KDF_NAME_HKDF, md, EVP_KDF_HKDF_MODE_EXPAND_ONLY, secret, bytesr(info, len), out);
+}
+#endif
+
 class socket2_openssl : public socket2 {
 public:
 	static void initialize()
 	{
 		g_ctx = SSL_CTX_new(TLS_client_method());
 		SSL_CTX_set_default_verify_paths(g_ctx); // don't know why this one isn't on by default
+#ifdef __linux__
+		// the only way to get the TLS 1.3 traffic secrets
+		SSL_CTX_set_keylog_callback(g_ctx, [](const SSL* ssl, const char * line) {
+			socket2_openssl* ossl = (socket2_openssl*)SSL_get_app_data(ssl);
+			if (ossl)
+				ossl->keylog(line);
+		});
+#endif
 		
 		g_bio_meth = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "arlib");
 		BIO_meth_set_write_ex(g_bio_meth, [](BIO* bio, const char * data, size_t dlen, size_t* written) -> int {
@@ -65,6 +171,52 @@ public:
 	enum { block_none, block_send, block_recv };
 	uint8_t send_block = block_none; // send_block = block_send means that last time SSL_write() was called, it failed with SSL_WANT_WRITE
 	uint8_t recv_block = block_none; // if the operation succeeded or wasn't attempted, it's block_none and considered ready immediately
+#ifdef __linux__
+	bool ktls_possible = false; // true between the end of the handshake and the first recv or send
+	bool ktls_tx = false;
+	bool ktls_rx = false;
+	uint8_t secret_len = 0;
+	uint8_t secret_client[EVP_MAX_MD_SIZE];
+	uint8_t secret_server[EVP_MAX_MD_SIZE];
+	
+	void keylog(cstring line)
+	{
+		uint8_t* target;
+		if (line.startswith("CLIENT_TRAFFIC_SECRET_0 ")) target = secret_client;
+		else if (line.startswith("SERVER_TRAFFIC_SECRET_0 ")) target = secret_server;
+		else return;
+		
+		cstring hex = line.rsplit<1>(" ")[1];
+		if (hex.length() > sizeof(secret_client)*2 || hex.length()%2)
+			return;
+		for (size_t i=0;i<hex.length()/2;i++)
+		{
+			uint8_t byte;
+			if (!fromstringhex(hex.substr(i*2, i*2+2), byte))
+				return;
+			target[i] = byte;
+		}
+		secret_len = hex.length()/2;
+	}
+	
+	void try_ktls();
+	void ktls_forget()
+	{
+		OPENSSL_cleanse(secret_client, sizeof(secret_client));
+		OPENSSL_cleanse(secret_server, sizeof(secret_server));
+		secret_len = 0;
+		ktls_possible = false;
+	}
+	
+	bool enable_ktls() override
+	{
+		if (!ktls_possible || !sock)
+			return false;
+		try_ktls();
+		ktls_forget();
+		return (ktls_tx && ktls_rx);
+	}
+#endif
 	
 	socket2_openssl(autoptr<socket2> sock_, cstring domain) : sock(std::move(sock_))
 	{
@@ -76,7 +228,7 @@ public:
 			//  (gtk and game-x11 set SIGPIPE to SIG_IGN, but making the openssl handler conditional on gui stuff is just wrong,
 			//   and gdb breaks on SIGPIPE anyways)
 			SSL_set_fd(ssl, fd); // does not claim ownership of the fd
-			// todo: test (trying to enable ktls returns ENOENT on every machine I have)
+			// kTLS is instead set up by enable_ktls(), which doesn't need this
 			//SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
 		}
 		else
@@ -86,6 +238,7 @@ public:
 			SSL_set_bio(ssl, bio, bio);
 		}
 		SSL_set_mode(ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+		SSL_set_app_data(ssl, this);
 		
 		SSL_set_verify(ssl, SSL_VERIFY_PEER, nullptr); // don't know why this one is off by default
 		SSL_set1_host(ssl, domain.c_str().c_str()); // needed for hostname verification
@@ -102,6 +255,7 @@ public:
 		int err = SSL_get_error(ssl, success);
 		if (err == SSL_ERROR_WANT_READ) { block = block_recv; return 0; }
 		else if (err == SSL_ERROR_WANT_WRITE) { block = block_send; return 0; }
+		else if (err == SSL_ERROR_ZERO_RETURN) { sock = nullptr; errno = ESHUTDOWN; return -1; } // close_notify
 		else { sock = nullptr; return -1; }
 	}
 	
@@ -113,6 +267,12 @@ public:
 #endif
 		if (!sock)
 			return -1;
+#ifdef __linux__
+		if (UNLIKELY(ktls_possible))
+			ktls_forget();
+		if (ktls_rx)
+			return recv_ktls(by);
+#endif
 		size_t ret;
 		return process_ret(SSL_read_ex(ssl, by.ptr(), by.size(), &ret), ret, recv_block);
 	}
@@ -124,10 +284,70 @@ public:
 #endif
 		if (!sock)
 			return -1;
+#ifdef __linux__
+		if (UNLIKELY(ktls_possible))
+			ktls_forget();
+		if (ktls_tx)
+			return sock->send_sync(by);
+#endif
 		size_t ret;
 		return process_ret(SSL_write_ex(ssl, by.ptr(), by.size(), &ret), ret, send_block);
 	}
 	
+#ifdef __linux__
+	ssize_t sendv_sync(arrayview<iovec> bufs) override
+	{
+		if (sock && ktls_tx)
+			return sock->sendv_sync(bufs);
+		return socket2::sendv_sync(bufs);
+	}
+	
+	// Non-application-data records must be read with recvmsg, or the kernel returns EIO.
+	ssize_t recv_ktls(bytesw by)
+	{
+		while (true)
+		{
+			iovec iov = { by.ptr(), by.size() };
+			alignas(cmsghdr) char control[CMSG_SPACE(sizeof(uint8_t))];
+			msghdr msg = {};
+			msg.msg_iov = &iov;
+			msg.msg_iovlen = 1;
+			msg.msg_control = control;
+			msg.msg_controllen = sizeof(control);
+			ssize_t n = recvmsg(sock->get_fd(), &msg, MSG_DONTWAIT);
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				return 0;
+			if (n == 0)
+				errno = ESHUTDOWN;
+			if (n <= 0)
+				break;
+			
+			cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+			uint8_t type = 23; // application data
+			if (cm && cm->cmsg_level == SOL_TLS && cm->cmsg_type == TLS_GET_RECORD_TYPE)
+				type = *(uint8_t*)CMSG_DATA(cm);
+			if (type == 23)
+				return n;
+			// TLS 1.3 servers send session tickets after the handshake; they're useless here, so discard them.
+			// Other handshake messages are KeyUpdate, which the kernel can't do, so the next record will fail.
+			if (type == 22 && SSL_version(ssl) == TLS1_3_VERSION)
+				continue;
+			// alert, most likely close_notify
+			errno = ESHUTDOWN;
+			break;
+		}
+		sock = nullptr;
+		return -1;
+	}
+	
+	fd_raw_t get_fd() override
+	{
+		if (sock && ktls_tx && ktls_rx)
+			return sock->get_fd();
+		return -1;
+	}
+#endif
+	
 	MAKE_DESTRUCTIBLE_FROM_CALLBACK();
 	
 	producer<void> sendapp_p;
@@ -161,8 +381,22 @@ public:
 			sock->can_recv().then(&wait_recv);
 		return &prod;
 	}
-	async<void> can_recv() override { return prepare_wait(recvapp_p, recv_block); }
-	async<void> can_send() override { return prepare_wait(sendapp_p, send_block); }
+	async<void> can_recv() override
+	{
+#ifdef __linux__
+		if (sock && ktls_rx)
+			return sock->can_recv();
+#endif
+		return prepare_wait(recvapp_p, recv_block);
+	}
+	async<void> can_send() override
+	{
+#ifdef __linux__
+		if (sock && ktls_tx)
+			return sock->can_send();
+#endif
+		return prepare_wait(sendapp_p, send_block);
+	}
 	
 	~socket2_openssl()
 	{
@@ -174,14 +408,113 @@ public:
 			// if the handshake is cancelled, it will fail with SSL_R_SHUTDOWN_WHILE_IN_INIT; not worth caring about
 			// OpenSSL errors are in a thread-local ring buffer; leaking them will eventually be collected
 			// (could confuse other components in this process that read those errors, but too rare, no point caring)
+#ifdef __linux__
+			if (ktls_tx)
+			{
+				// OpenSSL's write state is outdated, so the kernel must send the alert
+				uint8_t alert[2] = { 1, 0 }; // warning, close_notify
+				iovec iov = { alert, sizeof(alert) };
+				alignas(cmsghdr) char control[CMSG_SPACE(sizeof(uint8_t))] = {};
+				msghdr msg = {};
+				msg.msg_iov = &iov;
+				msg.msg_iovlen = 1;
+				msg.msg_control = control;
+				msg.msg_controllen = sizeof(control);
+				cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+				cm->cmsg_level = SOL_TLS;
+				cm->cmsg_type = TLS_SET_RECORD_TYPE;
+				cm->cmsg_len = CMSG_LEN(sizeof(uint8_t));
+				*(uint8_t*)CMSG_DATA(cm) = 21; // alert
+				sendmsg(sock->get_fd(), &msg, MSG_DONTWAIT|MSG_NOSIGNAL);
+			}
+			else
+#endif
 			SSL_shutdown(ssl);
 		}
 		
 		//the BIO should not be freed, the SSL* grabs the only reference
 		SSL_free(ssl);
+#ifdef __linux__
+		ktls_forget();
+#endif
 	}
 };
 
+#ifdef __linux__
+void socket2_openssl::try_ktls()
+{
+	int fd = sock->get_fd();
+	if (fd < 0 || SSL_has_pending(ssl))
+		return;
+	
+	const SSL_CIPHER* cipher = SSL_get_current_cipher(ssl);
+	int version = SSL_version(ssl);
+	int nid = SSL_CIPHER_get_cipher_nid(cipher);
+	const EVP_MD* md = SSL_CIPHER_get_handshake_digest(cipher);
+	size_t key_len;
+	if (nid == NID_aes_128_gcm) key_len = 16;
+	else if (nid == NID_aes_256_gcm || nid == NID_chacha20_poly1305) key_len = 32;
+	else return;
+	if (!md)
+		return;
+	
+	// client key, server key, client iv, server iv
+	uint8_t keys[32*2 + 12*2];
+	size_t iv_len;
+	uint64_t seq;
+	if (version == TLS1_3_VERSION)
+	{
+		if (!secret_len)
+			return;
+		iv_len = 12;
+		seq = 0; // the traffic keys were just installed
+		bytesr sc = bytesr(secret_client, secret_len);
+		bytesr ss = bytesr(secret_server, secret_len);
+		if (!ktls_expand_label(md, sc, "key", bytesw(keys, key_len)) ||
+		    !ktls_expand_label(md, ss, "key", bytesw(keys+key_len, key_len)) ||
+		    !ktls_expand_label(md, sc, "iv", bytesw(keys+key_len*2, iv_len)) ||
+		    !ktls_expand_label(md, ss, "iv", bytesw(keys+key_len*2+iv_len, iv_len)))
+			return;
+	}
+	else if (version == TLS1_2_VERSION)
+	{
+		iv_len = (nid == NID_chacha20_poly1305 ? 12 : 4);
+		seq = 1; // each side has sent one record with these keys, the Finished message
+		uint8_t master[SSL_MAX_MASTER_KEY_LENGTH];
+		size_t master_len = SSL_SESSION_get_master_key(SSL_get_session(ssl), master, sizeof(master));
+		uint8_t seed[13+32+32];
+		memcpy(seed, "key expansion", 13);
+		SSL_get_server_random(ssl, seed+13, 32);
+		SSL_get_client_random(ssl, seed+13+32, 32);
+		bool ok = ktls_kdf(OSSL_KDF_NAME_TLS1_PRF, md, -1, bytesr(master, master_len), seed, bytesw(keys, key_len*2+iv_len*2));
+		OPENSSL_cleanse(master, sizeof(master));
+		if (!ok)
+			return;
+	}
+	else return;
+	
+	ktls_crypto_info tx;
+	ktls_crypto_info rx;
+	size_t tx_size = ktls_fill(tx, version, nid, bytesr(keys, key_len), bytesr(keys+key_len*2, iv_len), seq);
+	size_t rx_size = ktls_fill(rx, version, nid, bytesr(keys+key_len, key_len), bytesr(keys+key_len*2+iv_len, iv_len), seq);
+	OPENSSL_cleanse(keys, sizeof(keys));
+	
+	// usually fails with ENOENT, if the tls module isn't loaded; if so, the socket is unchanged
+	// RX goes first; if only that works, OpenSSL keeps encrypting, with its own (still correct) write state.
+	// The other way around, OpenSSL would still be decrypting, and anything it sends in response (alerts, KeyUpdate)
+	//  would use stale keys and sequence numbers.
+	// Without keys, the ULP just passes data through, so if RX fails, nothing changed.
+	if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) == 0 &&
+	    setsockopt(fd, SOL_TLS, TLS_RX, &rx, rx_size) == 0)
+	{
+		ktls_rx = true;
+		ktls_tx = (setsockopt(fd, SOL_TLS, TLS_TX, &tx, tx_size) == 0);
+	}
+	OPENSSL_cleanse(&tx, sizeof(tx));
+	OPENSSL_cleanse(&rx, sizeof(rx));
+}
+#endif
+
 #ifdef ARLIB_TEST
 static bool initialized = false;
 static void try_initialize()
@@ -224,7 +557,165 @@ async<autoptr<socket2>> socket2::wrap_ssl_openssl(autoptr<socket2> inner, cstrin
 			co_return nullptr;
 		co_await ossl->can_recv();
 	}
+#ifdef __linux__
+	ossl->ktls_possible = true;
+#endif
 	
 	co_return ret;
 }
 #endif
+
+#if defined(ARLIB_TEST) && defined(__linux__) && defined(ARLIB_THREAD)
+#include "file.h"
+#include <netinet/in.h>
+#include <unistd.h>
+
+// the client only accepts valid certificates, so make one and trust it
+static EVP_PKEY* ktls_test_key;
+static X509* ktls_test_cert;
+static void ktls_test_make_cert()
+{
+	if (ktls_test_cert)
+		return;
+	ktls_test_key = EVP_EC_gen("P-256");
+	X509* cert = X509_new();
+	X509_set_version(cert, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+	X509_gmtime_adj(X509_getm_notBefore(cert), -3600);
+	X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+	X509_set_pubkey(cert, ktls_test_key);
+	X509_NAME* name = X509_get_subject_name(cert);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const uint8_t*)"localhost", -1, -1, 0);
+	X509_set_issuer_name(cert, name);
+	X509V3_CTX ctx;
+	X509V3_set_ctx_nodb(&ctx);
+	X509V3_set_ctx(&ctx, cert, cert, nullptr, nullptr, 0);
+	X509_EXTENSION* ext = X509V3_EXT_conf_nid(nullptr, &ctx, NID_subject_alt_name, "DNS:localhost");
+	X509_add_ext(cert, ext, -1);
+	X509_EXTENSION_free(ext);
+	X509_sign(cert, ktls_test_key, EVP_sha256());
+	X509_STORE_add_cert(SSL_CTX_get_cert_store(g_ctx), cert);
+	ktls_test_cert = cert;
+}
+
+static async<bool> ktls_test(int version)
+{
+	struct server_t {
+		SSL_CTX* ctx;
+		int lfd;
+		bool ok = false;
+		semaphore done;
+	} srv;
+	srv.ctx = SSL_CTX_new(TLS_server_method());
+	SSL_CTX_use_certificate(srv.ctx, ktls_test_cert);
+	SSL_CTX_use_PrivateKey(srv.ctx, ktls_test_key);
+	SSL_CTX_set_min_proto_version(srv.ctx, version);
+	SSL_CTX_set_max_proto_version(srv.ctx, version);
+	
+	srv.lfd = socket(AF_INET6, SOCK_STREAM|SOCK_CLOEXEC, 0);
+	sockaddr_in6 sa = {};
+	sa.sin6_family = AF_INET6;
+	sa.sin6_addr = in6addr_loopback;
+	socklen_t sa_len = sizeof(sa);
+	assert_eq(bind(srv.lfd, (sockaddr*)&sa, sizeof(sa)), 0);
+	assert_eq(listen(srv.lfd, 1), 0);
+	assert_eq(getsockname(srv.lfd, (sockaddr*)&sa, &sa_len), 0);
+	
+	// plain blocking OpenSSL, on another thread
+	thread_create([&srv]() {
+		int fd = accept(srv.lfd, nullptr, nullptr);
+		SSL* ssl = SSL_new(srv.ctx);
+		SSL_set_fd(ssl, fd);
+		if (SSL_accept(ssl) == 1)
+		{
+			SSL_write(ssl, "hello from server", 17);
+			char buf[64];
+			size_t n_buf = 0;
+			while (n_buf < 17)
+			{
+				int n = SSL_read(ssl, buf+n_buf, sizeof(buf)-n_buf);
+				if (n <= 0)
+					break;
+				n_buf += n;
+			}
+			srv.ok = (n_buf == 17 && !memcmp(buf, "hello from client", 17));
+			SSL_write(ssl, "bye", 3);
+			SSL_shutdown(ssl);
+		}
+		SSL_free(ssl);
+		close(fd);
+		srv.done.release();
+	});
+	
+	autoptr<socket2> inner = co_await socket2::create(socket2::address("[::1]", ntohs(sa.sin6_port)));
+	autoptr<socket2> sock = co_await socket2::wrap_ssl_openssl(std::move(inner), "localhost");
+	assert(sock);
+	bool offloaded = sock->enable_ktls();
+	assert(!sock->enable_ktls()); // only once
+	if (offloaded)
+		assert_gte(sock->get_fd(), 0);
+	else
+		assert_lt(sock->get_fd(), 0);
+	
+	// with TLS 1.3, session tickets arrive before this
+	bytearray got;
+	uint8_t buf[64];
+	while (got.size() < 17)
+	{
+		co_await sock->can_recv();
+		ssize_t n = sock->recv_sync(buf);
+		assert_gte(n, 0);
+		got += bytesr(buf, n);
+	}
+	assert_eq(cstring(got), "hello from server");
+	
+	bytesr out = cstring("hello from client").bytes();
+	while (out)
+	{
+		co_await sock->can_send();
+		ssize_t n = sock->send_sync(out);
+		assert_gte(n, 0);
+		out = out.skip(n);
+	}
+	
+	// then the close_notify alert
+	got.reset();
+	while (true)
+	{
+		co_await sock->can_recv();
+		ssize_t n = sock->recv_sync(buf);
+		if (n < 0)
+			break;
+		got += bytesr(buf, n);
+	}
+	assert_eq(errno, ESHUTDOWN);
+	assert_eq(cstring(got), "bye");
+	
+	sock = nullptr;
+	srv.done.wait();
+	assert(srv.ok);
+	close(srv.lfd);
+	SSL_CTX_free(srv.ctx);
+	co_return offloaded;
+}
+
+co_test("SSL kTLS", "tcp", "ssl")
+{
+	try_initialize();
+	ktls_test_make_cert();
+	
+	bytearray ulps = file2::readall_array("/proc/sys/net/ipv4/tcp_available_ulp");
+	bool have_ulp = cstring(ulps).trim().csplit(" ").contains("tls");
+#ifdef ARLIB_RUNLOOP_URING
+	have_ulp = false; // the runloop's sockets have no fd to offload
+#endif
+	
+	bool offloaded = false;
+	testctx("TLS 1.3") offloaded |= co_await ktls_test(TLS1_3_VERSION);
+	testctx("TLS 1.2") offloaded |= co_await ktls_test(TLS1_2_VERSION);
+	if (have_ulp)
+		assert(offloaded);
+	if (!offloaded)
+		test_skip_force("kernel has no tls module, only tested the fallback");
+}
+#endif
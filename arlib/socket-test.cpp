@@ -228,6 +228,372 @@ co_test("TCP listen", "tcp", "")
 }
 
 
+#if defined(__linux__) && defined(ARLIB_THREAD)
+co_test("TCP listen, multiple threads", "tcp", "")
+{
+	int port = time(NULL)%3600 + 13600;
+	
+	struct state_t {
+		size_t main_thread = thread_get_id();
+		int n_accepted = 0;
+		int n_wrong_thread = 0;
+	} state;
+	autoptr<socketlisten_multi> lst = socketlisten_multi::create(port, [&state](autoptr<socket2> s) {
+		if (thread_get_id() == state.main_thread)
+			lock_incr<lock_acqrel>(&state.n_wrong_thread);
+		lock_incr<lock_acqrel>(&state.n_accepted);
+	}, 2);
+	assert(lst);
+	
+	array<autoptr<socket2>> clients;
+	for (int i=0;i<8;i++)
+	{
+		clients.append(co_await socket2::create(socket2::address("[::1]", port)));
+		assert(clients[i]);
+	}
+	
+	timestamp end = timestamp::in_ms(5000);
+	while (lock_read<lock_acq>(&state.n_accepted) < 8 && timestamp::now() < end)
+		co_await runloop2::in_ms(1);
+	assert_eq(lock_read<lock_acq>(&state.n_accepted), 8);
+	assert_eq(lock_read<lock_acq>(&state.n_wrong_thread), 0);
+	
+	lst = nullptr;
+}
+#endif
+
+#ifdef __unix__
+#include <sys/socket.h>
+co_test("socket scatter-gather", "tcp", "")
+{
+	int fds[2];
+	assert_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+	autoptr<socket2> a = socket2::create_from_fd(fds[0]);
+	autoptr<socket2> b = socket2::create_from_fd(fds[1]);
+	
+	iovec out[] = { { (void*)"abc", 3 }, { (void*)"", 0 }, { (void*)"defgh", 5 } };
+	assert_eq(a->sendv_sync(out), 8);
+	
+	uint8_t buf1[2];
+	uint8_t buf2[16];
+	iovec in[] = { { buf1, sizeof(buf1) }, { buf2, sizeof(buf2) } };
+	co_await b->can_recv(); // the io_uring runloop sends in the background
+	assert_eq(b->recvv_sync(in), 8);
+	assert_eq(cstring(bytesr(buf1)), "ab");
+	assert_eq(cstring(bytesr(buf2, 6)), "cdefgh");
+	
+	// big enough to fill the socket buffer, so socketbuf has to keep some of it
+	bytearray big;
+	big.resize(1024*1024);
+	for (size_t i=0;i<big.size();i++)
+		big[i] = i ^ (i>>8);
+	
+	socketbuf sa = std::move(a);
+	sa.send_buf("head");
+	sa.send_buf(cstring("er").bytes());
+	sa.send_flush();
+	sa.send(std::move(big));
+	
+	bytearray got;
+	while (got.size() < 6 + 1024*1024)
+	{
+		co_await b->can_recv();
+		size_t prev = got.size();
+		got.resize(prev + 65536);
+		ssize_t n = b->recv_sync(got.skip(prev));
+		assert_gte(n, 0);
+		got.resize(prev + n);
+	}
+	assert_eq(cstring(got.slice(0, 6)), "header");
+	for (size_t i=0;i<1024*1024;i++)
+	{
+		if (got[6+i] != (uint8_t)(i ^ (i>>8)))
+			assert_eq(got[6+i], (uint8_t)(i ^ (i>>8)));
+	}
+	assert(co_await sa.await_send());
+}
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+co_test("socket zero-copy", "tcp", "")
+{
+	int port = time(NULL)%3600 + 17200;
+	
+	autoptr<socket2> b;
+	autoptr<socketlisten> lst = socketlisten::create(port, [&](autoptr<socket2> s) { b = std::move(s); });
+	assert(lst);
+	autoptr<socket2> a_sock = co_await socket2::create(socket2::address("[::1]", port));
+	assert(a_sock);
+	int a_fd = a_sock->get_fd();
+	socketbuf a = std::move(a_sock);
+	if (!a.enable_zerocopy())
+		test_skip_force("kernel doesn't support MSG_ZEROCOPY");
+	timestamp end = timestamp::in_ms(5000);
+	while (!b && timestamp::now() < end)
+		co_await runloop2::in_ms(1);
+	assert(b);
+	
+	// loopback copies anyway, but the notifications and buffer handling are the same
+	static const size_t size = 1024*1024;
+	bytearray big1;
+	bytearray big2;
+	big1.resize(size);
+	big2.resize(size);
+	for (size_t i=0;i<size;i++)
+	{
+		big1[i] = i ^ (i>>8);
+		big2[i] = i ^ (i>>12);
+	}
+	a.send("head");
+	a.send(std::move(big1));
+	a.send_buf(cstring("er").bytes());
+	a.send_buf(std::move(big2));
+	a.send_flush();
+	
+	bytearray got;
+	while (got.size() < 6 + size*2)
+	{
+		co_await b->can_recv();
+		size_t prev = got.size();
+		got.resize(prev + 65536);
+		ssize_t n = b->recv_sync(got.skip(prev));
+		assert_gte(n, 0);
+		got.resize(prev + n);
+	}
+	assert_eq(cstring(got.slice(0, 4)), "head");
+	assert_eq(cstring(got.slice(4+size, 2)), "er");
+	for (size_t i=0;i<size;i++)
+	{
+		if (got[4+i] != (uint8_t)(i ^ (i>>8)))
+			assert_eq(got[4+i], (uint8_t)(i ^ (i>>8)));
+		if (got[6+size+i] != (uint8_t)(i ^ (i>>12)))
+			assert_eq(got[6+size+i], (uint8_t)(i ^ (i>>12)));
+	}
+	assert(co_await a.await_send());
+	
+	// small sends don't use zero-copy, but must still work
+	a.send("abc");
+	uint8_t tmp[4];
+	co_await b->can_recv();
+	assert_eq(b->recv_sync(tmp), 3);
+	assert_eq(cstring(bytesr(tmp, 3)), "abc");
+	
+	// closing while the kernel may still use the buffers keeps the fd open, but the peer must still see the end
+	// this is too big to send at once, so the socketbuf is deleted with a partially sent buffer, which must not be freed
+	static const size_t size3 = size*4;
+	bytearray big3;
+	big3.resize(size3);
+	for (size_t i=0;i<size3;i++)
+		big3[i] = i ^ (i>>10);
+	a.send(std::move(big3));
+	a.reset();
+	bytearray scribble; // if big3 was freed, this would likely reuse its memory
+	scribble.resize(size3);
+	memset(scribble.ptr(), 0xAA, size3);
+	
+	bytearray tail;
+	end = timestamp::in_ms(5000);
+	while (timestamp::now() < end)
+	{
+		co_await b->can_recv();
+		size_t prev = tail.size();
+		tail.resize(prev + 65536);
+		ssize_t n = b->recv_sync(tail.skip(prev));
+		tail.resize(prev + max(n, 0));
+		if (n < 0)
+			break;
+	}
+	assert_eq(errno, ESHUTDOWN);
+	assert(tail.size() > 0);
+	assert_lt(tail.size(), size3);
+	for (size_t i=0;i<tail.size();i++)
+	{
+		if (tail[i] != (uint8_t)(i ^ (i>>10)))
+			assert_eq(tail[i], (uint8_t)(i ^ (i>>10)));
+	}
+	
+	// and once the kernel is done, the fd is closed
+	end = timestamp::in_ms(5000);
+	while (fcntl(a_fd, F_GETFD) >= 0 && timestamp::now() < end)
+		co_await runloop2::in_ms(10);
+	assert_lt(fcntl(a_fd, F_GETFD), 0);
+}
+#endif
+
+
+#ifdef __unix__
+// hides the fd, so relay() has to copy
+struct fdless_socket : public socket2 {
+	autoptr<socket2> inner;
+	fdless_socket(autoptr<socket2> inner) : inner(std::move(inner)) {}
+	ssize_t recv_sync(bytesw by) override { return inner->recv_sync(by); }
+	ssize_t send_sync(bytesr by) override { return inner->send_sync(by); }
+	async<void> can_recv() override { return inner->can_recv(); }
+	async<void> can_send() override { return inner->can_send(); }
+	void shutdown_send() override { inner->shutdown_send(); }
+};
+
+static async<void> relay_test(bool use_fd)
+{
+	int fds_a[2];
+	int fds_b[2];
+	assert_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds_a), 0);
+	assert_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds_b), 0);
+	autoptr<socket2> a_out = socket2::create_from_fd(fds_a[0]);
+	autoptr<socket2> a_in = socket2::create_from_fd(fds_a[1]);
+	autoptr<socket2> b_in = socket2::create_from_fd(fds_b[0]);
+	autoptr<socket2> b_out = socket2::create_from_fd(fds_b[1]);
+	if (!use_fd)
+		a_in = new fdless_socket(std::move(a_in));
+	
+	async<socket2::relay_stats> relay = socket2::relay(a_in, b_in);
+	
+	bytearray big;
+	big.resize(1024*1024);
+	for (size_t i=0;i<big.size();i++)
+		big[i] = i ^ (i>>8);
+	
+	assert_eq(b_out->send_sync(cstring("hello").bytes()), 5);
+	
+	size_t n_sent = 0;
+	bytearray got;
+	while (got.size() < big.size())
+	{
+		if (n_sent < big.size())
+		{
+			ssize_t n = a_out->send_sync(big.skip(n_sent));
+			assert_gte(n, 0);
+			n_sent += n;
+			if (n_sent == big.size())
+				a_out->shutdown_send();
+		}
+		co_await b_out->can_recv();
+		size_t prev = got.size();
+		got.resize(prev + 65536);
+		ssize_t n = b_out->recv_sync(got.skip(prev));
+		assert_gte(n, 0);
+		got.resize(prev + n);
+	}
+	assert(got == big);
+	
+	// a closed its side, so b should see that, but the other direction still works
+	co_await b_out->can_recv();
+	uint8_t tmp[16];
+	assert_eq(b_out->recv_sync(tmp), -1);
+	assert_eq(errno, ESHUTDOWN);
+	
+	assert_eq(b_out->send_sync(cstring(" world").bytes()), 6);
+	b_out->shutdown_send();
+	
+	bytearray got2;
+	while (true)
+	{
+		co_await a_out->can_recv();
+		ssize_t n = a_out->recv_sync(tmp);
+		if (n < 0)
+			break;
+		got2 += bytesr(tmp, n);
+	}
+	assert_eq(errno, ESHUTDOWN);
+	assert_eq(cstring(got2), "hello world");
+	
+	socket2::relay_stats stats = co_await relay;
+	assert_eq(stats.a_to_b, big.size());
+	assert_eq(stats.b_to_a, 11);
+	assert_eq(stats.error, 0);
+}
+co_test("socket relay", "tcp", "")
+{
+	testctx("splice") co_await relay_test(true);
+	testctx("buffered") co_await relay_test(false);
+}
+#endif
+
+#ifdef __unix__
+co_test("UDP batching", "", "udp")
+{
+	int port = time(NULL)%3600 + 17400;
+	autoptr<socket2_udp> server = socket2_udp::create_bound(socket2::address("[::1]", port));
+	assert(server);
+	autoptr<socket2_udp> client = socket2_udp::create(socket2::address("[::1]", port));
+	assert(client);
+	
+	// plain batches
+	socket2_udp::datagram out[100];
+	uint8_t out_bytes[100];
+	for (int i=0;i<100;i++)
+	{
+		out_bytes[i] = i;
+		out[i].buf = bytesw(&out_bytes[i], 1);
+	}
+	assert_eq(client->send_many(out), 100);
+	
+	uint8_t in_bytes[100][4];
+	socket2_udp::datagram in[100];
+	size_t n_in = 0;
+	while (n_in < 100)
+	{
+		for (size_t i=n_in;i<100;i++)
+			in[i].buf = in_bytes[i];
+		co_await server->can_recv();
+		ssize_t n = server->recv_many(arrayvieww<socket2_udp::datagram>(in).skip(n_in));
+		assert_gte(n, 0);
+		n_in += n;
+	}
+	for (int i=0;i<100;i++)
+	{
+		assert_eq(in[i].buf.size(), 1);
+		assert_eq(in[i].buf[0], i);
+		assert_eq(in[i].segment_size, 0);
+	}
+	
+	// reply to the sender
+	socket2_udp::datagram reply;
+	reply.buf = bytesw((uint8_t*)"pong", 4);
+	reply.addr = in[0].addr;
+	assert_eq(server->send_many(arrayview<socket2_udp::datagram>(&reply, 1)), 1);
+	co_await client->can_recv();
+	uint8_t reply_bytes[16];
+	assert_eq(client->recv_sync(reply_bytes), 4);
+	assert_eq(cstring(bytesr(reply_bytes, 4)), "pong");
+	
+	// one GSO send becomes eight datagrams, possibly coalesced again by GRO
+	server->enable_gro(); // if unsupported, the datagrams arrive separately, which is fine too
+	uint8_t gso_bytes[8*100];
+	for (size_t i=0;i<sizeof(gso_bytes);i++)
+		gso_bytes[i] = i/100;
+	socket2_udp::datagram gso;
+	gso.buf = gso_bytes;
+	gso.segment_size = 100;
+	ssize_t n_gso = client->send_many(arrayview<socket2_udp::datagram>(&gso, 1));
+	if (n_gso < 0 && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT))
+		test_skip_force("kernel doesn't support UDP GSO");
+	assert_eq(n_gso, 1);
+	
+	uint8_t gro_bytes[8][65536];
+	socket2_udp::datagram gro_in[8];
+	bytearray got;
+	while (got.size() < sizeof(gso_bytes))
+	{
+		for (size_t i=0;i<8;i++)
+			gro_in[i].buf = gro_bytes[i];
+		co_await server->can_recv();
+		ssize_t n = server->recv_many(gro_in);
+		assert_gte(n, 0);
+		for (ssize_t i=0;i<n;i++)
+		{
+			if (gro_in[i].segment_size)
+				assert_eq(gro_in[i].segment_size, 100);
+			else
+				assert_eq(gro_in[i].buf.size(), 100);
+			got += gro_in[i].buf;
+		}
+	}
+	assert(got == bytesr(gso_bytes));
+}
+#endif
+
 struct fake_socket : public socket2 {
 	ssize_t ret = 0;
 	producer<void> recv_wait;
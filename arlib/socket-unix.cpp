@@ -7,6 +7,11 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <limits.h>
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <netinet/udp.h>
+#endif
 
 static int mksocket(int domain, int type, int protocol)
 {
@@ -61,12 +66,132 @@ static void configure_sock(int fd)
 	setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, 10); // seconds per ping once the pings start
 }
 
+#ifdef SO_ZEROCOPY
+// The kernel numbers each successful MSG_ZEROCOPY send call, starting from zero, and once it no longer needs the buffers,
+//  it puts a notification with a range of such numbers on the socket's error queue.
+// While buffers are held, a runloop timer collects the notifications, so they're freed even if the socket is idle.
+struct zerocopy_state : nomove {
+	int fd;
+	uint32_t sent = 0;
+	uint32_t released = 0; // every send before this is done
+	struct range { uint32_t lo; uint32_t hi; };
+	array<range> early; // ranges that arrived before some earlier one; shouldn't happen for TCP, but let's not rely on that
+	struct held_t { bytearray buf; uint32_t until; };
+	array<held_t> held;
+	
+	bool busy() const { return sent != released; }
+	
+	zerocopy_state(int fd) : fd(fd) {}
+	
+	waiter<void> timer = make_waiter<&zerocopy_state::timer, &zerocopy_state::tick>();
+	int interval_ms = 10;
+	bool lingering = false;
+	timestamp deadline;
+	
+	void arm()
+	{
+		if (!timer.is_waiting())
+			runloop2::in_ms(interval_ms).then(&timer);
+	}
+	void tick()
+	{
+		collect();
+		if (lingering)
+		{
+			if (!busy() || timestamp::now() > deadline)
+			{
+				close(fd);
+				delete this;
+				return;
+			}
+			interval_ms = min(interval_ms*2, 1000);
+			arm();
+		}
+		else if (held.size())
+			arm();
+	}
+	
+	// If a socket is closed while the kernel still uses its buffers, freeing them could change data that's yet to be sent,
+	//  or retransmitted. Such sockets are kept open until the kernel is done, or for a minute at most; this object then
+	//  owns the fd, and deletes itself once done. The sending half is shut down immediately, so the peer sees the FIN.
+	void linger()
+	{
+		shutdown(fd, SHUT_WR);
+		lingering = true;
+		deadline = timestamp::in_ms(60000);
+		arm();
+	}
+	
+	void release(uint32_t lo, uint32_t hi)
+	{
+		if (lo != released)
+		{
+			early.append({ lo, hi });
+			return;
+		}
+		released = hi+1;
+	again:
+		for (size_t i=0;i<early.size();i++)
+		{
+			if (early[i].lo == released)
+			{
+				released = early[i].hi+1;
+				early.remove(i);
+				goto again;
+			}
+		}
+	}
+	
+	void collect()
+	{
+		while (busy())
+		{
+			alignas(cmsghdr) char control[128];
+			msghdr msg = {};
+			msg.msg_control = control;
+			msg.msg_controllen = sizeof(control);
+			if (recvmsg(fd, &msg, MSG_ERRQUEUE|MSG_DONTWAIT) < 0)
+				break;
+			for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+			{
+				if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+				    !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+					continue;
+				sock_extended_err* err = (sock_extended_err*)CMSG_DATA(cm);
+				if (err->ee_origin == SO_EE_ORIGIN_ZEROCOPY && err->ee_errno == 0)
+					release(err->ee_info, err->ee_data);
+			}
+		}
+		
+		size_t n_done = 0;
+		while (n_done < held.size() && (int32_t)(released - held[n_done].until) >= 0)
+			n_done++;
+		if (n_done)
+			held.remove_range(0, n_done);
+	}
+};
+
+#endif
+
 class socket2_impl : public socket2 {
 public:
 	int fd;
+#ifdef SO_ZEROCOPY
+	autoptr<zerocopy_state> zc;
+	
+	void zc_collect()
+	{
+		if (zc && zc->busy())
+			zc->collect();
+	}
+#else
+	void zc_collect() {}
+#endif
+	
 	socket2_impl(int fd) : fd(fd) {}
 	ssize_t recv_sync(bytesw by) override
 	{
+		zc_collect();
 #ifndef ARLIB_OPT
 		if (!by)
 			debug_fatal_stack("cannot receive zero bytes");
@@ -75,17 +200,335 @@ public:
 	}
 	ssize_t send_sync(bytesr by) override
 	{
+		zc_collect();
 #ifndef ARLIB_OPT
 		if (!by)
 			debug_fatal_stack("cannot send zero bytes");
 #endif
 		return fixret(::send(fd, (char*)by.ptr(), by.size(), MSG_DONTWAIT|MSG_NOSIGNAL));
 	}
+	// not readv/writev; they can't take MSG_NOSIGNAL
+	ssize_t recvv_sync(arrayview<iovec> bufs) override
+	{
+		zc_collect();
+#ifndef ARLIB_OPT
+		if (!bufs || !bufs[0].iov_len)
+			debug_fatal_stack("cannot receive zero bytes");
+#endif
+		msghdr msg = {};
+		msg.msg_iov = (iovec*)bufs.ptr();
+		msg.msg_iovlen = min(bufs.size(), IOV_MAX);
+		return fixret(::recvmsg(fd, &msg, MSG_DONTWAIT|MSG_NOSIGNAL));
+	}
+	ssize_t sendv_sync(arrayview<iovec> bufs) override
+	{
+		zc_collect();
+#ifndef ARLIB_OPT
+		if (!bufs || !bufs[0].iov_len)
+			debug_fatal_stack("cannot send zero bytes");
+#endif
+		msghdr msg = {};
+		msg.msg_iov = (iovec*)bufs.ptr();
+		msg.msg_iovlen = min(bufs.size(), IOV_MAX);
+		return fixret(::sendmsg(fd, &msg, MSG_DONTWAIT|MSG_NOSIGNAL));
+	}
+	
+#ifdef SO_ZEROCOPY
+	bool enable_zerocopy() override
+	{
+		if (zc)
+			return true;
+		if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, 1) < 0)
+			return false;
+		zc = new zerocopy_state(fd);
+		return true;
+	}
+	ssize_t sendv_zerocopy_sync(arrayview<iovec> bufs) override
+	{
+		if (!zc)
+			return sendv_sync(bufs);
+#ifndef ARLIB_OPT
+		if (!bufs || !bufs[0].iov_len)
+			debug_fatal_stack("cannot send zero bytes");
+#endif
+		zc_collect();
+		msghdr msg = {};
+		msg.msg_iov = (iovec*)bufs.ptr();
+		msg.msg_iovlen = min(bufs.size(), IOV_MAX);
+		ssize_t n = ::sendmsg(fd, &msg, MSG_DONTWAIT|MSG_NOSIGNAL|MSG_ZEROCOPY);
+		if (n < 0 && errno == ENOBUFS) // too many notifications pending; the kernel documentation says to copy instead
+			return sendv_sync(bufs);
+		if (n > 0)
+			zc->sent++;
+		return fixret(n);
+	}
+	void zerocopy_hold(bytearray by) override
+	{
+		zc_collect();
+		if (zc && zc->busy())
+		{
+			zc->held.append({ std::move(by), zc->sent });
+			zc->arm();
+		}
+	}
+#endif
+	
 	async<void> can_recv() override { return runloop2::await_read(fd); }
 	async<void> can_send() override { return runloop2::await_write(fd); }
+	void shutdown_send() override { ::shutdown(fd, SHUT_WR); }
 	int get_fd() override { return fd; }
-	~socket2_impl() { close(fd); }
+	~socket2_impl()
+	{
+#ifdef SO_ZEROCOPY
+		if (zc)
+		{
+			zc_collect();
+			if (zc->busy())
+			{
+				zc.release()->linger();
+				return;
+			}
+		}
+#endif
+		close(fd);
+	}
 };
+
+#ifdef ARLIB_RUNLOOP_URING
+// With the io_uring runloop, the socket's I/O is done by ring requests, submitted in the same syscall as everything else
+//  the runloop does. The API is still synchronous: can_recv() starts a receive into a buffer, and recv_sync() copies out
+//  of it; send_sync() copies into a buffer, which is sent in the background.
+// The fd is blocking, so the requests wait in the kernel, rather than failing with EAGAIN.
+// A send may still be going when the socket is deleted; like close(), the rest is then sent before the fd is closed,
+//  so this state is a separate object, which deletes itself once done. A pending receive is cancelled.
+struct uring_state : nomove {
+	int fd;
+	bool detached = false;
+	
+	static const size_t recv_size = 16384;
+	uint8_t* rbuf = (uint8_t*)xmalloc(recv_size);
+	size_t rstart = 0;
+	size_t rend = 0;
+	int rerr = 0; // errno, or ESHUTDOWN at the end of the stream
+	waiter<int> recv_wait = make_waiter<&uring_state::recv_wait, &uring_state::recv_done>();
+	producer<void> recv_prod;
+	
+	static const size_t send_size = 65536;
+	uint8_t* sbuf = (uint8_t*)xmalloc(send_size);
+	size_t slen = 0; // the start of this is in a send request, if one is in flight
+	int serr = 0;
+	bool shut_pending = false;
+	waiter<int> send_wait = make_waiter<&uring_state::send_wait, &uring_state::send_done>();
+	producer<void> send_prod;
+	
+	uring_state(int fd) : fd(fd) {}
+	~uring_state()
+	{
+		free(rbuf);
+		free(sbuf);
+	}
+	
+	void recv_start()
+	{
+		if (recv_wait.is_waiting() || rerr)
+			return;
+		io_uring_sqe sqe = {};
+		sqe.opcode = IORING_OP_RECV;
+		sqe.fd = fd;
+		sqe.addr = (uintptr_t)rbuf;
+		sqe.len = recv_size;
+		sqe.msg_flags = MSG_NOSIGNAL;
+		// if the socket is deleted, the buffer belongs to the request until it's done
+		runloop2::ring_op(sqe, [buf = rbuf](int) { free(buf); }).then(&recv_wait);
+	}
+	void recv_done(int res)
+	{
+		if (res > 0)
+		{
+			rstart = 0;
+			rend = res;
+		}
+		else
+			rerr = (res == 0 ? ESHUTDOWN : -res);
+		if (recv_prod.has_waiter())
+			recv_prod.complete();
+	}
+	async<void> can_recv()
+	{
+		if (rstart != rend || rerr)
+			return producer<void>::complete_sync();
+		recv_start();
+		return &recv_prod;
+	}
+	ssize_t recv(arrayview<iovec> bufs)
+	{
+		if (rstart == rend)
+		{
+			if (rerr)
+			{
+				errno = rerr;
+				return -1;
+			}
+			recv_start();
+			return 0;
+		}
+		size_t total = 0;
+		for (const iovec& v : bufs)
+		{
+			size_t n = min(v.iov_len, rend-rstart);
+			memcpy(v.iov_base, rbuf+rstart, n);
+			rstart += n;
+			total += n;
+			if (rstart == rend)
+				break;
+		}
+		return total;
+	}
+	
+	void send_start()
+	{
+		if (send_wait.is_waiting() || !slen)
+			return;
+		io_uring_sqe sqe = {};
+		sqe.opcode = IORING_OP_SEND;
+		sqe.fd = fd;
+		sqe.addr = (uintptr_t)sbuf;
+		sqe.len = slen;
+		sqe.msg_flags = MSG_NOSIGNAL;
+		// sends are never cancelled, so no orphan handler
+		runloop2::ring_op(sqe).then(&send_wait);
+	}
+	void send_done(int res)
+	{
+		if (res < 0)
+		{
+			serr = -res;
+			slen = 0;
+		}
+		else
+		{
+			memmove(sbuf, sbuf+res, slen-res);
+			slen -= res;
+		}
+		if (!slen && shut_pending)
+		{
+			shutdown(fd, SHUT_WR);
+			shut_pending = false;
+		}
+		send_start();
+		if (detached)
+			finish_if_done();
+		else if (send_prod.has_waiter())
+			send_prod.complete();
+	}
+	async<void> can_send()
+	{
+		if (slen < send_size || serr)
+			return producer<void>::complete_sync();
+		return &send_prod;
+	}
+	ssize_t send(arrayview<iovec> bufs)
+	{
+		if (serr)
+		{
+			errno = serr;
+			return -1;
+		}
+		size_t total = 0;
+		for (const iovec& v : bufs)
+		{
+			size_t n = min(v.iov_len, send_size-slen);
+			memcpy(sbuf+slen, v.iov_base, n);
+			slen += n;
+			total += n;
+			if (slen == send_size)
+				break;
+		}
+		send_start();
+		return total;
+	}
+	void shutdown_send()
+	{
+		if (slen)
+			shut_pending = true;
+		else
+			shutdown(fd, SHUT_WR);
+	}
+	
+	void detach()
+	{
+		detached = true;
+		if (recv_wait.is_waiting())
+		{
+			rbuf = nullptr; // the request's orphan handler frees it
+			recv_wait.cancel();
+		}
+		finish_if_done();
+	}
+	void finish_if_done()
+	{
+		if (slen)
+			return;
+		close(fd);
+		delete this;
+	}
+};
+
+class socket2_uring : public socket2 {
+public:
+	uring_state* st;
+	
+	socket2_uring(int fd) : st(new uring_state(fd)) { socket2::set_fd_block(fd, true); }
+	ssize_t recv_sync(bytesw by) override
+	{
+#ifndef ARLIB_OPT
+		if (!by)
+			debug_fatal_stack("cannot receive zero bytes");
+#endif
+		iovec v = { by.ptr(), by.size() };
+		return st->recv(arrayview<iovec>(&v, 1));
+	}
+	ssize_t send_sync(bytesr by) override
+	{
+#ifndef ARLIB_OPT
+		if (!by)
+			debug_fatal_stack("cannot send zero bytes");
+#endif
+		iovec v = { (void*)by.ptr(), by.size() };
+		return st->send(arrayview<iovec>(&v, 1));
+	}
+	ssize_t recvv_sync(arrayview<iovec> bufs) override
+	{
+#ifndef ARLIB_OPT
+		if (!bufs || !bufs[0].iov_len)
+			debug_fatal_stack("cannot receive zero bytes");
+#endif
+		return st->recv(bufs);
+	}
+	ssize_t sendv_sync(arrayview<iovec> bufs) override
+	{
+#ifndef ARLIB_OPT
+		if (!bufs || !bufs[0].iov_len)
+			debug_fatal_stack("cannot send zero bytes");
+#endif
+		return st->send(bufs);
+	}
+	
+	async<void> can_recv() override { return st->can_recv(); }
+	async<void> can_send() override { return st->can_send(); }
+	void shutdown_send() override { st->shutdown_send(); }
+	~socket2_uring() { st->detach(); }
+};
+#endif
+
+static socket2* wrap_fd(int fd)
+{
+#ifdef ARLIB_RUNLOOP_URING
+	return new socket2_uring(fd);
+#else
+	return new socket2_impl(fd);
+#endif
+}
 }
 
 async<autoptr<socket2>> socket2::create(address addr)
@@ -117,13 +560,13 @@ async<autoptr<socket2>> socket2::create(address addr)
 		goto fail;
 	}
 	
-	co_return new socket2_impl(fd);
+	co_return wrap_fd(fd);
 }
 
 autoptr<socket2> socket2::create_from_fd(fd_t fd)
 {
 	set_fd_nonblock(fd);
-	return new socket2_impl(fd.release());
+	return wrap_fd(fd.release());
 }
 
 
@@ -148,21 +591,186 @@ void socket2_udp::send(bytesr by)
 	::sendto(fd, by.ptr(), by.size(), MSG_DONTWAIT|MSG_NOSIGNAL, addr.as_native(), sizeof(addr));
 }
 
+autoptr<socket2_udp> socket2_udp::create_bound(socket2::address local)
+{
+	if (!local)
+		return nullptr;
+	int fd = mksocket(local.as_native()->sa_family, SOCK_DGRAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return nullptr;
+	if (bind(fd, local.as_native(), sizeof(local)) < 0)
+	{
+		close(fd);
+		return nullptr;
+	}
+	return new socket2_udp(fd, socket2::address());
+}
 
-autoptr<socketlisten> socketlisten::create(const socket2::address & addr, function<void(autoptr<socket2>)> cb)
+#ifdef __linux__
+static const size_t udp_batch = 64;
+
+ssize_t socket2_udp::recv_many(arrayvieww<datagram> dgrams)
+{
+	size_t total = 0;
+	while (total < dgrams.size())
+	{
+		size_t n = min(dgrams.size()-total, udp_batch);
+		mmsghdr msgs[udp_batch];
+		iovec iovs[udp_batch];
+		alignas(cmsghdr) char control[udp_batch][CMSG_SPACE(sizeof(int))];
+		memset(msgs, 0, sizeof(*msgs)*n);
+		for (size_t i=0;i<n;i++)
+		{
+			datagram& dg = dgrams[total+i];
+			iovs[i] = { dg.buf.ptr(), dg.buf.size() };
+			msgs[i].msg_hdr.msg_name = dg.addr.as_native();
+			msgs[i].msg_hdr.msg_namelen = sizeof(dg.addr);
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_control = control[i];
+			msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+		}
+		int ret = recvmmsg(fd, msgs, n, MSG_DONTWAIT, nullptr);
+		if (ret < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return total ? (ssize_t)total : -1;
+		}
+		for (int i=0;i<ret;i++)
+		{
+			datagram& dg = dgrams[total+i];
+			dg.buf = dg.buf.slice(0, min(msgs[i].msg_len, dg.buf.size()));
+			dg.segment_size = 0;
+			for (cmsghdr* cm = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cm; cm = CMSG_NXTHDR(&msgs[i].msg_hdr, cm))
+			{
+				if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO)
+					dg.segment_size = *(int*)CMSG_DATA(cm);
+			}
+		}
+		total += ret;
+		if ((size_t)ret < n)
+			break;
+	}
+	return total;
+}
+
+ssize_t socket2_udp::send_many(arrayview<datagram> dgrams)
+{
+	size_t total = 0;
+	while (total < dgrams.size())
+	{
+		size_t n = min(dgrams.size()-total, udp_batch);
+		mmsghdr msgs[udp_batch];
+		iovec iovs[udp_batch];
+		alignas(cmsghdr) char control[udp_batch][CMSG_SPACE(sizeof(uint16_t))];
+		memset(msgs, 0, sizeof(*msgs)*n);
+		for (size_t i=0;i<n;i++)
+		{
+			const datagram& dg = dgrams[total+i];
+			const socket2::address& dest = (dg.addr ? dg.addr : addr);
+			iovs[i] = { (void*)dg.buf.ptr(), dg.buf.size() };
+			msgs[i].msg_hdr.msg_name = dest.as_native();
+			msgs[i].msg_hdr.msg_namelen = sizeof(dest);
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			if (dg.segment_size)
+			{
+				msgs[i].msg_hdr.msg_control = control[i];
+				msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+				cmsghdr* cm = CMSG_FIRSTHDR(&msgs[i].msg_hdr);
+				cm->cmsg_level = SOL_UDP;
+				cm->cmsg_type = UDP_SEGMENT;
+				cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+				*(uint16_t*)CMSG_DATA(cm) = dg.segment_size;
+			}
+		}
+		int ret = sendmmsg(fd, msgs, n, MSG_DONTWAIT|MSG_NOSIGNAL);
+		if (ret < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return total ? (ssize_t)total : -1;
+		}
+		total += ret;
+		if ((size_t)ret < n)
+			break;
+	}
+	return total;
+}
+
+bool socket2_udp::enable_gro()
+{
+	return setsockopt(fd, SOL_UDP, UDP_GRO, true) == 0;
+}
+#else
+ssize_t socket2_udp::recv_many(arrayvieww<datagram> dgrams)
+{
+	size_t total = 0;
+	for (datagram& dg : dgrams)
+	{
+		socklen_t addrsize = sizeof(dg.addr);
+		ssize_t n = ::recvfrom(fd, dg.buf.ptr(), dg.buf.size(), MSG_DONTWAIT, dg.addr.as_native(), &addrsize);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (n < 0)
+			return total ? (ssize_t)total : -1;
+		dg.buf = dg.buf.slice(0, min((size_t)n, dg.buf.size()));
+		dg.segment_size = 0;
+		total++;
+	}
+	return total;
+}
+
+ssize_t socket2_udp::send_many(arrayview<datagram> dgrams)
+{
+	size_t total = 0;
+	for (const datagram& dg : dgrams)
+	{
+		const socket2::address& dest = (dg.addr ? dg.addr : addr);
+		if (dg.segment_size)
+		{
+			errno = EINVAL;
+			return total ? (ssize_t)total : -1;
+		}
+		ssize_t n = ::sendto(fd, dg.buf.ptr(), dg.buf.size(), MSG_DONTWAIT|MSG_NOSIGNAL, dest.as_native(), sizeof(dest));
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (n < 0)
+			return total ? (ssize_t)total : -1;
+		total++;
+	}
+	return total;
+}
+
+bool socket2_udp::enable_gro() { return false; }
+#endif
+
+
+static int mklisten(const socket2::address & addr, bool reuseport, int backlog)
 {
 	int fd = mksocket(AF_INET6, SOCK_STREAM, 0);
-	if (fd < 0) return nullptr;
+	if (fd < 0) return -1;
 	
 	if (setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, false) < 0) goto fail;
 	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, true) < 0) goto fail;
+#ifdef SO_REUSEPORT
+	if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, true) < 0) goto fail;
+#endif
 	if (bind(fd, addr.as_native(), sizeof(addr)) < 0) goto fail;
-	if (listen(fd, 10) < 0) goto fail;
-	return new socketlisten(fd, std::move(cb));
+	if (listen(fd, backlog) < 0) goto fail;
+	return fd;
 	
 fail:
 	close(fd);
-	return nullptr;
+	return -1;
+}
+
+autoptr<socketlisten> socketlisten::create(const socket2::address & addr, function<void(autoptr<socket2>)> cb)
+{
+	int fd = mklisten(addr, false, 10);
+	if (fd < 0) return nullptr;
+	return new socketlisten(fd, std::move(cb));
 }
 
 autoptr<socketlisten> socketlisten::create(uint16_t port, function<void(autoptr<socket2>)> cb)
@@ -173,8 +781,12 @@ autoptr<socketlisten> socketlisten::create(uint16_t port, function<void(autoptr<
 
 socketlisten::socketlisten(fd_t fd, function<void(autoptr<socket2>)> cb) : cb(std::move(cb)), fd(std::move(fd))
 {
+#ifdef ARLIB_RUNLOOP_URING
+	accept_start(); // the fd stays blocking, so the request waits in the kernel
+#else
 	socket2::set_fd_nonblock(this->fd);
 	runloop2::await_read(this->fd).then(&wait);
+#endif
 }
 
 void socketlisten::on_incoming()
@@ -187,8 +799,112 @@ void socketlisten::on_incoming()
 	if (nfd >= 0)
 	{
 		configure_sock(nfd);
-		this->cb(new socket2_impl(nfd));
+		this->cb(wrap_fd(nfd));
 	}
 	runloop2::await_read(fd).then(&wait);
 }
+
+#ifdef ARLIB_RUNLOOP_URING
+void socketlisten::accept_start()
+{
+	io_uring_sqe sqe = {};
+	sqe.opcode = IORING_OP_ACCEPT;
+	sqe.fd = fd;
+	sqe.accept_flags = SOCK_CLOEXEC;
+	// if the socketlisten is deleted, the request may still accept a connection
+	runloop2::ring_op(sqe, [](int nfd) { if (nfd >= 0) close(nfd); }).then(&accept_wait);
+}
+
+void socketlisten::on_accept(int nfd)
+{
+	accept_start();
+	if (nfd >= 0)
+	{
+		configure_sock(nfd);
+		this->cb(wrap_fd(nfd));
+	}
+}
+#endif
+
+#if defined(__linux__) && defined(ARLIB_THREAD)
+struct socketlisten_multi::reactor {
+	socketlisten_multi* parent;
+	fd_t fd;
+	runloop_mailbox* box;
+	producer<void> stop;
+	
+	void threadproc()
+	{
+		socketlisten_multi* parent = this->parent; // this object is deleted as soon as exited is released
+		{
+			runloop_mailbox box;
+			socketlisten lst(std::move(fd), parent->cb);
+			this->box = &box;
+			parent->started.release();
+			runloop2::run(&stop);
+		}
+#ifdef ARLIB_RUNLOOP_URING
+		runloop2::step(false); // submit the accept's cancellation; the loop is never stepped again, and the request would keep the port
+#endif
+		parent->exited.release();
+	}
+};
+
+autoptr<socketlisten_multi> socketlisten_multi::create(const socket2::address & addr, function<void(autoptr<socket2>)> cb, unsigned n_threads)
+{
+	if (!n_threads)
+		n_threads = thread_num_cores();
+	
+	socket2::address bind_addr = addr;
+	array<fd_t> fds;
+	for (unsigned i=0;i<n_threads;i++)
+	{
+		int fd = mklisten(bind_addr, true, SOMAXCONN);
+		if (fd < 0)
+			return nullptr;
+		fds.append(fd);
+		
+		// if the caller asked for any port, the kernel picked one for the first socket, and the others must use the same
+		if (bind_addr.port() == 0)
+		{
+			socklen_t len = sizeof(bind_addr);
+			if (getsockname(fd, bind_addr.as_native(), &len) < 0)
+				return nullptr;
+		}
+	}
+	return new socketlisten_multi(std::move(fds), std::move(cb));
+}
+
+autoptr<socketlisten_multi> socketlisten_multi::create(uint16_t port, function<void(autoptr<socket2>)> cb, unsigned n_threads)
+{
+	static const uint8_t localhost[16] = { 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1 };
+	return create(socket2::address(localhost, port), std::move(cb), n_threads);
+}
+
+socketlisten_multi::socketlisten_multi(array<fd_t> fds, function<void(autoptr<socket2>)> cb) : cb(std::move(cb))
+{
+	n_reactors = fds.size();
+	reactors = new reactor[n_reactors];
+	for (unsigned i=0;i<n_reactors;i++)
+	{
+		reactors[i].parent = this;
+		reactors[i].fd = std::move(fds[i]);
+		thread_create(bind_ptr(&reactor::threadproc, &reactors[i]));
+	}
+	for (unsigned i=0;i<n_reactors;i++)
+		started.wait();
+}
+
+socketlisten_multi::~socketlisten_multi()
+{
+	for (unsigned i=0;i<n_reactors;i++)
+	{
+		reactor* r = &reactors[i];
+		r->box->post([r]() { r->stop.complete(); });
+	}
+	for (unsigned i=0;i<n_reactors;i++)
+		exited.wait();
+	delete[] reactors;
+}
+#endif
 #endif
@@ -110,6 +110,7 @@ public:
 		send_wouldblock = (ret == 0);
 		return ret;
 	}
+	void shutdown_send() override { ::shutdown(fd, SD_SEND); }
 	async<void> can_recv() override
 	{
 		ev_active |= FD_READ|FD_CLOSE;
@@ -193,7 +194,67 @@ ssize_t socket2_udp::recv_sync(bytesw by, socket2::address* sender)
 
 void socket2_udp::send(bytesr by)
 {
-	::sendto(sock, (char*)by.ptr(), by.size(), 0, addr.as_native(), sizeof(addr));
+	int ret = ::sendto(sock, (char*)by.ptr(), by.size(), 0, addr.as_native(), sizeof(addr));
+	send_wouldblock = (ret < 0 && WSAGetLastError() == WSAEWOULDBLOCK);
+}
+
+autoptr<socket2_udp> socket2_udp::create_bound(socket2::address local)
+{
+	if (!local)
+		return nullptr;
+	SOCKET sock = mksocket(local.as_native()->sa_family, SOCK_DGRAM, 0);
+	if (sock < 0)
+		return nullptr;
+	if (bind(sock, local.as_native(), sizeof(local)) < 0)
+	{
+		closesocket(sock);
+		return nullptr;
+	}
+	return new socket2_udp(sock, socket2::address());
+}
+
+ssize_t socket2_udp::recv_many(arrayvieww<datagram> dgrams)
+{
+	size_t total = 0;
+	for (datagram& dg : dgrams)
+	{
+		// the socket is blocking, so ask first
+		u_long avail = 0;
+		if (ioctlsocket(sock, FIONREAD, &avail) != 0 || avail == 0)
+			break;
+		socklen_t addrsize = sizeof(dg.addr);
+		int n = ::recvfrom(sock, (char*)dg.buf.ptr(), dg.buf.size(), 0, dg.addr.as_native(), &addrsize);
+		if (n < 0 && WSAGetLastError() == WSAEMSGSIZE)
+			n = dg.buf.size();
+		if (n < 0)
+			return total ? (ssize_t)total : -1;
+		dg.buf = dg.buf.slice(0, n);
+		dg.segment_size = 0;
+		total++;
+	}
+	return total;
+}
+
+ssize_t socket2_udp::send_many(arrayview<datagram> dgrams)
+{
+	size_t total = 0;
+	for (const datagram& dg : dgrams)
+	{
+		const socket2::address& dest = (dg.addr ? dg.addr : addr);
+		if (dg.segment_size)
+		{
+			errno = EINVAL;
+			return total ? (ssize_t)total : -1;
+		}
+		if (::sendto(sock, (char*)dg.buf.ptr(), dg.buf.size(), 0, dest.as_native(), sizeof(dest)) < 0)
+		{
+			send_wouldblock = (WSAGetLastError() == WSAEWOULDBLOCK);
+			return total ? (ssize_t)total : -1;
+		}
+		send_wouldblock = false;
+		total++;
+	}
+	return total;
 }
 
 
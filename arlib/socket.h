@@ -70,13 +70,56 @@ public:
 	// The buffer must be at least one byte; zero is undefined behavior.
 	virtual ssize_t recv_sync(bytesw by) = 0;
 	virtual ssize_t send_sync(bytesr by) = 0;
+	// Like the above, but with several buffers. Returns the total number of bytes; like recv_sync and send_sync, this may be
+	//  less than requested, and may end in the middle of a buffer. Same rules, except only the first buffer must be nonempty.
+	// The default implementation calls recv_sync or send_sync once per buffer; plain sockets use a single syscall.
+	virtual ssize_t recvv_sync(arrayview<iovec> bufs);
+	virtual ssize_t sendv_sync(arrayview<iovec> bufs);
+	
+	// Zero-copy sending. If enabled, sendv_zerocopy_sync makes the kernel read the data straight from the given buffers while
+	//  sending, rather than copying it first. That saves a lot of CPU time for large buffers, but it's slower for small ones;
+	//  the kernel recommends it only for sends of 10KB or more.
+	// Since the kernel uses the buffers after the call returns, they must not be freed or changed until it's done with them;
+	//  give them to zerocopy_hold() once they're no longer needed, and the socket will free them at the right time.
+	// Only implemented for socket2::create() and create_from_fd() on Linux, only for TCP, and not with the io_uring runloop
+	//  (whose sockets copy into their own buffers anyways). For other sockets,
+	//  enable_zerocopy() returns false, sendv_zerocopy_sync is the same as sendv_sync, and zerocopy_hold frees immediately.
+	// The kernel's notifications are collected when recv_sync, send_sync or similar are called, and by a runloop timer
+	//  while any buffers are held. Until then, can_recv() and can_send() may complete spuriously.
+	virtual bool enable_zerocopy() { return false; }
+	virtual ssize_t sendv_zerocopy_sync(arrayview<iovec> bufs) { return sendv_sync(bufs); }
+	// The buffer is kept until every zero-copy send so far is done. If the socket is deleted before that, it's kept open
+	//  until they're done, to ensure the data isn't changed before it's sent.
+	virtual void zerocopy_hold(bytearray by) {}
 	virtual async<void> can_recv() = 0;
 	virtual async<void> can_send() = 0;
+	// Closes the sending half of the connection (TCP FIN). The other side's recv_sync returns ESHUTDOWN once it has read
+	//  everything; this side can still receive. Don't call send_sync afterwards.
+	// Only implemented for socket2::create() and create_from_fd(); everything else ignores it.
+	virtual void shutdown_send() {}
+	
+	struct relay_stats {
+		uint64_t a_to_b = 0;
+		uint64_t b_to_a = 0;
+		int error = 0; // errno of whatever failed, or 0 if both sides closed cleanly
+	};
+	// Copies everything from a to b, and from b to a, until both have closed their sending half, or either fails.
+	// If one side closes, the other side's sending half is closed, but the other direction keeps going.
+	// On Linux, if both sockets have a get_fd(), the bytes are moved with splice() through a pipe, and never reach userspace.
+	//  Otherwise, they're copied through a buffer.
+	// The sockets are not closed, and must remain valid until the relay is done (or cancelled).
+	static async<relay_stats> relay(socket2* a, socket2* b);
 	
 #ifdef __unix__
-	// If positive, reading or writing this fd is equivalent to recv_sync and send_sync. Can be used for ktls, but little or nothing else.
-	// Only implemented for socket2::create() and create_from_fd(), everything else will return -1.
+	// If positive, reading or writing this fd is equivalent to recv_sync and send_sync. Can be used for splice and sendfile,
+	//  but little or nothing else.
+	// Only implemented for socket2::create() and create_from_fd(), and SSL sockets after enable_ktls(); everything else
+	//  will return -1. Also -1 with the io_uring runloop, whose sockets have their own buffers.
 	virtual fd_raw_t get_fd() { return fd_t::null(); }
+	// Gives the encryption to the kernel (kTLS), making get_fd() usable. Must be called right after wrap_ssl returns,
+	//  before anything else is done with the socket. Returns whether it worked; if not, the socket still works as usual.
+	// Only implemented for OpenSSL on Linux, and only if the kernel's tls module is available. Experimental.
+	virtual bool enable_ktls() { return false; }
 #else
 	fd_raw_t get_fd() { return fd_t::null(); }
 #endif
@@ -141,6 +184,20 @@ public:
 
 using mksocket_t = function<async<autoptr<socket2>>(bool ssl, cstring domain, uint16_t port)>;
 
+// For socket2_udp::recv_many and send_many.
+struct socket2_udp_datagram {
+	// For recv_many, where to put the datagram; afterwards, shrunk to the received size. If the datagram was bigger,
+	//  the rest is discarded. For send_many, the datagram to send; not modified.
+	bytesw buf;
+	// For recv_many, the sender. For send_many, the destination, or empty to use the one given to create().
+	socket2::address addr;
+	// For recv_many, if GRO is enabled, this may be several datagrams from the same sender, coalesced; if so, this is the
+	//  size of each, except the last may be smaller. Otherwise, zero.
+	// For send_many, if nonzero, buf is split into datagrams of this size by the kernel or network card (GSO); at most
+	//  64 segments, and it must fit in one IP packet. If the kernel can't do that, it fails with EIO or EINVAL.
+	uint16_t segment_size = 0;
+};
+
 #ifdef __unix__
 class socket2_udp {
 	int fd;
@@ -148,12 +205,27 @@ class socket2_udp {
 	
 	socket2_udp(int fd, socket2::address addr) : fd(fd), addr(addr) {}
 public:
+	typedef socket2_udp_datagram datagram;
+	
 	static autoptr<socket2_udp> create(socket2::address ip);
+	// Binds to the given local address, to receive datagrams from anyone. There's no default destination; send() does
+	//  nothing, and send_many must be given addresses.
+	static autoptr<socket2_udp> create_bound(socket2::address local);
 	
 	async<void> can_recv() { return runloop2::await_read(fd); }
+	async<void> can_send() { return runloop2::await_write(fd); }
 	ssize_t recv_sync(bytesw by, socket2::address* sender = nullptr);
 	void send(bytesr by);
 	
+	// Receives or sends several datagrams. On Linux, that's one syscall (recvmmsg/sendmmsg) per 64 datagrams.
+	// Returns the number of datagrams received or sent, which may be fewer than requested, including zero.
+	// Errors return -1, unless some datagrams were already handled; if so, the error will show up again on the next call.
+	ssize_t recv_many(arrayvieww<datagram> dgrams);
+	ssize_t send_many(arrayview<datagram> dgrams);
+	// Lets the kernel coalesce several received datagrams into one (GRO), saving even more syscalls; use big buffers.
+	// Returns false if unsupported.
+	bool enable_gro();
+	
 	~socket2_udp() { close(fd); }
 };
 #endif
@@ -162,15 +234,32 @@ class socket2_udp {
 	SOCKET sock;
 	WSAEVENT ev;
 	socket2::address addr;
+	bool send_wouldblock = false;
 	
 	socket2_udp(SOCKET sock, socket2::address addr) : sock(sock), addr(addr) { ev = CreateEvent(NULL, false, false, NULL); }
 public:
+	typedef socket2_udp_datagram datagram;
+	
 	static autoptr<socket2_udp> create(socket2::address ip);
+	static autoptr<socket2_udp> create_bound(socket2::address local);
 	
 	async<void> can_recv() { WSAEventSelect(sock, ev, FD_READ); return runloop2::await_handle(ev); }
+	async<void> can_send()
+	{
+		// FD_WRITE isn't level triggered, it's only signaled after a send fails with WSAEWOULDBLOCK
+		if (!send_wouldblock)
+			return producer<void>::complete_sync();
+		WSAEventSelect(sock, ev, FD_WRITE);
+		return runloop2::await_handle(ev);
+	}
 	ssize_t recv_sync(bytesw by, socket2::address* sender = nullptr);
 	void send(bytesr by);
 	
+	// Same as unix, but one syscall per datagram, and no segment_size.
+	ssize_t recv_many(arrayvieww<datagram> dgrams);
+	ssize_t send_many(arrayview<datagram> dgrams);
+	bool enable_gro() { return false; }
+	
 	~socket2_udp() { WSACloseEvent(ev); closesocket(sock); }
 };
 #endif
@@ -193,11 +282,41 @@ private:
 #endif
 	
 	void on_incoming();
+#ifdef ARLIB_RUNLOOP_URING
+	waiter<int> accept_wait = make_waiter<&socketlisten::accept_wait, &socketlisten::on_accept>();
+	void accept_start();
+	void on_accept(int nfd);
+#endif
+	friend class socketlisten_multi;
 public:
 	static autoptr<socketlisten> create(const socket2::address & addr, function<void(autoptr<socket2>)> cb);
 	static autoptr<socketlisten> create(uint16_t port, function<void(autoptr<socket2>)> cb);
 };
 
+#if defined(__linux__) && defined(ARLIB_THREAD)
+// A socketlisten_multi is a TCP server spread over several threads. Each thread has its own runloop and its own listening socket,
+//  all bound to the same address with SO_REUSEPORT, so the kernel balances incoming connections between them.
+// The callback is called on the thread that accepted the connection, so it must be thread safe. The socket belongs to that thread's
+//  runloop; everything done with it should stay on that thread, which is the point - no locking, and each connection stays on one core.
+// Destroying the object stops the threads and waits for them. Connections still open at that point are stuck forever;
+//  close them first.
+class socketlisten_multi : nomove {
+	struct reactor;
+	reactor* reactors;
+	unsigned n_reactors;
+	function<void(autoptr<socket2>)> cb;
+	semaphore started;
+	semaphore exited;
+	
+	socketlisten_multi(array<fd_t> fds, function<void(autoptr<socket2>)> cb);
+public:
+	// If n_threads is zero, thread_num_cores() is used.
+	static autoptr<socketlisten_multi> create(const socket2::address & addr, function<void(autoptr<socket2>)> cb, unsigned n_threads = 0);
+	static autoptr<socketlisten_multi> create(uint16_t port, function<void(autoptr<socket2>)> cb, unsigned n_threads = 0);
+	~socketlisten_multi();
+};
+#endif
+
 // A socketbuf is a convenience wrapper to read structured data from the socket. Ask for N bytes and you get N bytes, no need for loops.
 // On the send side, it converts send to memcpy, making it act as if it's synchronous and allowing multiple concurrent writers.
 class socketbuf {
@@ -237,6 +356,7 @@ class socketbuf {
 	
 	MAKE_DESTRUCTIBLE_FROM_CALLBACK();
 	void socket_failed();
+	void send_release();
 	
 	template<typename T, op_t op>
 	async<T> get_async()
@@ -257,6 +377,7 @@ class socketbuf {
 public:
 	socketbuf() { recv_by.bufsize(4096); }
 	socketbuf(autoptr<socket2> sock) : sock(std::move(sock)) { recv_by.bufsize(4096); }
+	~socketbuf() { send_release(); }
 	socketbuf& operator=(autoptr<socket2> sock)
 	{
 		reset();
@@ -270,6 +391,7 @@ public:
 		sock = std::move(other.sock);
 		recv_by = std::move(other.recv_by);
 		send_by = std::move(other.send_by);
+		zerocopy = other.zerocopy;
 		this->send_prepare();
 		
 		return *this;
@@ -280,6 +402,7 @@ public:
 		socket_failed();
 		recv_by.reset(4096);
 		send_by.reset();
+		zerocopy = false;
 	}
 	
 	operator bool() { return sock != nullptr; }
@@ -326,22 +449,36 @@ public:
 	}
 	
 private:
-	bytepipe send_by;
+	bytepipe_chain send_by;
 	
 	waiter<void> send_wait = make_waiter<&socketbuf::send_wait, &socketbuf::send_ready>();
 	producer<bool> send_prod = make_producer<&socketbuf::send_prod, &socketbuf::send_prod_cancel>();
 	void send_prod_cancel() { send_wait.cancel(); }
 	
+	bool zerocopy = false;
+	static const size_t zerocopy_min = 16384;
+	
 	void send_ready();
 	void send_prepare();
 public:
 	void send(bytesr by);
 	void send(cstring str) { return send(str.bytes()); }
 	void send(const char * str) { return send(bytesr((uint8_t*)str, strlen(str))); }
+	// If the socket can't send all of it immediately, the buffer is kept and the rest is sent from there, without copying.
+	void send(bytearray&& by);
+	// If the socket supports it, large sends use socket2::sendv_zerocopy_sync. Data pushed as bytearray is then sent without
+	//  any copy at all. Returns whether it's enabled.
+	bool enable_zerocopy()
+	{
+		if (sock)
+			zerocopy = sock->enable_zerocopy();
+		return zerocopy;
+	}
 	
 	// send_buf collects incoming bytes, and does not send them until send_flush() is called
 	// don't mix with send()
 	void send_buf(bytesr by) { send_by.push(by); }
+	void send_buf(bytearray&& by) { send_by.push(std::move(by)); }
 	template<typename... Ts> void send_buf(Ts... args) { send_by.push_text(args...); }
 	void send_flush() { send_ready(); }
 	
@@ -0,0 +1,174 @@
+#pragma once
+#include "global.h"
+#include <type_traits>
+
+// Sorting primitives on raw memory, used by arrayvieww's sort functions and the parallel sorts in thread.h.
+// Like everything else in Arlib, items are moved with memcpy; a scratch buffer is uninitialized memory, not a T array.
+class sorting {
+	template<typename T>
+	static void move(T* dst, const T* src, size_t count)
+	{
+		memcpy((void*)dst, (void*)src, sizeof(T)*count);
+	}
+	
+	// Maps a key to an unsigned integer with the same order.
+	template<typename Tk>
+	static auto radix_bits(Tk key)
+	{
+		static_assert(std::is_arithmetic_v<Tk>, "radix sort keys must be integers or floats");
+		if constexpr (std::is_floating_point_v<Tk>)
+		{
+			static_assert(sizeof(Tk) == 4 || sizeof(Tk) == 8);
+			using Tu = std::conditional_t<sizeof(Tk) == 4, uint32_t, uint64_t>;
+			Tu bits;
+			memcpy(&bits, &key, sizeof(bits));
+			Tu sign = (Tu)1 << (sizeof(Tu)*8-1);
+			// negative floats are sign-magnitude, so they sort backwards; flip them
+			return (Tu)((bits & sign) ? ~bits : bits|sign);
+		}
+		else if constexpr (std::is_signed_v<Tk>)
+		{
+			using Tu = std::make_unsigned_t<Tk>;
+			return (Tu)((Tu)key ^ ((Tu)1 << (sizeof(Tu)*8-1)));
+		}
+		else return key;
+	}
+
+public:
+	// Below this size, the O(n log n) sorts just use insertion sort. Must be a power of two.
+	static const size_t run_size = 32;
+	// Below this size, radix sort isn't worth its fixed costs.
+	static const size_t radix_min = 64;
+	
+	// Binary insertion sort. Not the fastest, but it's adaptive, it's simple, and its constant factors are good.
+	template<typename T, typename Tless>
+	static void insertion(T* items, size_t count, const Tless& less)
+	{
+		for (size_t a=1;a<count;a++)
+		{
+			if (!less(items[a], items[a-1]))
+				continue;
+			
+			size_t probe = 1;
+			while (probe < a && less(items[a], items[a-probe]))
+				probe *= 2;
+			
+			size_t min = a-probe;
+			probe /= 2;
+			while (probe)
+			{
+				if (min+probe > a || !less(items[a], items[min+probe]))
+					min += probe;
+				probe /= 2;
+			}
+			
+			if (min > a || !less(items[a], items[min]))
+				min++;
+			
+			size_t newpos = min;
+			
+			char tmp[sizeof(T)];
+			memcpy((void*)tmp, (void*)&items[a], sizeof(T));
+			memmove((void*)&items[newpos+1], (void*)&items[newpos], sizeof(T)*(a-newpos));
+			memcpy((void*)&items[newpos], tmp, sizeof(T));
+		}
+	}
+	
+	// Merges the sorted runs src[0..na) and src[na..na+nb) into dst. Equal items are taken from the first run first.
+	// The comparator is always called with the later item first, both pointing into src.
+	template<typename T, typename Tless>
+	static void merge(const T* src, size_t na, size_t nb, T* dst, const Tless& less)
+	{
+		const T* a = src;
+		const T* a_end = src+na;
+		const T* b = a_end;
+		const T* b_end = b+nb;
+		if (!na || !nb || !less(*b, a_end[-1]))
+		{
+			move(dst, src, na+nb);
+			return;
+		}
+		while (a < a_end && b < b_end)
+		{
+			if (less(*b, *a))
+				move(dst++, b++, 1);
+			else
+				move(dst++, a++, 1);
+		}
+		move(dst, a, a_end-a);
+		dst += a_end-a;
+		move(dst, b, b_end-b);
+	}
+	
+	// Merges adjacent sorted runs of 'width' items (the last one possibly shorter) from src to dst, creating runs of width*2.
+	template<typename T, typename Tless>
+	static void merge_pass(const T* src, T* dst, size_t count, size_t width, const Tless& less)
+	{
+		for (size_t i=0;i<count;i+=width*2)
+		{
+			size_t na = min(width, count-i);
+			size_t nb = min(width, count-i-na);
+			merge(src+i, na, nb, dst+i, less);
+		}
+	}
+	
+	// Stable bottom-up merge sort. Scratch must have room for count items; it's unused if count <= run_size.
+	// O(n) if the input is already sorted.
+	template<typename T, typename Tless>
+	static void merge_sort(T* items, T* scratch, size_t count, const Tless& less)
+	{
+		for (size_t i=0;i<count;i+=run_size)
+			insertion(items+i, min(run_size, count-i), less);
+		
+		T* src = items;
+		T* dst = scratch;
+		for (size_t width=run_size;width<count;width*=2)
+		{
+			merge_pass(src, dst, count, width, less);
+			std::swap(src, dst);
+		}
+		if (src != items)
+			move(items, src, count);
+	}
+	
+	// Stable LSD radix sort, one byte per pass; key(item) must return an integer or float. Passes where every item has
+	//  the same byte are skipped, so small keys in a wide type cost no more than narrow keys.
+	// Scratch must have room for count items.
+	template<typename T, typename Tkey>
+	static void radix(T* items, T* scratch, size_t count, const Tkey& key)
+	{
+		if (!count)
+			return;
+		using Tu = decltype(radix_bits(key(items[0])));
+		static const size_t n_bytes = sizeof(Tu);
+		
+		size_t hist[n_bytes][256] = {};
+		for (size_t i=0;i<count;i++)
+		{
+			Tu k = radix_bits(key(items[i]));
+			for (size_t b=0;b<n_bytes;b++)
+				hist[b][(uint8_t)(k >> (b*8))]++;
+		}
+		
+		T* src = items;
+		T* dst = scratch;
+		for (size_t b=0;b<n_bytes;b++)
+		{
+			if (hist[b][(uint8_t)(radix_bits(key(src[0])) >> (b*8))] == count)
+				continue;
+			
+			size_t pos[256];
+			size_t sum = 0;
+			for (size_t d=0;d<256;d++)
+			{
+				pos[d] = sum;
+				sum += hist[b][d];
+			}
+			for (size_t i=0;i<count;i++)
+				move(dst + pos[(uint8_t)(radix_bits(key(src[i])) >> (b*8))]++, src+i, 1);
+			std::swap(src, dst);
+		}
+		if (src != items)
+			move(items, src, count);
+	}
+};
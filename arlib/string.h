@@ -419,6 +419,7 @@ public:
 class cstrnul : public cstring {
 	friend class cstring;
 	friend class string;
+	friend class arena;
 	forceinline const char * ptr_withnul() const { return (char*)ptr(); }
 	
 	class has_nul {};
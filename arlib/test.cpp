@@ -229,9 +229,12 @@ bool test_skipped()
 	return (result != err_ok);
 }
 
+static thread_local bool is_test_thread = false;
+
 bool test_rethrow()
 {
-	if (result != err_ok)
+	// a failure belongs to the thread running the tests; other threads, for example ones running their own runloop, must not see it
+	if (result != err_ok && is_test_thread)
 	{
 		test_throw(result);
 		return true;
@@ -380,6 +383,7 @@ int main(int argc, char* argv[])
 {
 	setvbuf(stdout, NULL, _IONBF, 0);
 	printf("Initializing Arlib...");
+	is_test_thread = true;
 	bool run_twice = false;
 	
 	// todo: drop __SANITIZE_ADDRESS__, and this ifndef, on gcc >= 14
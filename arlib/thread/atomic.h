@@ -44,8 +44,9 @@ T lock_xchg(T* val, T2 newval) { return __atomic_exchange_n(val, newval, order);
 template<lockorder_t order, lockorder_t orderfail, typename T, typename T2>
 T lock_cmpxchg(T* val, T2 oldval, T2 newval)
 {
+	// must be strong; callers compare the return value to oldval, so a spurious failure would look like success
 	T oldvalcast = oldval;
-	__atomic_compare_exchange_n(val, &oldvalcast, newval, true, order, orderfail);
+	__atomic_compare_exchange_n(val, &oldvalcast, newval, false, order, orderfail);
 	return oldvalcast;
 }
 
@@ -108,9 +109,9 @@ template<lockorder_t order, lockorder_t orderfail, typename T, typename T2>
 T lock_cmpxchg(T* val, T2 oldval, T2 newval)
 {
 	static_assert(sizeof(T) == sizeof(T2));
-	if constexpr (sizeof(T)==4) return InterlockedCompareExchange((volatile LONG*)val, oldval, newval);
+	if constexpr (sizeof(T)==4) return InterlockedCompareExchange((volatile LONG*)val, newval, oldval);
 #ifdef _WIN64
-	else if constexpr (sizeof(T)==8) return InterlockedCompareExchange64((volatile LONG64*)val, oldval, newval);
+	else if constexpr (sizeof(T)==8) return InterlockedCompareExchange64((volatile LONG64*)val, newval, oldval);
 #endif
 	else static_assert(sizeof(T) < 0);
 }
@@ -135,3 +135,53 @@ test("thread runonce","","thread")
 	assert_range(st.t.us(), US_INIT-US_TOLERANCE_NEG, US_INIT+US_TOLERANCE);
 	}
 }
+
+test("lock_cmpxchg", "", "thread")
+{
+	{
+		// the template arguments' comma confuses the assert macros
+		auto cmpxchg32 = [](uint32_t* val, uint32_t oldval, uint32_t newval) { return lock_cmpxchg<lock_acqrel, lock_loose>(val, oldval, newval); };
+		uint32_t n = 1;
+		assert_eq(cmpxchg32(&n, 1, 2), 1u);
+		assert_eq(n, 2u);
+		assert_eq(cmpxchg32(&n, 1, 3), 2u);
+		assert_eq(n, 2u);
+		
+		auto cmpxchg64 = [](uint64_t* val, uint64_t oldval, uint64_t newval) { return lock_cmpxchg<lock_acqrel, lock_loose>(val, oldval, newval); };
+		uint64_t n64 = 1;
+		assert_eq(cmpxchg64(&n64, 1, 2), 1u);
+		assert_eq(n64, 2u);
+		assert_eq(cmpxchg64(&n64, 1, 3), 2u);
+		assert_eq(n64, 2u);
+	}
+	
+	{
+		// returning oldval must mean the exchange happened, otherwise increments get lost
+		static const int n_threads = 4;
+		static const int count = 100000;
+		struct state {
+			uint32_t n = 0;
+			semaphore done;
+		} st;
+		for (int t=0;t<n_threads;t++)
+		{
+			thread_create([&st]() {
+				for (int i=0;i<count;i++)
+				{
+					uint32_t prev = lock_read<lock_loose>(&st.n);
+					while (true)
+					{
+						uint32_t ret = lock_cmpxchg<lock_acqrel, lock_loose>(&st.n, prev, prev+1);
+						if (ret == prev)
+							break;
+						prev = ret;
+					}
+				}
+				st.done.release();
+			});
+		}
+		for (int t=0;t<n_threads;t++)
+			st.done.wait();
+		assert_eq(st.n, (uint32_t)(n_threads*count));
+	}
+}
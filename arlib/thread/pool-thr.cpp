@@ -0,0 +1,222 @@
+#include "thread.h"
+
+#ifdef ARLIB_THREAD
+// A work stealing pool. Each worker has its own deque; jobs submitted from a worker go to the back of that worker's deque,
+//  and the worker takes them from the back again (most recently submitted first, its data is probably still in cache).
+// Jobs submitted from outside the pool go to a shared queue. Idle workers check that queue, then steal from the front of the others.
+// Each deque has its own mutex; the owner and a thief rarely touch the same deque at the same time,
+//  so the locks are uncontended in practice, and a lock-free deque isn't worth the complexity.
+namespace {
+
+class jobdeque {
+	function<void()>* items = nullptr;
+	size_t capacity = 0; // zero or a power of two
+	size_t head = 0; // head and tail are not masked; they wrap at SIZE_MAX+1, which is a multiple of any capacity
+	size_t tail = 0;
+	
+	void grow()
+	{
+		size_t new_capacity = (capacity ? capacity*2 : 16);
+		function<void()>* new_items = xmalloc(sizeof(function<void()>)*new_capacity);
+		for (size_t i=head;i!=tail;i++)
+		{
+			function<void()>& item = items[i&(capacity-1)];
+			new(&new_items[i&(new_capacity-1)]) function<void()>(std::move(item));
+			item.~function();
+		}
+		free(items);
+		items = new_items;
+		capacity = new_capacity;
+	}
+	
+	function<void()> take(size_t idx)
+	{
+		function<void()>& item = items[idx&(capacity-1)];
+		function<void()> ret = std::move(item);
+		item.~function();
+		return ret;
+	}
+
+public:
+	mutex lock;
+	
+	bool empty() { return head == tail; }
+	void push_back(function<void()>&& job)
+	{
+		if (tail-head == capacity)
+			grow();
+		new(&items[tail&(capacity-1)]) function<void()>(std::move(job));
+		tail++;
+	}
+	function<void()> pop_back() { return take(--tail); }
+	function<void()> pop_front() { return take(head++); }
+	
+	~jobdeque()
+	{
+		while (!empty())
+			pop_front();
+		free(items);
+	}
+};
+
+class threadpool;
+struct worker {
+	threadpool* parent;
+	jobdeque jobs;
+	void run();
+};
+static thread_local worker* g_worker;
+
+class threadpool {
+	worker* workers;
+	unsigned n_workers;
+	jobdeque injected; // jobs submitted from outside the pool
+	
+	// Number of workers that want a wakeup. Sleeping is announced before the final check for jobs,
+	//  so a submitter either sees the announcement, or the sleeper sees the job.
+	int n_sleeping = 0;
+	semaphore wake;
+	
+	bool stop = false;
+	semaphore exited;
+	
+	bool try_pop_back(jobdeque& q, function<void()>& out)
+	{
+		synchronized(q.lock)
+		{
+			if (q.empty())
+				return false;
+			out = q.pop_back();
+		}
+		return true;
+	}
+	bool try_pop_front(jobdeque& q, function<void()>& out)
+	{
+		synchronized(q.lock)
+		{
+			if (q.empty())
+				return false;
+			out = q.pop_front();
+		}
+		return true;
+	}
+	
+	bool find_job(worker* self, function<void()>& out)
+	{
+		if (try_pop_back(self->jobs, out))
+			return true;
+		if (try_pop_front(injected, out))
+			return true;
+		size_t self_idx = self - workers;
+		for (unsigned i=1;i<n_workers;i++)
+		{
+			if (try_pop_front(workers[(self_idx+i) % n_workers].jobs, out))
+				return true;
+		}
+		return false;
+	}
+	
+	// Takes back one sleep announcement. If it's already taken, a wakeup was sent on our behalf;
+	//  it's left in the semaphore, and some worker will wake up, find nothing, and go back to sleep.
+	bool unannounce()
+	{
+		int n = lock_read<lock_seqcst>(&n_sleeping);
+		while (n > 0)
+		{
+			int prev = lock_cmpxchg<lock_acqrel, lock_loose>(&n_sleeping, n, n-1);
+			if (prev == n)
+				return true;
+			n = prev;
+		}
+		return false;
+	}
+	
+	void notify()
+	{
+		if (unannounce())
+			wake.release();
+	}
+
+public:
+	void threadproc(worker* self)
+	{
+		g_worker = self;
+		function<void()> job;
+		while (true)
+		{
+			if (find_job(self, job))
+			{
+				job();
+				continue;
+			}
+			lock_incr<lock_seqcst>(&n_sleeping);
+			if (find_job(self, job))
+			{
+				unannounce();
+				job();
+				continue;
+			}
+			// queued jobs are finished before exiting
+			if (lock_read<lock_acq>(&stop))
+			{
+				unannounce();
+				break;
+			}
+			wake.wait();
+		}
+		g_worker = nullptr;
+		exited.release();
+	}
+	
+	threadpool(unsigned n_workers, priority_t pri) : n_workers(max(n_workers, 1u))
+	{
+		workers = new worker[this->n_workers];
+		for (unsigned i=0;i<this->n_workers;i++)
+		{
+			workers[i].parent = this;
+			thread_create(bind_ptr(&worker::run, &workers[i]), pri);
+		}
+	}
+	
+	void submit(function<void()>&& job)
+	{
+		worker* self = g_worker;
+		jobdeque& q = (self && self->parent == this ? self->jobs : injected);
+		synchronized(q.lock)
+		{
+			q.push_back(std::move(job));
+		}
+		notify();
+	}
+	
+	~threadpool()
+	{
+		lock_write<lock_rel>(&stop, true);
+		for (unsigned i=0;i<n_workers;i++)
+			wake.release();
+		for (unsigned i=0;i<n_workers;i++)
+			exited.wait();
+		delete[] workers;
+	}
+};
+
+void worker::run() { parent->threadproc(this); }
+
+threadpool& get_pool(priority_t pri)
+{
+	if (pri == pri_idle)
+	{
+		static threadpool pool(thread_num_cores_idle(), pri_idle);
+		return pool;
+	}
+	static threadpool pool(thread_num_cores(), pri_default);
+	return pool;
+}
+
+}
+
+void thread_pool_run(function<void()>&& job, priority_t pri)
+{
+	get_pool(pri).submit(std::move(job));
+}
+#endif
@@ -0,0 +1,130 @@
+#include "queue.h"
+
+#ifdef ARLIB_THREAD
+#include "../test.h"
+#include "../array.h"
+
+test("spsc_queue", "thread", "")
+{
+	{
+		spsc_queue<int> q(3);
+		assert_eq(q.capacity(), 4);
+		int n;
+		assert(!q.try_pop(n));
+		for (int i=0;i<4;i++)
+			assert(q.try_push(i));
+		assert(!q.try_push(4));
+		for (int i=0;i<4;i++)
+		{
+			assert(q.try_pop(n));
+			assert_eq(n, i);
+		}
+		assert(!q.try_pop(n));
+	}
+	
+	{
+		// small queue, so both the full and empty cases block repeatedly
+		static const int count = 100000;
+		struct state {
+			spsc_queue<int> q { 4 };
+			uint64_t sum = 0;
+			bool in_order = true;
+			semaphore done;
+		} st;
+		thread_create([&st]() {
+			int prev = -1;
+			for (int i=0;i<count;i++)
+			{
+				int n = st.q.pop();
+				if (n != prev+1) st.in_order = false;
+				prev = n;
+				st.sum += n;
+			}
+			st.done.release();
+		});
+		for (int i=0;i<count;i++)
+			st.q.push(i);
+		st.done.wait();
+		assert(st.in_order);
+		assert_eq(st.sum, (uint64_t)count*(count-1)/2);
+	}
+	
+	{
+		// anything remaining is destroyed with the queue
+		spsc_queue<array<int>> q(4);
+		q.push({ 1, 2, 3 });
+		q.push({ 4, 5 });
+		assert_eq(q.pop().size(), 3);
+	}
+}
+
+test("mpmc_queue", "thread", "")
+{
+	{
+		mpmc_queue<int> q(4);
+		int n;
+		assert(!q.try_pop(n));
+		for (int i=0;i<4;i++)
+			assert(q.try_push(i));
+		assert(!q.try_push(4));
+		for (int i=0;i<4;i++)
+		{
+			assert(q.try_pop(n));
+			assert_eq(n, i);
+		}
+		assert(!q.try_pop(n));
+		// again, to make sure the sequence numbers wrap properly
+		for (int i=0;i<4;i++)
+			assert(q.try_push(i+10));
+		assert(q.try_pop(n));
+		assert_eq(n, 10);
+	}
+	
+	{
+		static const int n_producers = 4;
+		static const int n_consumers = 4;
+		static const int per_producer = 25000;
+		struct state {
+			mpmc_queue<int> q { 8 };
+			array<int> seen;
+			int next_producer = 0;
+			semaphore producers_done;
+			semaphore consumers_done;
+		} st;
+		st.seen.resize(n_producers * per_producer);
+		
+		for (int p=0;p<n_producers;p++)
+		{
+			thread_create([&st]() {
+				int p = lock_incr<lock_loose>(&st.next_producer);
+				for (int i=0;i<per_producer;i++)
+					st.q.push(p*per_producer + i);
+				st.producers_done.release();
+			});
+		}
+		for (int c=0;c<n_consumers;c++)
+		{
+			thread_create([&st]() {
+				while (true)
+				{
+					int n = st.q.pop();
+					if (n < 0) break;
+					lock_incr<lock_loose>(&st.seen[n]);
+				}
+				st.consumers_done.release();
+			});
+		}
+		
+		// once the producers are done, each consumer gets one -1, and exits after seeing it
+		for (int p=0;p<n_producers;p++)
+			st.producers_done.wait();
+		for (int c=0;c<n_consumers;c++)
+			st.q.push(-1);
+		for (int c=0;c<n_consumers;c++)
+			st.consumers_done.wait();
+		
+		for (int n : st.seen)
+			assert_eq(n, 1);
+	}
+}
+#endif
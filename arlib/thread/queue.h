@@ -0,0 +1,256 @@
+#pragma once
+#include "thread.h"
+
+#ifdef ARLIB_THREAD
+#ifndef __linux__
+#include <sched.h>
+#endif
+
+// Lets threads sleep until another thread changes something. To wait:
+//  int token = waiter.prepare(); if (!condition()) waiter.wait(token); else waiter.cancel();
+// The thread that makes the condition true must do so with a seqcst write, then call notify().
+// Outside Linux, there's no futex, so wait() just yields the CPU; it's still correct, but not efficient.
+class thread_waiter : nomove {
+	int m_seq = 0;
+	int m_waiters = 0;
+public:
+	int prepare()
+	{
+		lock_incr<lock_seqcst>(&m_waiters);
+		return lock_read<lock_seqcst>(&m_seq);
+	}
+	void cancel()
+	{
+		lock_decr<lock_acqrel>(&m_waiters);
+	}
+	void wait(int token)
+	{
+#ifdef __linux__
+		futex_sleep_if_eq(&m_seq, token);
+#elif defined(_WIN32)
+		SwitchToThread();
+#else
+		sched_yield();
+#endif
+		lock_decr<lock_acqrel>(&m_waiters);
+	}
+	void notify()
+	{
+		if (lock_read<lock_seqcst>(&m_waiters))
+		{
+			lock_incr<lock_seqcst>(&m_seq);
+#ifdef __linux__
+			futex_wake_all(&m_seq);
+#endif
+		}
+	}
+};
+
+// Fixed-size queue for handing items from one thread to another, without locks. Exactly one thread may push, and exactly
+//  one thread may pop (not necessarily the same ones every time, but if they change, some other synchronization is needed).
+// The try_ functions never block; push() and pop() sleep if the queue is full or empty, respectively.
+// Capacity is rounded up to a power of two.
+template<typename T>
+class spsc_queue : nomove {
+	T* m_items;
+	size_t m_mask;
+	
+	// the producer and consumer each own one cache line, and only read the other's if their cached copy says full or empty
+	alignas(64) size_t m_tail = 0; // next slot to push to; written by the producer
+	size_t m_head_cache = 0;
+	alignas(64) size_t m_head = 0; // next slot to pop from; written by the consumer
+	size_t m_tail_cache = 0;
+	alignas(64) thread_waiter m_not_empty;
+	alignas(64) thread_waiter m_not_full;
+
+public:
+	spsc_queue(size_t capacity)
+	{
+		m_mask = bitround(max(capacity, 2)) - 1;
+		m_items = xmalloc(sizeof(T) * (m_mask+1));
+	}
+	~spsc_queue()
+	{
+		for (size_t i=m_head;i!=m_tail;i++)
+			m_items[i&m_mask].~T();
+		free(m_items);
+	}
+	
+	// If this returns false, the item is unchanged.
+	bool try_push(T& item)
+	{
+		size_t tail = m_tail;
+		if (tail - m_head_cache > m_mask)
+		{
+			m_head_cache = lock_read<lock_acq>(&m_head);
+			if (tail - m_head_cache > m_mask)
+				return false;
+		}
+		new(&m_items[tail&m_mask]) T(std::move(item));
+		lock_write<lock_seqcst>(&m_tail, tail+1);
+		m_not_empty.notify();
+		return true;
+	}
+	bool try_push(T&& item) { return try_push(item); }
+	void push(T item)
+	{
+		while (!try_push(item))
+		{
+			int token = m_not_full.prepare();
+			if (lock_read<lock_seqcst>(&m_head) + m_mask+1 == m_tail)
+				m_not_full.wait(token);
+			else
+				m_not_full.cancel();
+		}
+	}
+	
+	bool try_pop(T& out)
+	{
+		size_t head = m_head;
+		if (head == m_tail_cache)
+		{
+			m_tail_cache = lock_read<lock_acq>(&m_tail);
+			if (head == m_tail_cache)
+				return false;
+		}
+		out = std::move(m_items[head&m_mask]);
+		m_items[head&m_mask].~T();
+		lock_write<lock_seqcst>(&m_head, head+1);
+		m_not_full.notify();
+		return true;
+	}
+	T pop()
+	{
+		T ret;
+		while (!try_pop(ret))
+		{
+			int token = m_not_empty.prepare();
+			if (lock_read<lock_seqcst>(&m_tail) == m_head)
+				m_not_empty.wait(token);
+			else
+				m_not_empty.cancel();
+		}
+		return ret;
+	}
+	
+	size_t capacity() const { return m_mask+1; }
+};
+
+// Fixed-size queue that any number of threads can push to and pop from, without locks.
+// Each slot has a sequence number telling whether it's ready to be pushed to or popped from, so producers and consumers
+//  only contend on the head or tail counter, never on each other's slots. Based on Dmitry Vyukov's bounded MPMC queue.
+// Same API as spsc_queue.
+template<typename T>
+class mpmc_queue : nomove {
+	struct cell {
+		size_t seq;
+		alignas(T) char item[sizeof(T)];
+	};
+	cell* m_cells;
+	size_t m_mask;
+	
+	alignas(64) size_t m_tail = 0;
+	alignas(64) size_t m_head = 0;
+	alignas(64) thread_waiter m_not_empty;
+	alignas(64) thread_waiter m_not_full;
+	
+	// Same meaning as the diff in claim(). Negative means full or empty; positive means another thread took that cell,
+	//  and the caller should retry rather than sleep, or it may sleep with something still in the queue.
+	intptr_t state(size_t* pos_ptr, size_t offset)
+	{
+		size_t pos = lock_read<lock_seqcst>(pos_ptr);
+		return (intptr_t)(lock_read<lock_seqcst>(&m_cells[pos & m_mask].seq) - (pos+offset));
+	}
+	
+	// Returns a cell that the caller now owns, or null if the queue is full or empty.
+	// For push, the cell is ready when its seq equals the position; for pop, when it's one higher.
+	cell* claim(size_t* pos_ptr, size_t offset)
+	{
+		size_t pos = lock_read<lock_loose>(pos_ptr);
+		while (true)
+		{
+			cell* c = &m_cells[pos & m_mask];
+			intptr_t diff = (intptr_t)(lock_read<lock_acq>(&c->seq) - (pos+offset));
+			if (diff == 0)
+			{
+				size_t prev = lock_cmpxchg<lock_loose, lock_loose>(pos_ptr, pos, pos+1);
+				if (prev == pos)
+					return c;
+				pos = prev;
+			}
+			else if (diff < 0)
+				return nullptr;
+			else
+				pos = lock_read<lock_loose>(pos_ptr);
+		}
+	}
+
+public:
+	mpmc_queue(size_t capacity)
+	{
+		m_mask = bitround(max(capacity, 2)) - 1;
+		m_cells = xmalloc(sizeof(cell) * (m_mask+1));
+		for (size_t i=0;i<=m_mask;i++)
+			m_cells[i].seq = i;
+	}
+	~mpmc_queue()
+	{
+		for (size_t i=m_head;i!=m_tail;i++)
+			((T*)m_cells[i&m_mask].item)->~T();
+		free(m_cells);
+	}
+	
+	bool try_push(T& item)
+	{
+		cell* c = claim(&m_tail, 0);
+		if (!c)
+			return false;
+		size_t pos = c->seq;
+		new(c->item) T(std::move(item));
+		lock_write<lock_seqcst>(&c->seq, pos+1);
+		m_not_empty.notify();
+		return true;
+	}
+	bool try_push(T&& item) { return try_push(item); }
+	void push(T item)
+	{
+		while (!try_push(item))
+		{
+			int token = m_not_full.prepare();
+			if (state(&m_tail, 0) < 0)
+				m_not_full.wait(token);
+			else
+				m_not_full.cancel();
+		}
+	}
+	
+	bool try_pop(T& out)
+	{
+		cell* c = claim(&m_head, 1);
+		if (!c)
+			return false;
+		size_t pos = c->seq - 1;
+		T* item = (T*)c->item;
+		out = std::move(*item);
+		item->~T();
+		lock_write<lock_seqcst>(&c->seq, pos + m_mask+1);
+		m_not_full.notify();
+		return true;
+	}
+	T pop()
+	{
+		T ret;
+		while (!try_pop(ret))
+		{
+			int token = m_not_empty.prepare();
+			if (state(&m_head, 1) < 0)
+				m_not_empty.wait(token);
+			else
+				m_not_empty.cancel();
+		}
+		return ret;
+	}
+	
+	size_t capacity() const { return m_mask+1; }
+};
+#endif
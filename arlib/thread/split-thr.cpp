@@ -1,95 +1,184 @@
 #include "thread.h"
 
-#ifdef ARLIB_THREADggg
+#ifdef ARLIB_THREAD
 namespace {
 
-//TODO: there is no procedure for destroying threads
-struct threadpool {
-	mutex lock;
+// The ids are handed out one at a time from a shared counter, to whoever asks first, so uneven work is balanced automatically.
+// The caller and each helper take ids until they run out; helpers that start after that return without touching the work function.
+// Only the helpers that took part need to be waited for; the others may run after thread_split returns, so the state is refcounted.
+struct split_state {
+	function<void(unsigned int id)> work;
+	size_t count;
+	size_t next = 0; // size_t, so the final failed increment from each thread can't overflow
+	unsigned int n_running = 0;
+	unsigned int refcount;
+	semaphore done;
 	
-	multievent* wake;
-	multievent* started;
-	uint32_t numthreads;
-	uint32_t numidle;
+	split_state(function<void(unsigned int id)> work, size_t count, unsigned int refcount)
+		: work(std::move(work)), count(count), refcount(refcount) {}
 	
-	//these vary between each piece of work
-	function<void(unsigned int id)> work;
-	uint32_t id;
-	multievent* done;
+	void run()
+	{
+		while (true)
+		{
+			size_t id = lock_incr<lock_seqcst>(&next);
+			if (id >= count)
+				break;
+			work(id);
+		}
+	}
+	
+	void helper()
+	{
+		lock_incr<lock_seqcst>(&n_running);
+		run();
+		if (lock_decr<lock_acqrel>(&n_running) == 1)
+			done.release();
+		release();
+	}
+	
+	void release()
+	{
+		if (lock_decr<lock_acqrel>(&refcount) == 1)
+			delete this;
+	}
 };
 
-static struct threadpool * pool;
+}
 
-void threadproc(struct threadpool * This)
+void thread_split(unsigned int count, function<void(unsigned int id)> work, priority_t pri)
 {
-	while (true)
+	if (count <= 1)
 	{
-		This->wake->wait();
-		lock_decr(&This->numidle);
-		
-		function<void(unsigned int id)> work = This->work;
-		unsigned int id = lock_incr(&This->id);
-		multievent* done = This->done;
-		
-		This->started->signal();
-		work(id);
-		done->signal();
-		lock_incr(&This->numidle);
+		if (count)
+			work(0);
+		return;
 	}
+	
+	unsigned int n_helpers = min(count-1, (pri == pri_idle ? thread_num_cores_idle() : thread_num_cores()));
+	split_state* st = new split_state(std::move(work), count, n_helpers+1);
+	for (unsigned int i=0;i<n_helpers;i++)
+		thread_pool_run(bind_ptr(&split_state::helper, st), pri);
+	
+	st->run();
+	// every id is taken, but some may still be running; the semaphore is released whenever n_running hits zero
+	while (lock_read<lock_seqcst>(&st->n_running) != 0)
+		st->done.wait();
+	st->release();
 }
 
-struct threadpool* pool_create()
+#include "../test.h"
+#include "../array.h"
+#include "../string.h"
+#include "../random.h"
+
+test("thread_split", "", "thread")
 {
-	struct threadpool * pool = new threadpool;
+	array<int> seen;
+	seen.resize(1000);
+	thread_split(seen.size(), [&seen](unsigned int id) { lock_incr<lock_loose>(&seen[id]); });
+	for (int n : seen)
+		assert_eq(n, 1);
 	
-	pool->wake=new multievent();
-	pool->started=new multievent();
-	pool->numthreads=0;
-	pool->numidle=0;
-	
-	return pool;
+	thread_split(0, [](unsigned int id) { abort(); });
 }
 
-void pool_delete(struct threadpool* pool)
+test("parallel_for", "thread", "")
 {
-	delete pool->wake;
-	delete pool->started;
-	delete pool;
+	array<int> items;
+	for (int i=0;i<10000;i++)
+		items.append(i);
+	parallel_for((arrayvieww<int>)items, 100, [](arrayvieww<int> chunk) {
+		for (int& n : chunk)
+			n *= 2;
+	});
+	for (int i=0;i<10000;i++)
+		assert_eq(items[i], i*2);
+	
+	// nested; the inner calls must not wait for the outer ones
+	parallel_for((arrayvieww<int>)items, 1000, [](arrayvieww<int> chunk) {
+		parallel_for(chunk, 10, [](arrayvieww<int> chunk) {
+			for (int& n : chunk)
+				n += 1;
+		});
+	});
+	for (int i=0;i<10000;i++)
+		assert_eq(items[i], i*2+1);
+	
+	parallel_for(arrayview<int>(), 10, [](arrayview<int> chunk) { abort(); });
 }
 
+test("parallel_reduce", "thread", "")
+{
+	array<uint64_t> items;
+	for (int i=1;i<=10000;i++)
+		items.append(i);
+	uint64_t sum = parallel_reduce((arrayview<uint64_t>)items, 64, (uint64_t)0,
+		[](arrayview<uint64_t> chunk) -> uint64_t {
+			uint64_t ret = 0;
+			for (uint64_t n : chunk)
+				ret += n;
+			return ret;
+		},
+		[](uint64_t a, uint64_t b) { return a+b; });
+	assert_eq(sum, 10000*10001/2);
+	
+	// reduce is called in order; string concatenation is associative, but not commutative
+	array<string> words;
+	for (int i=0;i<100;i++)
+		words.append(tostring(i));
+	string joined = parallel_reduce((arrayview<string>)words, 7, string(),
+		[](arrayview<string> chunk) -> string {
+			string ret;
+			for (const string& s : chunk)
+				ret += s;
+			return ret;
+		},
+		[](string a, string b) { return a+b; });
+	string expected;
+	for (const string& s : words)
+		expected += s;
+	assert_eq(joined, expected);
 }
 
-void thread_split(unsigned int count, function<void(unsigned int id)> work)
+test("parallel_sort", "thread", "")
 {
-	if (!count) return;
-	if (count==1)
-	{
-		work(0);
-		return;
-	}
-	struct threadpool * This = thread_once_undo(&pool, bind(pool_create), bind(pool_delete));
+	struct rec {
+		uint32_t key;
+		uint32_t seq;
+	};
+	array<rec> items;
+	random_t rand(1);
+	for (uint32_t i=0;i<200000;i++)
+		items.append({ rand(5000), i });
+	auto check = [](arrayview<rec> items, bool stable) {
+		for (size_t i=1;i<items.size();i++)
+		{
+			assert_lte(items[i-1].key, items[i].key);
+			if (stable && items[i-1].key == items[i].key)
+				assert_lt(items[i-1].seq, items[i].seq);
+		}
+	};
 	
-	This->lock.lock();
-	multievent* done=new multievent();
+	array<rec> a = items;
+	parallel_ssort(a, [](const rec& a, const rec& b) { return a.key < b.key; });
+	check(a, true);
 	
-	This->work=work;
-	This->id=1;
-	This->done=done;
-	
-	while (lock_read(&This->numidle) < count-1)
-	{
-		This->numthreads++;
-		lock_incr(&This->numidle);
-		thread_create(bind_ptr(threadproc, This));
-	}
+	a = items;
+	parallel_radix_sort(a, [](const rec& r) { return r.key; });
+	check(a, true);
 	
-	This->wake->signal(count-1);
-	This->started->wait(count-1);
-	This->lock.unlock();
+	a = items;
+	parallel_sort(a, [](const rec& a, const rec& b) { return a.key < b.key; });
+	check(a, false);
 	
-	work(0);
+	array<int> b;
+	for (int i=0;i<100000;i++)
+		b.append(i*7919 % 100003 - 50000);
+	parallel_sort(b);
+	for (size_t i=1;i<b.size();i++)
+		assert_lt(b[i-1], b[i]);
 	
-	done->wait(count-1);
-	delete done;
+	parallel_ssort(arrayvieww<int>());
 }
 #endif
@@ -2,6 +2,7 @@
 #include "../global.h"
 
 #include "atomic.h"
+#include "../sort.h"
 
 #ifdef ARLIB_THREAD
 //It is safe (though may yield a performance penalty) to malloc() something in one thread and free() it in another.
@@ -184,10 +185,16 @@ static inline size_t thread_get_id() { return pthread_self(); }
 static inline size_t thread_get_id() { return GetCurrentThreadId(); }
 #endif
 
-//This one creates 'count' threads, calls work() in each of them with 'id' from 0 to 'count'-1, and
-// returns once each thread has returned.
-//Unlike thread_create, thread_split is expected to be called often, for short-running tasks. The threads may be reused.
-void thread_split(unsigned int count, function<void(unsigned int id)> work);
+//Calls work() with 'id' from 0 to 'count'-1, spread over the thread pool and the calling thread, and returns once all of them have returned.
+//The ids are handed out dynamically, so a thread may get any number of them, in any order.
+//Unlike thread_create, thread_split is expected to be called often, for short-running tasks. It may be called from inside a pool job.
+//pri_idle uses a separate pool, with thread_num_cores_idle() threads; other priorities use the same pool.
+void thread_split(unsigned int count, function<void(unsigned int id)> work, priority_t pri = pri_default);
+
+//Runs the given function on a worker thread, some time later. There are thread_num_cores() workers, created on first use,
+// and shut down (after finishing any queued jobs) when the program exits. Priority is as for thread_split.
+//A job must not block waiting for another job, there may be only one worker. (Calling thread_split is fine, though.)
+void thread_pool_run(function<void()>&& job, priority_t pri = pri_default);
 
 
 ////It is permitted to define this as (e.g.) QThreadStorage<T> rather than compiler magic.
@@ -249,5 +256,125 @@ public:
 #define synchronized(mutex) if (true)
 static inline size_t thread_get_id() { return 0; }
 static inline unsigned int thread_num_cores() { return 1; }
+static inline void thread_split(unsigned int count, function<void(unsigned int id)> work)
+{
+	for (unsigned int id=0;id<count;id++)
+		work(id);
+}
 
 #endif
+
+//Splits range (an arrayview or arrayvieww) into chunks of 'grain' items, the last one possibly smaller,
+// and calls fn(chunk) for each of them, using thread_split. If grain is zero, a suitable size is chosen.
+template<typename Tv, typename Tf>
+void parallel_for(Tv range, size_t grain, Tf&& fn)
+{
+	if (!grain)
+		grain = max(range.size() / (thread_num_cores()*4), (size_t)1);
+	struct ctx_t {
+		Tv* range;
+		size_t grain;
+		std::remove_reference_t<Tf>* fn;
+	} ctx = { &range, grain, &fn };
+	thread_split((range.size() + grain-1) / grain, [&ctx](unsigned int id) {
+		size_t start = (size_t)id * ctx.grain;
+		(*ctx.fn)(ctx.range->slice(start, min(ctx.grain, ctx.range->size()-start)));
+	});
+}
+
+//Like parallel_for, but map(chunk) returns a value, and they're combined with reduce(a, b), starting with init.
+//reduce is called on the calling thread, in order, after all chunks are done; it must be associative, but needn't be commutative.
+//Tr must be default constructible.
+template<typename Tv, typename Tr, typename Tmap, typename Treduce>
+Tr parallel_reduce(Tv range, size_t grain, Tr init, Tmap&& map, Treduce&& reduce)
+{
+	if (!grain)
+		grain = max(range.size() / (thread_num_cores()*4), (size_t)1);
+	size_t n_chunks = (range.size() + grain-1) / grain;
+	Tr* parts = new Tr[n_chunks];
+	struct ctx_t {
+		Tv* range;
+		size_t grain;
+		std::remove_reference_t<Tmap>* map;
+		Tr* parts;
+	} ctx = { &range, grain, &map, parts };
+	thread_split(n_chunks, [&ctx](unsigned int id) {
+		size_t start = (size_t)id * ctx.grain;
+		ctx.parts[id] = (*ctx.map)(ctx.range->slice(start, min(ctx.grain, ctx.range->size()-start)));
+	});
+	for (size_t i=0;i<n_chunks;i++)
+		init = reduce(std::move(init), std::move(parts[i]));
+	delete[] parts;
+	return init;
+}
+
+template<typename T> class arrayvieww;
+
+//Sorts chunks of items with sort_chunk(arrayvieww<T>) on all cores, then merges them with less, also in parallel
+// (except the last merge, which is done by a single thread). The result is stable if sort_chunk is.
+//Small inputs are passed to sort_chunk unchanged.
+template<typename T, typename Tsort, typename Tless>
+void parallel_merge_sort(arrayvieww<T> items, Tsort&& sort_chunk, const Tless& less)
+{
+	size_t count = items.size();
+	unsigned int n_cores = thread_num_cores();
+	if (count <= 4096 || n_cores == 1)
+	{
+		sort_chunk(items);
+		return;
+	}
+	
+	// chunk size must be a power of two multiple of the merge sort's run size, or the pairs won't line up
+	size_t chunk = max(bitround((count + n_cores-1) / n_cores), sorting::run_size);
+	parallel_for(items, chunk, sort_chunk);
+	if (chunk >= count)
+		return;
+	
+	T* scratch = xmalloc(sizeof(T)*count);
+	struct ctx_t {
+		T* src;
+		T* dst;
+		size_t count;
+		size_t width;
+		const Tless* less;
+	} ctx = { items.ptr(), scratch, count, chunk, &less };
+	for (;ctx.width<count;ctx.width*=2)
+	{
+		thread_split((count + ctx.width*2-1) / (ctx.width*2), [&ctx](unsigned int id) {
+			size_t start = (size_t)id * ctx.width*2;
+			sorting::merge_pass(ctx.src+start, ctx.dst+start, min(ctx.width*2, ctx.count-start), ctx.width, *ctx.less);
+		});
+		std::swap(ctx.src, ctx.dst);
+	}
+	if (ctx.src != items.ptr())
+		memcpy((void*)items.ptr(), (void*)ctx.src, sizeof(T)*count);
+	free(scratch);
+}
+
+//Like arrayvieww::sort, ssort and radix_sort, but using all cores.
+template<typename T, typename Tless>
+void parallel_sort(arrayvieww<T> items, const Tless& less)
+{
+	parallel_merge_sort(items, [&less](arrayvieww<T> chunk) { chunk.sort(less); }, less);
+}
+template<typename T>
+void parallel_sort(arrayvieww<T> items)
+{
+	parallel_merge_sort(items, [](arrayvieww<T> chunk) { chunk.sort(); }, [](const T& a, const T& b) { return a < b; });
+}
+template<typename T, typename Tless>
+void parallel_ssort(arrayvieww<T> items, const Tless& less)
+{
+	parallel_merge_sort(items, [&less](arrayvieww<T> chunk) { chunk.ssort(less); }, less);
+}
+template<typename T>
+void parallel_ssort(arrayvieww<T> items)
+{
+	parallel_ssort(items, [](const T& a, const T& b) { return a < b; });
+}
+template<typename T, typename Tkey>
+void parallel_radix_sort(arrayvieww<T> items, const Tkey& key)
+{
+	parallel_merge_sort(items, [&key](arrayvieww<T> chunk) { chunk.radix_sort(key); },
+		[&key](const T& a, const T& b) { return key(a) < key(b); });
+}
@@ -173,97 +173,6 @@ public:
 	
 	waiter<void> sshwait = make_waiter<&magic_proxy::sshwait, &magic_proxy::ssh_complete>();
 	
-	struct direct_child {
-		autoptr<socket2> sock1;
-		autoptr<socket2> sock2;
-		size_t n_to_sock1 = 0;
-		size_t n_to_sock2 = 0;
-		uint8_t buf1[512];
-		uint8_t buf2[512];
-		
-		// anything involving n_to_sock2
-		waiter<void> wait1 = make_waiter<&direct_child::wait1, &direct_child::complete1>();
-		
-		// anything involving n_to_sock1
-		waiter<void> wait2 = make_waiter<&direct_child::wait2, &direct_child::complete2>();
-		
-		void init(autoptr<socket2> sock1, autoptr<socket2> sock2)
-		{
-			this->sock1 = std::move(sock1);
-			this->sock2 = std::move(sock2);
-			n_to_sock1 = 0;
-			n_to_sock2 = 0;
-			set_waiters();
-		}
-		
-		void set_waiters()
-		{
-			if (!wait1.is_waiting())
-			{
-				if (n_to_sock2)
-					sock2->can_send().then(&wait1);
-				else
-					sock1->can_recv().then(&wait1);
-			}
-			if (!wait2.is_waiting())
-			{
-				if (n_to_sock1)
-					sock1->can_send().then(&wait2);
-				else
-					sock2->can_recv().then(&wait2);
-			}
-		}
-		
-		void complete1()
-		{
-			if (n_to_sock2 == 0)
-			{
-				ssize_t n = sock1->recv_sync(buf1);
-				if (n < 0)
-					return cancel();
-				n_to_sock2 = n;
-			}
-			if (n_to_sock2 != 0)
-			{
-				ssize_t n = sock2->send_sync(bytesr(buf1, n_to_sock2));
-				if (n < 0)
-					return cancel();
-				memmove(buf1, buf1+n, n_to_sock2-n);
-				n_to_sock2 -= n;
-			}
-			set_waiters();
-		}
-		
-		void complete2()
-		{
-			if (n_to_sock1 == 0)
-			{
-				ssize_t n = sock2->recv_sync(buf2);
-				if (n < 0)
-					return cancel();
-				n_to_sock1 = n;
-			}
-			if (n_to_sock1 != 0)
-			{
-				ssize_t n = sock1->send_sync(bytesr(buf2, n_to_sock1));
-				if (n < 0)
-					return cancel();
-				memmove(buf2, buf2+n, n_to_sock1-n);
-				n_to_sock1 -= n;
-			}
-			set_waiters();
-		}
-		
-		void cancel()
-		{
-			wait1.cancel();
-			wait2.cancel();
-			sock1 = nullptr;
-			sock2 = nullptr;
-		}
-	};
-	refarray<direct_child> direct_children;
-	
 	struct ssh_child {
 		autoptr<socket2> sock1;
 		LIBSSH2_CHANNEL* sock2;
@@ -703,18 +612,7 @@ public:
 			}
 			
 	//puts("READY");
-			direct_child* chp = nullptr;
-			for (direct_child& ch : direct_children)
-			{
-				if (!ch.sock1)
-				{
-					chp = &ch;
-					break;
-				}
-			}
-			if (!chp)
-				chp = &direct_children.append();
-			chp->init(std::move(sock), std::move(remote_sock));
+			co_await socket2::relay(sock, remote_sock);
 		}
 		
 		co_return;
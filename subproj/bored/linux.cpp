@@ -48,38 +48,25 @@ static bool read_stat(struct stat * stbuf, bytestream& in)
 	return true;
 }
 
-struct statcache {
-	time_t expiry = 0;
-	struct stat stbuf;
-};
-static map<string,statcache> g_cache;
-struct dircache {
-	time_t expiry = 0;
-	array<string> contents;
-};
-static map<string,dircache> g_dir_cache;
-static time_t g_cache_revalidate = 0;
+// Every write operation clears the caches, so the expiry is only for noticing other clients' changes.
+static lru_cache<string,struct stat> g_cache(65536);
+static lru_cache<string,array<string>> g_dir_cache(4096);
+static void cache_invalidate()
+{
+	g_cache.reset();
+	g_dir_cache.reset();
+}
 
 static void cache_add(const char * path, struct stat * stbuf)
 {
-	time_t now = time(NULL);
-	statcache& c = g_cache.get_create(path);
-	c.stbuf = *stbuf;
-	c.expiry = now+5;
-	g_cache_revalidate = now+5;
+	g_cache.insert(path, *stbuf, 1, timestamp::in_sec(5));
 }
 static bool cache_get(const char * path, struct stat * stbuf)
 {
-	time_t now = time(NULL);
-	if (now > g_cache_revalidate)
+	struct stat* c = g_cache.get(cstring(path));
+	if (c)
 	{
-		g_cache.reset();
-		g_dir_cache.reset();
-	}
-	statcache* c = g_cache.get_or_null(path);
-	if (c && c->expiry >= now)
-	{
-		*stbuf = c->stbuf;
+		*stbuf = *c;
 		return true;
 	}
 	return false;
@@ -87,23 +74,12 @@ static bool cache_get(const char * path, struct stat * stbuf)
 
 static array<string>& cache_dir_add(const char * path)
 {
-	time_t now = time(NULL);
-	dircache& c = g_dir_cache.get_create(path);
-	c.contents.reset();
-	c.expiry = now+5;
-	g_cache_revalidate = now+5;
-	return c.contents;
+	return g_dir_cache.insert(path, {}, 1, timestamp::in_sec(5));
 }
 static arrayview<string> cache_dir_get(const char * path)
 {
-	time_t now = time(NULL);
-	if (now > g_cache_revalidate)
-	{
-		g_cache.reset();
-		g_dir_cache.reset();
-	}
-	dircache* c = g_dir_cache.get_or_null(path);
-	if (c && c->expiry >= now) return c->contents;
+	array<string>* c = g_dir_cache.get(cstring(path));
+	if (c) return *c;
 	return {};
 }
 
@@ -482,7 +458,7 @@ puts("connected "+addr);
 	};
 	f_ops.create = [](const char * path, mode_t mode, struct fuse_file_info * fi) -> int
 	{
-		g_cache_revalidate = 0;
+		cache_invalidate();
 		return shared_open(path, true, fi);
 	};
 	f_ops.read = [](const char * path, char * buf, size_t size, off_t offset, struct fuse_file_info * fi) -> int
@@ -544,7 +520,7 @@ puts("connected "+addr);
 	};
 	f_ops.rename = [](const char * oldpath, const char * newpath) -> int
 	{
-		g_cache_revalidate = 0;
+		cache_invalidate();
 		
 		bytestreamw_dyn req;
 		req.u32l(REQ_RENAME);
@@ -557,7 +533,7 @@ puts("connected "+addr);
 	};
 	f_ops.unlink = [](const char * path) -> int
 	{
-		g_cache_revalidate = 0;
+		cache_invalidate();
 		
 		bytestreamw_dyn req;
 		req.u32l(REQ_DELETE);
@@ -569,7 +545,7 @@ puts("connected "+addr);
 	};
 	f_ops.mkdir = [](const char * path, mode_t mode) -> int
 	{
-		g_cache_revalidate = 0;
+		cache_invalidate();
 		
 		bytestreamw_dyn req;
 		req.u32l(REQ_MKDIR);
@@ -581,7 +557,7 @@ puts("connected "+addr);
 	};
 	f_ops.rmdir = [](const char * path) -> int
 	{
-		g_cache_revalidate = 0;
+		cache_invalidate();
 		
 		bytestreamw_dyn req;
 		req.u32l(REQ_RMDIR);